@@ -0,0 +1,115 @@
+"""Compare zarr write throughput against compression ratio for each codec.
+
+The test image mimics widefield fluorescence microscopy: a camera offset,
+Gaussian shaped cells with varying brightness and Poisson shot noise, stored
+as uint16. An existing image can be used instead with --source.
+
+    python benchmarks/bench_compression.py --size 8192 --chunk 1024
+    python benchmarks/bench_compression.py --source image.ome.tif
+"""
+
+import argparse
+import os
+import tempfile
+import time
+
+import numpy as np
+from bfiocpp import TSReader, TSWriter, Seq, FileType
+
+CODECS = [
+    ("none", {}),
+    ("blosc", {"blosc_cname": "lz4", "shuffle": "shuffle"}),
+    ("blosc", {"blosc_cname": "lz4", "shuffle": "bitshuffle"}),
+    ("blosc", {"blosc_cname": "zstd", "shuffle": "bitshuffle"}),
+    ("zstd", {"compression_level": 1}),
+    ("zstd", {"compression_level": 5}),
+    ("gzip", {"compression_level": 1}),
+    ("gzip", {"compression_level": 6}),
+]
+
+
+def synthetic_image(size, seed=0):
+    rng = np.random.default_rng(seed)
+    image = np.full((size, size), 100.0, dtype=np.float32)
+    yy, xx = np.mgrid[-24:25, -24:25]
+    num_cells = size * size // 4000
+    for y, x, sigma, peak in zip(
+        rng.integers(24, size - 25, num_cells),
+        rng.integers(24, size - 25, num_cells),
+        rng.uniform(4, 10, num_cells),
+        rng.uniform(200, 3000, num_cells),
+    ):
+        image[y - 24 : y + 25, x - 24 : x + 25] += peak * np.exp(
+            -(yy**2 + xx**2) / (2 * sigma**2)
+        )
+    return rng.poisson(image).astype(np.uint16)
+
+
+def load_image(path):
+    br = TSReader(path, FileType.OmeTiff, "")
+    data = br.data(
+        Seq(0, br._Y - 1, 1),
+        Seq(0, br._X - 1, 1),
+        Seq(0, 0, 1),
+        Seq(0, 0, 1),
+        Seq(0, 0, 1),
+    )
+    return data[0, 0, 0]
+
+
+def directory_size(path):
+    total = 0
+    for root, _, files in os.walk(path):
+        total += sum(os.path.getsize(os.path.join(root, f)) for f in files)
+    return total
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--size", type=int, default=8192)
+    parser.add_argument("--chunk", type=int, default=1024)
+    parser.add_argument("--source", type=str, default=None)
+    parser.add_argument("--threads", type=int, default=0)
+    args = parser.parse_args()
+
+    image = load_image(args.source) if args.source else synthetic_image(args.size)
+    image = image.reshape((1, 1, 1) + image.shape)
+    shape = list(image.shape)
+    chunk_shape = [1, 1, 1, args.chunk, args.chunk]
+    image_mb = image.nbytes / 1e6
+    print(f"image {shape[3]}x{shape[4]} {image.dtype}, {image_mb:.1f} MB")
+    print(f"{'format':>6} {'codec':>28} {'MB/s':>8} {'ratio':>6}")
+
+    for file_type, label in [(FileType.OmeZarrV2, "v2"), (FileType.OmeZarrV3, "v3")]:
+        for codec, options in CODECS:
+            with tempfile.TemporaryDirectory() as dir:
+                path = os.path.join(dir, "bench.zarr")
+                start = time.perf_counter()
+                with TSWriter(
+                    path,
+                    shape,
+                    chunk_shape,
+                    str(image.dtype),
+                    "TCZYX",
+                    file_type,
+                    compression=codec,
+                    compression_threads=args.threads,
+                    **options,
+                ) as bw:
+                    bw.write_image_data(
+                        image,
+                        Seq(0, shape[3] - 1, 1),
+                        Seq(0, shape[4] - 1, 1),
+                        Seq(0, 0, 1),
+                        Seq(0, 0, 1),
+                        Seq(0, 0, 1),
+                    )
+                elapsed = time.perf_counter() - start
+                ratio = image.nbytes / directory_size(path)
+
+            name = codec + "".join(f" {k}={v}" for k, v in options.items())
+            print(f"{label:>6} {name:>28} {image_mb / elapsed:>8.1f} {ratio:>6.2f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,80 @@
+"""Measure how many files per second are catalogued by probe and by opening readers.
+
+Writes a collection of small OME-TIFF or OME-Zarr images (or uses the files given
+with --files) and reports files per second for probe_images(), open_readers() and
+one TSReader per file.
+
+    python benchmarks/bench_probe.py --count 2000 --format tiff
+"""
+
+import argparse
+import glob
+import os
+import tempfile
+import time
+
+import numpy as np
+from bfiocpp import TSReader, TSWriter, Seq, FileType, open_readers, probe_images
+
+
+def write_collection(dir, count, file_type):
+    shape = [1, 2, 1, 256, 256]
+    data = np.zeros(shape, dtype=np.uint16)
+    extension = ".ome.tif" if file_type == FileType.OmeTiff else ".zarr"
+    files = []
+    for i in range(count):
+        path = os.path.join(dir, f"field_{i:05d}{extension}")
+        bw = TSWriter(path, shape, [1, 1, 1, 128, 128], "uint16", "TCZYX", file_type)
+        bw.write_image_data(
+            data,
+            Seq(0, 255, 1),
+            Seq(0, 255, 1),
+            Seq(0, 0, 1),
+            Seq(0, 1, 1),
+            Seq(0, 0, 1),
+        )
+        bw.close()
+        files.append(path)
+    return files
+
+
+def timed(label, count, function):
+    start = time.perf_counter()
+    function()
+    elapsed = time.perf_counter() - start
+    print(f"{label:>14} {count / elapsed:>12.0f} {elapsed:>8.2f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--count", type=int, default=1000)
+    parser.add_argument("--format", choices=["tiff", "zarr"], default="tiff")
+    parser.add_argument("--files", help="glob of existing images instead of writing")
+    parser.add_argument("--threads", type=int, default=0)
+    args = parser.parse_args()
+
+    file_type = FileType.OmeTiff if args.format == "tiff" else FileType.OmeZarrV2
+    with tempfile.TemporaryDirectory() as dir:
+        if args.files:
+            files = sorted(glob.glob(args.files))
+        else:
+            files = write_collection(dir, args.count, file_type)
+        count = len(files)
+        print(f"{count} {args.format} files")
+        print(f"{'method':>14} {'files/s':>12} {'seconds':>8}")
+
+        timed("probe", count, lambda: probe_images(files, file_type, "", args.threads))
+        timed(
+            "open_readers",
+            count,
+            lambda: list(open_readers(files, file_type, "", num_threads=args.threads)),
+        )
+        timed(
+            "TSReader",
+            count,
+            lambda: [TSReader(path, file_type, "") for path in files],
+        )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,81 @@
+"""Measure write amplification of unaligned tile writes with and without staging.
+
+Writes a synthetic image as tiles that do not line up with the zarr chunks and
+reports the bytes passed to write() per byte of image, as counted by the kernel
+in /proc/self/io (Linux only).
+
+    python benchmarks/bench_write_staging.py --size 8192 --tile 1000 --chunk 1024
+"""
+
+import argparse
+import os
+import tempfile
+import time
+
+import numpy as np
+from bfiocpp import TSWriter, Seq
+
+
+def io_counters():
+    counters = {}
+    with open("/proc/self/io") as f:
+        for line in f:
+            key, value = line.split(":")
+            counters[key] = int(value)
+    return counters
+
+
+def write_tiles(path, size, tile, chunk, staging_bytes):
+    shape = [1, 1, 1, size, size]
+    chunk_shape = [1, 1, 1, chunk, chunk]
+    rng = np.random.default_rng(0)
+
+    with TSWriter(
+        path, shape, chunk_shape, "uint16", "TCZYX", staging_bytes=staging_bytes
+    ) as bw:
+        for y in range(0, size, tile):
+            for x in range(0, size, tile):
+                h = min(tile, size - y)
+                w = min(tile, size - x)
+                data = rng.integers(0, 4096, (1, 1, 1, h, w), dtype=np.uint16)
+                bw.write_image_data(
+                    data,
+                    Seq(y, y + h - 1, 1),
+                    Seq(x, x + w - 1, 1),
+                    Seq(0, 0, 1),
+                    Seq(0, 0, 1),
+                    Seq(0, 0, 1),
+                )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--size", type=int, default=8192)
+    parser.add_argument("--tile", type=int, default=1000)
+    parser.add_argument("--chunk", type=int, default=1024)
+    parser.add_argument("--staging-mb", type=int, default=512)
+    args = parser.parse_args()
+
+    image_bytes = args.size * args.size * 2
+    print(
+        f"image {args.size}x{args.size} uint16, tiles {args.tile}, chunks {args.chunk}"
+    )
+    print(f"{'staging':>12} {'written/image':>14} {'read/image':>11} {'seconds':>8}")
+
+    for staging_mb in [0, args.staging_mb]:
+        with tempfile.TemporaryDirectory() as dir:
+            path = os.path.join(dir, "bench.zarr")
+            before = io_counters()
+            start = time.perf_counter()
+            write_tiles(path, args.size, args.tile, args.chunk, staging_mb << 20)
+            elapsed = time.perf_counter() - start
+            after = io_counters()
+
+        written = (after["wchar"] - before["wchar"]) / image_bytes
+        read = (after["rchar"] - before["rchar"]) / image_bytes
+        label = f"{staging_mb} MB" if staging_mb else "off"
+        print(f"{label:>12} {written:>14.2f} {read:>11.2f} {elapsed:>8.2f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -102,6 +102,12 @@ setup(
     package_dir={"": "src/python"},
     ext_modules=[CMakeExtension("bfiocpp/libbfiocpp")],
     test_suite="tests",
+    entry_points={
+        "console_scripts": [
+            "bfiocpp-convert=bfiocpp.convert:main",
+            "bfiocpp-rechunk=bfiocpp.convert:rechunk_main",
+        ],
+    },
     zip_safe=False,
     python_requires=">=3.8",
     install_requires=[
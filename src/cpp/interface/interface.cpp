@@ -2,10 +2,19 @@
 #include <pybind11/stl_bind.h>
 #include <pybind11/stl.h>
 #include <pybind11/numpy.h>
+#include <cctype>
 #include <tuple>
+#include "../reader/array_view.h"
+#include "../reader/batch_open.h"
+#include "../reader/map_tiles.h"
+#include "../reader/patch_sampler.h"
+#include "../reader/probe.h"
+#include "../reader/sliding_window.h"
+#include "../reader/thumbnail.h"
 #include "../reader/tsreader.h"
 #include "../utilities/sequence.h"
 #include "../utilities/utilities.h"
+#include "../writer/image_converter.h"
 #include "../writer/tswriter.h"
 
 namespace py = pybind11;
@@ -16,11 +25,11 @@ using bfiocpp::Seq;
         auto size = std::get<N>(*seq_ptr).size(); \
         auto data = std::get<N>(*seq_ptr).data(); \
         auto capsule = py::capsule(new auto (seq_ptr), [](void *p) {delete reinterpret_cast<decltype(seq_ptr)*>(p);}); \
-        return py::array(size, data, capsule).reshape({num_tsteps, num_channels, num_layers, num_rows, num_cols}); \
+        return py::array(size, data, capsule).reshape(shape); \
         break; \
     }
 
-inline py::array as_pyarray_shared_5d(std::shared_ptr<image_data> seq_ptr, size_t num_rows, size_t num_cols, size_t num_layers=1, size_t num_channels=1, size_t num_tsteps=1 ) {
+inline py::array as_pyarray_shared(std::shared_ptr<image_data> seq_ptr, const std::vector<py::ssize_t>& shape) {
     switch (seq_ptr->index()) {
         EXTRACT_FROM_VARIANT_AND_RETURN(0)
         EXTRACT_FROM_VARIANT_AND_RETURN(1)
@@ -35,14 +44,47 @@ inline py::array as_pyarray_shared_5d(std::shared_ptr<image_data> seq_ptr, size_
     }
 }
 
-py::array get_image_data(bfiocpp::TsReaderCPP& tl, const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps) {
-    auto tmp = tl.GetImageData(rows, cols, layers, channels, tsteps);
+inline py::array as_pyarray_shared_5d(std::shared_ptr<image_data> seq_ptr, size_t num_rows, size_t num_cols, size_t num_layers=1, size_t num_channels=1, size_t num_tsteps=1 ) {
+    return as_pyarray_shared(seq_ptr, {static_cast<py::ssize_t>(num_tsteps), static_cast<py::ssize_t>(num_channels), static_cast<py::ssize_t>(num_layers),
+                                       static_cast<py::ssize_t>(num_rows), static_cast<py::ssize_t>(num_cols)});
+}
+
+// array backed by data, which the capsule keeps alive. data must not be shared with anything
+// else (a freshly read or allocated array), since numpy may write to it.
+inline py::array as_pyarray_view(const tensorstore::SharedArray<const void>& data, const std::vector<py::ssize_t>& shape) {
+    auto capsule = py::capsule(new tensorstore::SharedArray<const void>(data),
+                               [](void *p) {delete reinterpret_cast<tensorstore::SharedArray<const void>*>(p);});
+    return py::array(py::dtype(std::string(data.dtype().name())), shape, data.data(), capsule);
+}
+
+inline py::array as_pyarray_view(const tensorstore::SharedArray<const void>& data) {
+    return as_pyarray_view(data, std::vector<py::ssize_t>(data.shape().begin(), data.shape().end()));
+}
+
+py::array get_image_data(bfiocpp::TsReaderCPP& tl, const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+                         const bfiocpp::ReadConversion& conversion = bfiocpp::ReadConversion(), const std::string& axis_order = "") {
     auto ih = rows.Stop() - rows.Start() + 1;
     auto iw = cols.Stop() - cols.Start() + 1;
     auto id = layers.Stop() - layers.Start() + 1;;
     auto nc = channels.Stop() - channels.Start() + 1;
     auto nt = tsteps.Stop() - tsteps.Start() + 1;
- 
+
+    if (axis_order.empty() && conversion.IsIdentity(bfiocpp::GetDataTypeCode(tl.GetDataType()))) {
+        if (auto chunk = tl.GetChunkData(rows, cols, layers, channels, tsteps)) {
+            return as_pyarray_view(*chunk, {1, 1, 1, static_cast<py::ssize_t>(ih), static_cast<py::ssize_t>(iw)});
+        }
+    }
+    auto tmp = tl.GetImageData(rows, cols, layers, channels, tsteps, conversion, axis_order);
+
+    if (!axis_order.empty()) {
+        // GetImageData has validated the axis order
+        const std::string axes = "TCZYX";
+        const py::ssize_t sizes[] = {static_cast<py::ssize_t>(nt), static_cast<py::ssize_t>(nc), static_cast<py::ssize_t>(id),
+                                     static_cast<py::ssize_t>(ih), static_cast<py::ssize_t>(iw)};
+        std::vector<py::ssize_t> shape;
+        for (char axis : axis_order) shape.push_back(sizes[axes.find(static_cast<char>(std::toupper(static_cast<unsigned char>(axis))))]);
+        return as_pyarray_shared(tmp, shape);
+    }
     return as_pyarray_shared_5d(tmp, ih, iw, id, nc, nt) ;
 }
 
@@ -59,13 +101,17 @@ py::array get_iterator_requested_tile_data(bfiocpp::TsReaderCPP& tl,  std::int64
     auto channels = Seq(c_index, c_index, 1);
     auto tsteps = Seq(t_index, t_index, 1);
 
-    auto tmp = tl.GetImageData(rows, cols, layers, channels, tsteps);
     auto ih = rows.Stop() - rows.Start() + 1;
     auto iw = cols.Stop() - cols.Start() + 1;
     auto id = layers.Stop() - layers.Start() + 1;;
     auto nc = channels.Stop() - channels.Start() + 1;
     auto nt = tsteps.Stop() - tsteps.Start() + 1;
- 
+
+    // tiles aligned to the chunk grid skip the zero-filled output buffer
+    if (auto chunk = tl.GetChunkData(rows, cols, layers, channels, tsteps)) {
+        return as_pyarray_view(*chunk, {1, 1, 1, static_cast<py::ssize_t>(ih), static_cast<py::ssize_t>(iw)});
+    }
+    auto tmp = tl.GetImageData(rows, cols, layers, channels, tsteps);
     return as_pyarray_shared_5d(tmp, ih, iw, id, nc, nt) ;
 }
 
@@ -74,7 +120,9 @@ PYBIND11_MODULE(libbfiocpp, m) {
         .def(py::init<const size_t, const size_t, const size_t>());
     
     py::class_<bfiocpp::TsReaderCPP, std::shared_ptr<bfiocpp::TsReaderCPP>>(m, "TsReaderCPP") 
-    .def(py::init<const std::string &, bfiocpp::FileType, const std::string &>()) 
+    .def(py::init<const std::string &, bfiocpp::FileType, const std::string &, const std::vector<std::int64_t> &>(),
+         py::arg("fname"), py::arg("file_type"), py::arg("axes_list"),
+         py::arg("tiles_per_chunk") = std::vector<std::int64_t>{}) 
     .def("get_image_height", &bfiocpp::TsReaderCPP::GetImageHeight) 
     .def("get_image_width", &bfiocpp::TsReaderCPP::GetImageWidth) 
     .def("get_image_depth", &bfiocpp::TsReaderCPP::GetImageDepth) 
@@ -84,6 +132,11 @@ PYBIND11_MODULE(libbfiocpp, m) {
     .def("get_channel_count", &bfiocpp::TsReaderCPP::GetChannelCount) 
     .def("get_tstep_count", &bfiocpp::TsReaderCPP::GetTstepCount) 
     .def("get_datatype", &bfiocpp::TsReaderCPP::GetDataType)
+    .def("get_level_count", &bfiocpp::TsReaderCPP::GetLevelCount)
+    .def("get_level", &bfiocpp::TsReaderCPP::GetLevel)
+    .def("get_level_scale", &bfiocpp::TsReaderCPP::GetLevelScale)
+    .def("set_level", &bfiocpp::TsReaderCPP::SetLevel)
+    .def("get_level_for_size", &bfiocpp::TsReaderCPP::GetLevelForSize)
     .def("get_tile_coordinate",
         [](bfiocpp::TsReaderCPP& tl, std::int64_t y_start, std::int64_t x_start, std::int64_t row_stride, std::int64_t col_stride) { 
             auto row_index = static_cast<std::int64_t>(y_start/row_stride);
@@ -92,9 +145,95 @@ PYBIND11_MODULE(libbfiocpp, m) {
         }
     )
     .def("get_image_data",  
-        [](bfiocpp::TsReaderCPP& tl, const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps) { 
-            return get_image_data(tl, rows, cols, layers, channels, tsteps);
-        }, py::return_value_policy::reference) 
+        [](bfiocpp::TsReaderCPP& tl, const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+           const bfiocpp::ReadConversion& conversion, const std::string& axis_order) { 
+            return get_image_data(tl, rows, cols, layers, channels, tsteps, conversion, axis_order);
+        }, py::arg("rows"), py::arg("cols"), py::arg("layers"), py::arg("channels"), py::arg("tsteps"),
+        py::arg("conversion") = bfiocpp::ReadConversion(), py::arg("axis_order") = "", py::return_value_policy::reference) 
+    .def("get_projection",
+        [](bfiocpp::TsReaderCPP& tl, const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+           const std::string& method, const std::string& axis) {
+            std::shared_ptr<image_data> tmp;
+            {
+                // the result is wrapped in a numpy array, which needs the GIL again
+                py::gil_scoped_release release;
+                tmp = tl.GetProjection(rows, cols, layers, channels, tsteps, method, axis);
+            }
+            auto ih = rows.Stop() - rows.Start() + 1;
+            auto iw = cols.Stop() - cols.Start() + 1;
+            auto id = axis == "Z" ? 1 : layers.Stop() - layers.Start() + 1;
+            auto nc = channels.Stop() - channels.Start() + 1;
+            auto nt = axis == "T" ? 1 : tsteps.Stop() - tsteps.Start() + 1;
+            return as_pyarray_shared_5d(tmp, ih, iw, id, nc, nt);
+        }, py::arg("rows"), py::arg("cols"), py::arg("layers"), py::arg("channels"), py::arg("tsteps"),
+        py::arg("method") = "max", py::arg("axis") = "Z")
+    .def("set_shading_correction", &bfiocpp::TsReaderCPP::SetShadingCorrection,
+         py::arg("flat") = nullptr, py::arg("dark") = nullptr, py::call_guard<py::gil_scoped_release>())
+    .def("compute_statistics", &bfiocpp::TsReaderCPP::ComputeStatistics,
+         py::arg("options") = bfiocpp::StatisticsOptions(), py::call_guard<py::gil_scoped_release>())
+    .def("map_tiles",
+        [](bfiocpp::TsReaderCPP& tl, const py::object& kernel, const std::map<std::string, double>& params,
+           const bfiocpp::MapTilesOptions& options, std::shared_ptr<bfiocpp::TsWriterCPP> output) {
+            bfiocpp::TileKernel tile_kernel;
+            if (py::isinstance<py::str>(kernel)) {
+                tile_kernel = bfiocpp::GetTileKernel(kernel.cast<std::string>(), params);
+            } else {
+                // Python callbacks run one at a time under the GIL, reads and writes stay concurrent
+                tile_kernel = [callback = py::handle(kernel)](double* tile, std::int64_t height, std::int64_t width) {
+                    py::gil_scoped_acquire acquire;
+                    try {
+                        // the callback gets its own copy, tile is reused once it returns
+                        py::array_t<double> copy({height, width});
+                        std::copy(tile, tile + height * width, copy.mutable_data());
+                        py::object result = callback(copy);
+                        auto values = result.is_none() ? copy : py::array_t<double, py::array::c_style | py::array::forcecast>::ensure(result);
+                        if (!values || values.size() != height * width) {
+                            throw std::invalid_argument("tile callback must return None or an array of the tile shape");
+                        }
+                        std::copy(values.data(), values.data() + values.size(), tile);
+                    } catch (py::error_already_set& e) {
+                        // the Python error can only be released while the GIL is held
+                        throw std::runtime_error(e.what());
+                    }
+                };
+            }
+            py::gil_scoped_release release;
+            return bfiocpp::MapTiles(tl, tile_kernel, options, output.get());
+        }, py::arg("kernel"), py::arg("params") = std::map<std::string, double>{},
+        py::arg("options") = bfiocpp::MapTilesOptions(), py::arg("output") = nullptr)
+    .def("run_sliding_window",
+        [](bfiocpp::TsReaderCPP& tl, bfiocpp::TsWriterCPP& output, const py::function& callback,
+           const bfiocpp::SlidingWindowOptions& options) {
+            // the callback runs under the GIL, reads and writes continue in the background
+            auto window_callback = [callback = py::handle(callback)](const float* window, std::int64_t channels, std::int64_t height,
+                                                                     std::int64_t width, float* result, std::int64_t output_channels) {
+                py::gil_scoped_acquire acquire;
+                try {
+                    py::array_t<float> input({channels, height, width}, window);
+                    auto values = py::array_t<float, py::array::c_style | py::array::forcecast>::ensure(callback(input));
+                    if (!values || values.size() != output_channels * height * width) {
+                        throw std::invalid_argument("sliding window callback must return an array of shape (" + std::to_string(output_channels) + ", " +
+                                                    std::to_string(height) + ", " + std::to_string(width) + ")");
+                    }
+                    std::copy(values.data(), values.data() + values.size(), result);
+                } catch (py::error_already_set& e) {
+                    // the Python error can only be released while the GIL is held
+                    throw std::runtime_error(e.what());
+                }
+            };
+            py::gil_scoped_release release;
+            bfiocpp::RunSlidingWindow(tl, output, window_callback, options);
+        }, py::arg("output"), py::arg("callback"), py::arg("options") = bfiocpp::SlidingWindowOptions())
+    .def("get_thumbnail",
+        [](bfiocpp::TsReaderCPP& tl, const bfiocpp::ThumbnailOptions& options) {
+            tensorstore::SharedArray<const void> thumbnail;
+            {
+                py::gil_scoped_release release;
+                thumbnail = bfiocpp::GetThumbnail(tl, options);
+            }
+            return as_pyarray_view(thumbnail);
+        }, py::arg("options") = bfiocpp::ThumbnailOptions())
+    .def("get_array_view", [](const bfiocpp::TsReaderCPP& tl) {return bfiocpp::TsArrayView(tl);})
     .def("send_iterator_read_requests",
     [](bfiocpp::TsReaderCPP& tl, std::int64_t const tile_height, std::int64_t const tile_width, std::int64_t const row_stride, std::int64_t const col_stride) {
         tl.SetIterReadRequests(tile_height, tile_width, row_stride, col_stride);
@@ -107,11 +246,86 @@ PYBIND11_MODULE(libbfiocpp, m) {
                                     std::int64_t x_min, std::int64_t x_max) {
         return get_iterator_requested_tile_data(tl, t_index, c_index, z_index, y_min, y_max, x_min, x_max);
     }, py::return_value_policy::reference)
+    .def("get_iterator_request_count", [](const bfiocpp::TsReaderCPP& tl) {return tl.iter_request_list.size();})
+    .def("get_iterator_tile_batch",
+    [](bfiocpp::TsReaderCPP& tl, std::size_t first, std::size_t count) {
+        std::shared_ptr<image_data> tmp;
+        {
+            py::gil_scoped_release release;
+            tmp = tl.GetIterTileBatch(first, count);
+        }
+        const auto num_tiles = std::min(count, tl.iter_request_list.size() - first);
+        const auto [tile_height, tile_width] = tl.GetIterTileShape();
+        auto data = as_pyarray_shared(tmp, {static_cast<py::ssize_t>(num_tiles), static_cast<py::ssize_t>(tile_height), static_cast<py::ssize_t>(tile_width)});
+
+        // (T, C, Z, Y_min, Y_max, X_min, X_max) of every tile
+        py::array_t<std::int64_t> coordinates({static_cast<py::ssize_t>(num_tiles), py::ssize_t{7}});
+        auto coordinate = coordinates.mutable_unchecked<2>();
+        for (std::size_t tile = 0; tile < num_tiles; ++tile) {
+            const auto& request = tl.iter_request_list[first + tile];
+            std::apply([&](auto... values) {
+                py::ssize_t column = 0;
+                ((coordinate(tile, column++) = values), ...);
+            }, request);
+        }
+        return std::make_tuple(data, coordinates);
+    })
     .def("__iter__", [](bfiocpp::TsReaderCPP& tl){ 
         return py::make_iterator(tl.iter_request_list.begin(), tl.iter_request_list.end());
         }, py::keep_alive<0, 1>()); 
 
 
+    py::class_<bfiocpp::TsArrayView>(m, "TsArrayView")
+    .def_property_readonly("ndim", &bfiocpp::TsArrayView::Rank)
+    .def_property_readonly("shape", &bfiocpp::TsArrayView::Shape)
+    .def_property_readonly("chunks", &bfiocpp::TsArrayView::Chunks)
+    .def("get_datatype", &bfiocpp::TsArrayView::GetDataType)
+    .def("slice", &bfiocpp::TsArrayView::Slice)
+    .def("index", &bfiocpp::TsArrayView::IndexAt)
+    .def("read",
+        [](const bfiocpp::TsArrayView& view) {
+            std::shared_ptr<image_data> tmp;
+            {
+                py::gil_scoped_release release;
+                tmp = view.Read();
+            }
+            const auto shape = view.Shape();
+            return as_pyarray_shared(tmp, std::vector<py::ssize_t>(shape.begin(), shape.end()));
+        });
+
+    py::class_<bfiocpp::SamplerOptions>(m, "SamplerOptions")
+    .def(py::init<>())
+    .def_readwrite("patch_height", &bfiocpp::SamplerOptions::patch_height)
+    .def_readwrite("patch_width", &bfiocpp::SamplerOptions::patch_width)
+    .def_readwrite("batch_size", &bfiocpp::SamplerOptions::batch_size)
+    .def_readwrite("shuffle_buffer_size", &bfiocpp::SamplerOptions::shuffle_buffer_size)
+    .def_readwrite("prefetch", &bfiocpp::SamplerOptions::prefetch)
+    .def_readwrite("cache_affinity", &bfiocpp::SamplerOptions::cache_affinity)
+    .def_readwrite("seed", &bfiocpp::SamplerOptions::seed);
+
+    py::class_<bfiocpp::SamplingMask>(m, "SamplingMask")
+    .def(py::init<>())
+    .def_readwrite("weights", &bfiocpp::SamplingMask::weights)
+    .def_readwrite("height", &bfiocpp::SamplingMask::height)
+    .def_readwrite("width", &bfiocpp::SamplingMask::width);
+
+    py::class_<bfiocpp::PatchSampler, std::shared_ptr<bfiocpp::PatchSampler>>(m, "PatchSamplerCPP")
+    .def(py::init<const std::vector<std::shared_ptr<bfiocpp::TsReaderCPP>>&, const bfiocpp::SamplerOptions&, const std::vector<bfiocpp::SamplingMask>&>(),
+         py::arg("readers"), py::arg("options"), py::arg("masks") = std::vector<bfiocpp::SamplingMask>{})
+    .def("get_datatype", &bfiocpp::PatchSampler::GetDataType)
+    .def("next_batch",
+        [](bfiocpp::PatchSampler& sampler) {
+            const auto& options = sampler.GetOptions();
+            bfiocpp::PatchBatch batch;
+            {
+                py::gil_scoped_release release;
+                batch = sampler.NextBatch();
+            }
+            auto data = as_pyarray_shared(batch.data, {static_cast<py::ssize_t>(batch.positions.size()), static_cast<py::ssize_t>(sampler.GetChannelCount()),
+                                                       static_cast<py::ssize_t>(options.patch_height), static_cast<py::ssize_t>(options.patch_width)});
+            return std::make_tuple(data, batch.positions);
+        });
+
     py::enum_<bfiocpp::FileType>(m, "FileType")
         .value("OmeTiff", bfiocpp::FileType::OmeTiff)
         .value("OmeZarrV2", bfiocpp::FileType::OmeZarrV2)
@@ -120,15 +334,208 @@ PYBIND11_MODULE(libbfiocpp, m) {
     
     m.def("get_ome_xml", &bfiocpp::GetOmeXml);
 
+    py::class_<bfiocpp::ImageInfo>(m, "ImageInfo")
+    .def_readonly("path", &bfiocpp::ImageInfo::path)
+    .def_readonly("height", &bfiocpp::ImageInfo::height)
+    .def_readonly("width", &bfiocpp::ImageInfo::width)
+    .def_readonly("depth", &bfiocpp::ImageInfo::depth)
+    .def_readonly("num_channels", &bfiocpp::ImageInfo::num_channels)
+    .def_readonly("num_tsteps", &bfiocpp::ImageInfo::num_tsteps)
+    .def_readonly("tile_height", &bfiocpp::ImageInfo::tile_height)
+    .def_readonly("tile_width", &bfiocpp::ImageInfo::tile_width)
+    .def_readonly("data_type", &bfiocpp::ImageInfo::data_type)
+    .def_readonly("num_levels", &bfiocpp::ImageInfo::num_levels)
+    .def_readonly("error", &bfiocpp::ImageInfo::error);
+
+    m.def("probe_image", &bfiocpp::ProbeImage, py::arg("path"), py::arg("file_type"), py::arg("axes_list") = "",
+          py::call_guard<py::gil_scoped_release>());
+    m.def("probe_images", &bfiocpp::ProbeImages, py::arg("paths"), py::arg("file_type"), py::arg("axes_list") = "",
+          py::arg("num_threads") = 0, py::call_guard<py::gil_scoped_release>());
+
+    py::class_<bfiocpp::BatchOpen>(m, "BatchOpen")
+    .def(py::init<const std::vector<std::string>&, bfiocpp::FileType, const std::string&, std::size_t, unsigned int>(),
+         py::arg("files"), py::arg("file_type"), py::arg("axes_list") = "", py::arg("max_in_flight") = 0, py::arg("num_threads") = 0)
+    .def("__len__", &bfiocpp::BatchOpen::Size)
+    .def("next",
+        [](bfiocpp::BatchOpen& batch) -> py::object {
+            std::optional<bfiocpp::OpenResult> result;
+            {
+                py::gil_scoped_release release;
+                result = batch.Next();
+            }
+            if (!result) return py::none();
+            return py::make_tuple(result->index, result->reader, result->error);
+        });
+    m.def("get_thumbnails",
+        [](const std::vector<std::string>& files, bfiocpp::FileType file_type, const std::string& axes_list,
+           const bfiocpp::ThumbnailOptions& options, unsigned int num_threads) {
+            std::vector<bfiocpp::ThumbnailResult> thumbnails;
+            {
+                py::gil_scoped_release release;
+                thumbnails = bfiocpp::GetThumbnails(files, file_type, axes_list, options, num_threads);
+            }
+            py::list results;
+            for (const auto& result : thumbnails) {
+                results.append(py::make_tuple(result.thumbnail.data() ? py::object(as_pyarray_view(result.thumbnail)) : py::none(),
+                                              result.error));
+            }
+            return results;
+        }, py::arg("files"), py::arg("file_type"), py::arg("axes_list") = "",
+        py::arg("options") = bfiocpp::ThumbnailOptions(), py::arg("num_threads") = 0);
+
     
+    py::class_<bfiocpp::ReadConversion>(m, "ReadConversion")
+    .def(py::init<>())
+    .def_readwrite("dtype", &bfiocpp::ReadConversion::dtype)
+    .def_readwrite("scale", &bfiocpp::ReadConversion::scale)
+    .def_readwrite("offset", &bfiocpp::ReadConversion::offset)
+    .def_readwrite("clip_min", &bfiocpp::ReadConversion::clip_min)
+    .def_readwrite("clip_max", &bfiocpp::ReadConversion::clip_max);
+
+    py::class_<bfiocpp::StatisticsOptions>(m, "StatisticsOptions")
+    .def(py::init<>())
+    .def_readwrite("per_layer", &bfiocpp::StatisticsOptions::per_layer)
+    .def_readwrite("per_tstep", &bfiocpp::StatisticsOptions::per_tstep)
+    .def_readwrite("num_bins", &bfiocpp::StatisticsOptions::num_bins)
+    .def_readwrite("histogram_min", &bfiocpp::StatisticsOptions::histogram_min)
+    .def_readwrite("histogram_max", &bfiocpp::StatisticsOptions::histogram_max);
+
+    py::class_<bfiocpp::ImageStatistics>(m, "ImageStatistics")
+    .def_readonly("tstep", &bfiocpp::ImageStatistics::tstep)
+    .def_readonly("channel", &bfiocpp::ImageStatistics::channel)
+    .def_readonly("layer", &bfiocpp::ImageStatistics::layer)
+    .def_readonly("count", &bfiocpp::ImageStatistics::count)
+    .def_readonly("min", &bfiocpp::ImageStatistics::min)
+    .def_readonly("max", &bfiocpp::ImageStatistics::max)
+    .def_readonly("sum", &bfiocpp::ImageStatistics::sum)
+    .def_readonly("m2", &bfiocpp::ImageStatistics::m2)
+    .def_readonly("histogram_min", &bfiocpp::ImageStatistics::histogram_min)
+    .def_readonly("histogram_max", &bfiocpp::ImageStatistics::histogram_max)
+    .def_readonly("histogram", &bfiocpp::ImageStatistics::histogram)
+    .def_property_readonly("mean", &bfiocpp::ImageStatistics::Mean)
+    .def_property_readonly("std", &bfiocpp::ImageStatistics::StandardDeviation)
+    .def("percentile", &bfiocpp::ImageStatistics::Percentile);
+
+    py::class_<bfiocpp::MapTilesOptions>(m, "MapTilesOptions")
+    .def(py::init<>())
+    .def_readwrite("tile_height", &bfiocpp::MapTilesOptions::tile_height)
+    .def_readwrite("tile_width", &bfiocpp::MapTilesOptions::tile_width)
+    .def_readwrite("num_threads", &bfiocpp::MapTilesOptions::num_threads);
+
+    py::class_<bfiocpp::ThumbnailOptions>(m, "ThumbnailOptions")
+    .def(py::init<>())
+    .def_readwrite("max_size", &bfiocpp::ThumbnailOptions::max_size)
+    .def_readwrite("layer", &bfiocpp::ThumbnailOptions::layer)
+    .def_readwrite("tstep", &bfiocpp::ThumbnailOptions::tstep);
+
+    py::class_<bfiocpp::ChannelReduction>(m, "ChannelReduction")
+    .def_readonly("channel", &bfiocpp::ChannelReduction::channel)
+    .def_readonly("count", &bfiocpp::ChannelReduction::count)
+    .def_readonly("nonzero", &bfiocpp::ChannelReduction::nonzero)
+    .def_readonly("sum", &bfiocpp::ChannelReduction::sum)
+    .def_readonly("min", &bfiocpp::ChannelReduction::min)
+    .def_readonly("max", &bfiocpp::ChannelReduction::max);
+
+    m.def("get_tile_kernel_names", &bfiocpp::GetTileKernelNames);
+
+    py::class_<bfiocpp::SlidingWindowOptions>(m, "SlidingWindowOptions")
+    .def(py::init<>())
+    .def_readwrite("window_height", &bfiocpp::SlidingWindowOptions::window_height)
+    .def_readwrite("window_width", &bfiocpp::SlidingWindowOptions::window_width)
+    .def_readwrite("overlap_height", &bfiocpp::SlidingWindowOptions::overlap_height)
+    .def_readwrite("overlap_width", &bfiocpp::SlidingWindowOptions::overlap_width)
+    .def_readwrite("blend", &bfiocpp::SlidingWindowOptions::blend)
+    .def_readwrite("output_channels", &bfiocpp::SlidingWindowOptions::output_channels)
+    .def_readwrite("prefetch", &bfiocpp::SlidingWindowOptions::prefetch);
+
+    py::class_<bfiocpp::CompressionOptions>(m, "CompressionOptions")
+    .def(py::init<>())
+    .def_readwrite("codec", &bfiocpp::CompressionOptions::codec)
+    .def_readwrite("blosc_cname", &bfiocpp::CompressionOptions::blosc_cname)
+    .def_readwrite("shuffle", &bfiocpp::CompressionOptions::shuffle)
+    .def_readwrite("level", &bfiocpp::CompressionOptions::level)
+    .def_readwrite("num_threads", &bfiocpp::CompressionOptions::num_threads);
+
+    py::class_<bfiocpp::ShardingOptions>(m, "ShardingOptions")
+    .def(py::init<>())
+    .def_readwrite("shard_shape", &bfiocpp::ShardingOptions::shard_shape)
+    .def_readwrite("index_location", &bfiocpp::ShardingOptions::index_location);
+
+    py::class_<bfiocpp::PyramidOptions>(m, "PyramidOptions")
+    .def(py::init<>())
+    .def_readwrite("num_levels", &bfiocpp::PyramidOptions::num_levels)
+    .def_readwrite("method", &bfiocpp::PyramidOptions::method);
+
     // Writer class
     py::class_<bfiocpp::TsWriterCPP, std::shared_ptr<bfiocpp::TsWriterCPP>>(m, "TsWriterCPP")
-    .def(py::init<const std::string&, const std::vector<std::int64_t>&, const std::vector<std::int64_t>&, const std::string&, const std::string&, bfiocpp::FileType>(),
+    .def(py::init<const std::string&, const std::vector<std::int64_t>&, const std::vector<std::int64_t>&, const std::string&, const std::string&, bfiocpp::FileType, std::size_t, std::size_t, const bfiocpp::CompressionOptions&, const bfiocpp::ShardingOptions&, const bfiocpp::PyramidOptions&>(),
          py::arg("filename"),
          py::arg("image_shape"),
          py::arg("chunk_shape"),
          py::arg("dtype"),
          py::arg("dimension_order"),
-         py::arg("file_type") = bfiocpp::FileType::OmeZarrV2)
-    .def("write_image_data", &bfiocpp::TsWriterCPP::WriteImageData);
+         py::arg("file_type") = bfiocpp::FileType::OmeZarrV2,
+         py::arg("max_pending_writes") = 16,
+         py::arg("staging_bytes") = 0,
+         py::arg("compression") = bfiocpp::CompressionOptions(),
+         py::arg("sharding") = bfiocpp::ShardingOptions(),
+         py::arg("pyramid") = bfiocpp::PyramidOptions())
+    .def("write_image_data", &bfiocpp::TsWriterCPP::WriteImageData)
+    .def("write_image_data_async", &bfiocpp::TsWriterCPP::WriteImageDataAsync)
+    .def("flush", &bfiocpp::TsWriterCPP::Flush, py::call_guard<py::gil_scoped_release>())
+    .def("close", &bfiocpp::TsWriterCPP::Close, py::call_guard<py::gil_scoped_release>());
+
+    py::class_<bfiocpp::ConversionOptions>(m, "ConversionOptions")
+    .def(py::init<>())
+    .def_readwrite("file_type", &bfiocpp::ConversionOptions::file_type)
+    .def_readwrite("chunk_shape", &bfiocpp::ConversionOptions::chunk_shape)
+    .def_readwrite("block_shape", &bfiocpp::ConversionOptions::block_shape)
+    .def_readwrite("compression", &bfiocpp::ConversionOptions::compression)
+    .def_readwrite("read_threads", &bfiocpp::ConversionOptions::read_threads)
+    .def_readwrite("memory_limit", &bfiocpp::ConversionOptions::memory_limit)
+    .def_readwrite("resume", &bfiocpp::ConversionOptions::resume);
+
+    py::class_<bfiocpp::ConversionReport>(m, "ConversionReport")
+    .def_readonly("num_chunks", &bfiocpp::ConversionReport::num_chunks)
+    .def_readonly("chunks_written", &bfiocpp::ConversionReport::chunks_written)
+    .def_readonly("chunks_skipped", &bfiocpp::ConversionReport::chunks_skipped)
+    .def_readonly("bytes_written", &bfiocpp::ConversionReport::bytes_written)
+    .def_readonly("seconds", &bfiocpp::ConversionReport::seconds)
+    .def_property_readonly("megabytes_per_second", &bfiocpp::ConversionReport::MegabytesPerSecond);
+
+    // progress callbacks run on the calling thread, which holds the GIL only while they run
+    auto wrap_progress = [](const py::object& progress) {
+        std::function<void(const bfiocpp::ConversionReport&)> report_progress;
+        if (!progress.is_none()) {
+            report_progress = [callback = py::handle(progress)](const bfiocpp::ConversionReport& report) {
+                py::gil_scoped_acquire acquire;
+                try {
+                    callback(report);
+                } catch (py::error_already_set& e) {
+                    // the Python error can only be released while the GIL is held
+                    throw std::runtime_error(e.what());
+                }
+            };
+        }
+        return report_progress;
+    };
+    m.def("convert_image",
+        [wrap_progress](bfiocpp::TsReaderCPP& source, const std::string& output, const bfiocpp::ConversionOptions& options, const py::object& progress) {
+            auto report_progress = wrap_progress(progress);
+            py::gil_scoped_release release;
+            return bfiocpp::ConvertImage(source, output, options, report_progress);
+        }, py::arg("source"), py::arg("output"), py::arg("options") = bfiocpp::ConversionOptions(), py::arg("progress") = py::none());
+    m.def("rechunk_image",
+        [wrap_progress](const std::string& input, bfiocpp::FileType input_type, const std::string& axes_list, const std::string& output,
+                        const bfiocpp::ConversionOptions& options, const py::object& progress) {
+            auto report_progress = wrap_progress(progress);
+            py::gil_scoped_release release;
+            return bfiocpp::RechunkImage(input, input_type, axes_list, output, options, report_progress);
+        }, py::arg("input"), py::arg("input_type"), py::arg("axes_list"), py::arg("output"), py::arg("options"),
+           py::arg("progress") = py::none());
+    m.def("get_rechunk_block_shape", &bfiocpp::GetRechunkBlockShape);
+
+    py::class_<bfiocpp::WriteFuture, std::shared_ptr<bfiocpp::WriteFuture>>(m, "WriteFuture")
+    .def("done", &bfiocpp::WriteFuture::Ready)
+    .def("result", &bfiocpp::WriteFuture::Wait, py::call_guard<py::gil_scoped_release>());
 }
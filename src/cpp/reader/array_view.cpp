@@ -0,0 +1,90 @@
+#include <stdexcept>
+#include "tensorstore/array.h"
+#include "tensorstore/index_space/dim_expression.h"
+
+#include "array_view.h"
+#include "../utilities/utilities.h"
+
+namespace bfiocpp {
+
+TsArrayView::TsArrayView(const TsReaderCPP& reader): _store(reader.GetTensorStore()) {}
+
+TsArrayView::TsArrayView(tensorstore::TensorStore<> store): _store(std::move(store)) {}
+
+std::int64_t TsArrayView::Rank() const {return _store.rank();}
+
+std::vector<std::int64_t> TsArrayView::Shape() const {
+    const auto shape = _store.domain().shape();
+    return std::vector<std::int64_t>(shape.begin(), shape.end());
+}
+
+std::string TsArrayView::GetDataType() const {return std::string(_store.dtype().name());}
+
+std::vector<std::int64_t> TsArrayView::Chunks() const {
+    std::vector<std::int64_t> chunks(_store.rank(), 0);
+    auto chunk_layout = _store.chunk_layout();
+    if (chunk_layout.ok()) {
+        const auto read_chunk_shape = chunk_layout->read_chunk_shape();
+        for (std::size_t dim = 0; dim < chunks.size(); ++dim) {
+            chunks[dim] = read_chunk_shape[dim];
+        }
+    }
+    return chunks;
+}
+
+void TsArrayView::CheckDimension(std::int64_t dim) const {
+    if (dim < 0 || dim >= _store.rank()) {
+        throw std::out_of_range("Dimension " + std::to_string(dim) + " is out of range for a view of rank " + std::to_string(_store.rank()));
+    }
+}
+
+TsArrayView TsArrayView::Slice(std::int64_t dim, std::int64_t start, std::int64_t stop, std::int64_t step) const {
+    CheckDimension(dim);
+    if (step == 0) {
+        throw std::invalid_argument("Slice step can not be zero");
+    }
+    // the sliced dimension starts at 0 again, like a numpy slice
+    auto store = _store | tensorstore::Dims(dim).HalfOpenInterval(start, stop, step).TranslateTo(0);
+    if (!store.ok()) {
+        throw std::out_of_range("Error slicing view: " + store.status().ToString());
+    }
+    return TsArrayView(std::move(store).value());
+}
+
+TsArrayView TsArrayView::IndexAt(std::int64_t dim, std::int64_t index) const {
+    CheckDimension(dim);
+    auto store = _store | tensorstore::Dims(dim).IndexSlice(index);
+    if (!store.ok()) {
+        throw std::out_of_range("Error indexing view: " + store.status().ToString());
+    }
+    return TsArrayView(std::move(store).value());
+}
+
+template <typename T>
+std::shared_ptr<std::vector<T>> TsArrayView::ReadTemplated() const {
+    auto read_buffer = std::make_shared<std::vector<T>>(_store.domain().num_elements());
+    auto array = tensorstore::Array(read_buffer->data(), _store.domain().shape(), tensorstore::c_order);
+    auto status = tensorstore::Read(_store, tensorstore::UnownedToShared(array)).status();
+    if (!status.ok()) {
+        throw std::runtime_error("Error reading view: " + status.ToString());
+    }
+    return read_buffer;
+}
+
+std::shared_ptr<image_data> TsArrayView::Read() const {
+    switch (GetDataTypeCode(_store.dtype().name()))
+    {
+    case (1): return std::make_shared<image_data>(std::move(*(ReadTemplated<std::uint8_t>())));
+    case (2): return std::make_shared<image_data>(std::move(*(ReadTemplated<std::uint16_t>())));
+    case (4): return std::make_shared<image_data>(std::move(*(ReadTemplated<std::uint32_t>())));
+    case (8): return std::make_shared<image_data>(std::move(*(ReadTemplated<std::uint64_t>())));
+    case (16): return std::make_shared<image_data>(std::move(*(ReadTemplated<std::int8_t>())));
+    case (32): return std::make_shared<image_data>(std::move(*(ReadTemplated<std::int16_t>())));
+    case (64): return std::make_shared<image_data>(std::move(*(ReadTemplated<std::int32_t>())));
+    case (128): return std::make_shared<image_data>(std::move(*(ReadTemplated<std::int64_t>())));
+    case (256): return std::make_shared<image_data>(std::move(*(ReadTemplated<float>())));
+    default: return std::make_shared<image_data>(std::move(*(ReadTemplated<double>())));
+    }
+}
+
+} // ns bfiocpp
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "tensorstore/tensorstore.h"
+#include "tsreader.h"
+
+namespace bfiocpp{
+
+// Lazy view of an image. Slicing composes the view's index transform without reading,
+// data is read once when the view is materialized with Read.
+class TsArrayView{
+public:
+    // TCZYX view of the current level of reader
+    explicit TsArrayView(const TsReaderCPP& reader);
+    explicit TsArrayView(tensorstore::TensorStore<> store);
+
+    std::int64_t Rank() const;
+    std::vector<std::int64_t> Shape() const;
+    std::string GetDataType() const;
+    // read chunk shape as seen through the view, 0 where the chunks are not regular
+    std::vector<std::int64_t> Chunks() const;
+
+    // numpy style a[..., start:stop:step, ...], stop is exclusive and step may be negative
+    TsArrayView Slice(std::int64_t dim, std::int64_t start, std::int64_t stop, std::int64_t step) const;
+    // numpy style a[..., index, ...], which removes dim
+    TsArrayView IndexAt(std::int64_t dim, std::int64_t index) const;
+
+    // c_order data of the whole view
+    std::shared_ptr<image_data> Read() const;
+
+private:
+    tensorstore::TensorStore<> _store;
+
+    void CheckDimension(std::int64_t dim) const;
+    template <typename T>
+    std::shared_ptr<std::vector<T>> ReadTemplated() const;
+};
+} // ns bfiocpp
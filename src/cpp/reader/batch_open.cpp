@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "tensorstore/open.h"
+#include "tensorstore/util/executor.h"
+#include "batch_open.h"
+#include "tsreader.h"
+
+namespace bfiocpp {
+
+BatchOpen::BatchOpen(const std::vector<std::string>& files, FileType file_type, const std::string& axes_list,
+                     std::size_t max_in_flight, unsigned int num_threads):
+    _files(files), _file_type(file_type), _axes_list(axes_list), _max_in_flight(max_in_flight > 0 ? max_in_flight : 256),
+    _context(GetReadContext()) {
+
+    // the threads only read the level metadata, the opens themselves run on the context
+    const auto threads_to_start = std::min<std::size_t>(
+        std::max(1u, num_threads > 0 ? num_threads : std::thread::hardware_concurrency()), _files.size());
+    _threads.reserve(threads_to_start);
+    for (std::size_t i = 0; i < threads_to_start; ++i) _threads.emplace_back([this]() { IssueOpens(); });
+}
+
+BatchOpen::~BatchOpen() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _changed.notify_all();
+    for (auto& thread : _threads) thread.join();
+
+    // the completion callbacks refer to this batch
+    std::unique_lock<std::mutex> lock(_mutex);
+    _changed.wait(lock, [this]() { return _in_flight == 0; });
+}
+
+std::size_t BatchOpen::Size() const {return _files.size();}
+
+void BatchOpen::IssueOpens() {
+    for (auto index = _next_file++; index < _files.size(); index = _next_file++) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _changed.wait(lock, [this]() { return _stopping || _in_flight < _max_in_flight; });
+            if (_stopping) return;
+            ++_in_flight;
+        }
+
+        try {
+            auto levels = TsReaderCPP::FindLevels(_files[index], _file_type);
+            auto spec = TsReaderCPP::GetReadSpec(_files[index], _file_type, levels, 0, {});
+            auto opened = tensorstore::MapFuture(
+                tensorstore::InlineExecutor{},
+                [this, index, levels = std::move(levels)](const tensorstore::Result<TsReaderCPP::Store>& store) mutable -> tensorstore::Result<void> {
+                    OpenResult result;
+                    result.index = index;
+                    try {
+                        if (!store.ok()) {
+                            throw std::runtime_error("Error opening " + _files[index] + ": " + store.status().ToString());
+                        }
+                        result.reader.reset(new TsReaderCPP(_files[index], _file_type, _axes_list, _context, std::move(levels), *store));
+                    } catch (const std::exception& e) {
+                        result.error = e.what();
+                    }
+                    Complete(std::move(result));
+                    return tensorstore::MakeResult();
+                },
+                tensorstore::Open(spec, _context, tensorstore::OpenMode::open, tensorstore::ReadWriteMode::read));
+
+            // the mapped future is held until it is ready, so the open is not abandoned
+            std::lock_guard<std::mutex> lock(_mutex);
+            _pending.push_back(std::move(opened));
+            while (!_pending.empty() && _pending.front().ready()) _pending.pop_front();
+        } catch (const std::exception& e) {
+            OpenResult result;
+            result.index = index;
+            result.error = "Error opening " + _files[index] + ": " + e.what();
+            Complete(std::move(result));
+        }
+    }
+}
+
+void BatchOpen::Complete(OpenResult result) {
+    // notified under the lock, the destructor may return as soon as _in_flight reaches 0 and
+    // the lock is released
+    std::lock_guard<std::mutex> lock(_mutex);
+    _completed.push_back(std::move(result));
+    --_in_flight;
+    _changed.notify_all();
+}
+
+std::optional<OpenResult> BatchOpen::Next() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_returned == _files.size()) return std::nullopt;
+    _changed.wait(lock, [this]() { return !_completed.empty(); });
+    auto result = std::move(_completed.front());
+    _completed.pop_front();
+    ++_returned;
+    lock.unlock();
+    // a slot for another open
+    _changed.notify_all();
+    return result;
+}
+
+} // ns bfiocpp
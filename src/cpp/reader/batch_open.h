@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tensorstore/context.h"
+#include "tensorstore/util/future.h"
+#include "../utilities/utilities.h"
+
+namespace bfiocpp{
+
+class TsReaderCPP;
+
+struct OpenResult {
+    std::size_t index = 0;                  // position of the file in the batch
+    std::shared_ptr<TsReaderCPP> reader;    // null if the open failed
+    std::string error;
+};
+
+// Opens many files concurrently on one shared tensorstore context. A few threads find the
+// pyramid levels of every file and issue the tensorstore::Open of level 0 without waiting for
+// it, keeping at most max_in_flight opens pending. Readers are handed out by Next() in the
+// order their opens complete, a file that fails to open gives its error instead of a reader.
+class BatchOpen {
+public:
+    // max_in_flight 0 allows 256 pending opens, num_threads 0 uses one thread per core
+    BatchOpen(const std::vector<std::string>& files, FileType file_type, const std::string& axes_list,
+              std::size_t max_in_flight = 0, unsigned int num_threads = 0);
+    // stops issuing opens and waits for the pending ones
+    ~BatchOpen();
+    BatchOpen(const BatchOpen&) = delete;
+    BatchOpen& operator=(const BatchOpen&) = delete;
+
+    // blocks until the next open completes, empty once every file has been returned
+    std::optional<OpenResult> Next();
+    std::size_t Size() const;
+
+private:
+    std::vector<std::string> _files;
+    FileType _file_type;
+    std::string _axes_list;
+    std::size_t _max_in_flight;
+    tensorstore::Context _context;
+
+    std::atomic<std::size_t> _next_file{0};
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::size_t _in_flight = 0, _returned = 0;
+    bool _stopping = false;
+    std::deque<OpenResult> _completed;
+    std::deque<tensorstore::Future<void>> _pending;
+    std::vector<std::thread> _threads;
+
+    void IssueOpens();
+    void Complete(OpenResult result);
+};
+} // ns bfiocpp
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+#include "convert.h"
+#include "../utilities/utilities.h"
+
+namespace bfiocpp {
+
+namespace {
+template <typename In, typename Out>
+void ConvertTyped(const In* src, Out* dst, std::size_t num_elements, double scale, double offset, double clip_min, double clip_max,
+                  const float* dark, const float* inverse_flat){
+    // the shading correction is chosen outside the loop, so it is fused into the same pass
+    auto convert = [&](auto load) {
+        if constexpr (std::is_integral_v<Out>) {
+            // saturate to the output range, the largest 64 bit values are not exact as double
+            clip_min = std::max(clip_min, static_cast<double>(std::numeric_limits<Out>::lowest()));
+            clip_max = std::min(clip_max, std::nextafter(static_cast<double>(std::numeric_limits<Out>::max()), 0.0));
+            for (std::size_t i = 0; i < num_elements; ++i) {
+                double value = load(i) * scale + offset;
+                // NaN ends up at clip_min
+                value = (value > clip_min) ? value : clip_min;
+                value = (value < clip_max) ? value : clip_max;
+                dst[i] = static_cast<Out>(std::floor(value + 0.5));
+            }
+        } else {
+            for (std::size_t i = 0; i < num_elements; ++i) {
+                const double value = load(i) * scale + offset;
+                dst[i] = static_cast<Out>(std::min(std::max(value, clip_min), clip_max));
+            }
+        }
+    };
+    if (dark != nullptr && inverse_flat != nullptr) {
+        convert([&](std::size_t i) {return (static_cast<double>(src[i]) - dark[i]) * inverse_flat[i];});
+    } else {
+        convert([&](std::size_t i) {return static_cast<double>(src[i]);});
+    }
+}
+
+// Inputs that are exact as float with a float32 output are converted in float, in groups
+// of kLanes elements whose count is known to the compiler, so the loop vectorizes at -O2
+// on the x86-64 baseline. The scalar double loop needs SSE4.1 for floor and has no
+// vector double to int64 conversion before AVX-512.
+template <typename In>
+void ConvertToFloat32(const In* __restrict src, float* __restrict dst, std::size_t num_elements, float scale, float offset,
+                      float clip_min, float clip_max, const float* __restrict dark, const float* __restrict inverse_flat){
+    constexpr std::size_t kLanes = 16;
+    const std::size_t num_grouped = num_elements - num_elements % kLanes;
+    if (dark != nullptr && inverse_flat != nullptr) {
+        for (std::size_t i = 0; i < num_grouped; i += kLanes) {
+            for (std::size_t lane = 0; lane < kLanes; ++lane) {
+                const float value = (static_cast<float>(src[i + lane]) - dark[i + lane]) * inverse_flat[i + lane] * scale + offset;
+                dst[i + lane] = std::min(std::max(value, clip_min), clip_max);
+            }
+        }
+        for (std::size_t i = num_grouped; i < num_elements; ++i) {
+            const float value = (static_cast<float>(src[i]) - dark[i]) * inverse_flat[i] * scale + offset;
+            dst[i] = std::min(std::max(value, clip_min), clip_max);
+        }
+    } else {
+        for (std::size_t i = 0; i < num_grouped; i += kLanes) {
+            for (std::size_t lane = 0; lane < kLanes; ++lane) {
+                const float value = static_cast<float>(src[i + lane]) * scale + offset;
+                dst[i + lane] = std::min(std::max(value, clip_min), clip_max);
+            }
+        }
+        for (std::size_t i = num_grouped; i < num_elements; ++i) {
+            const float value = static_cast<float>(src[i]) * scale + offset;
+            dst[i] = std::min(std::max(value, clip_min), clip_max);
+        }
+    }
+}
+
+// false if the conversion has no float32 fast path
+bool ConvertBlockToFloat32(const void* src, std::uint16_t src_dtype_code, float* dst, std::size_t num_elements,
+                           double scale, double offset, double clip_min, double clip_max, const float* dark, const float* inverse_flat){
+    constexpr double kFloatMax = std::numeric_limits<float>::max();
+    if (std::abs(scale) > kFloatMax || std::abs(offset) > kFloatMax) return false;
+    // bounds beyond the float range clip nothing a float can hold
+    auto to_float_bound = [kFloatMax](double bound) {
+        return bound > kFloatMax ? std::numeric_limits<float>::infinity() :
+               bound < -kFloatMax ? -std::numeric_limits<float>::infinity() : static_cast<float>(bound);
+    };
+    const auto scale_f = static_cast<float>(scale), offset_f = static_cast<float>(offset);
+    const auto clip_min_f = to_float_bound(clip_min), clip_max_f = to_float_bound(clip_max);
+    switch(src_dtype_code)
+    {
+        case (1): ConvertToFloat32(static_cast<const std::uint8_t*>(src), dst, num_elements, scale_f, offset_f, clip_min_f, clip_max_f, dark, inverse_flat); return true;
+        case (2): ConvertToFloat32(static_cast<const std::uint16_t*>(src), dst, num_elements, scale_f, offset_f, clip_min_f, clip_max_f, dark, inverse_flat); return true;
+        case (16): ConvertToFloat32(static_cast<const std::int8_t*>(src), dst, num_elements, scale_f, offset_f, clip_min_f, clip_max_f, dark, inverse_flat); return true;
+        case (32): ConvertToFloat32(static_cast<const std::int16_t*>(src), dst, num_elements, scale_f, offset_f, clip_min_f, clip_max_f, dark, inverse_flat); return true;
+        case (256): ConvertToFloat32(static_cast<const float*>(src), dst, num_elements, scale_f, offset_f, clip_min_f, clip_max_f, dark, inverse_flat); return true;
+        default: return false;
+    }
+}
+
+template <typename In>
+void ConvertFrom(const In* src, void* dst, std::uint16_t dst_dtype_code, std::size_t num_elements,
+                 double scale, double offset, double clip_min, double clip_max, const float* dark, const float* inverse_flat){
+    switch(dst_dtype_code)
+    {
+        case (1): ConvertTyped(src, static_cast<std::uint8_t*>(dst), num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (2): ConvertTyped(src, static_cast<std::uint16_t*>(dst), num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (4): ConvertTyped(src, static_cast<std::uint32_t*>(dst), num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (8): ConvertTyped(src, static_cast<std::uint64_t*>(dst), num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (16): ConvertTyped(src, static_cast<std::int8_t*>(dst), num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (32): ConvertTyped(src, static_cast<std::int16_t*>(dst), num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (64): ConvertTyped(src, static_cast<std::int32_t*>(dst), num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (128): ConvertTyped(src, static_cast<std::int64_t*>(dst), num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (256): ConvertTyped(src, static_cast<float*>(dst), num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (512): ConvertTyped(src, static_cast<double*>(dst), num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        default:
+            throw std::invalid_argument("Error converting image data: unsupported output data type");
+    }
+}
+} // namespace
+
+bool ReadConversion::IsIdentity(std::uint16_t src_dtype_code) const {
+    auto all_equal = [](const std::vector<double>& values, double expected) {
+        return std::all_of(values.begin(), values.end(), [expected](double value) {return value == expected;});
+    };
+    return (dtype.empty() || GetOutputDataTypeCode(dtype) == src_dtype_code) &&
+           all_equal(scale, 1.0) && all_equal(offset, 0.0) && !clip_min.has_value() && !clip_max.has_value();
+}
+
+std::uint16_t GetOutputDataTypeCode(const std::string& dtype){
+    for (const char* name : {"uint8", "uint16", "uint32", "uint64", "int8", "int16", "int32", "int64", "float32", "float64", "double"}) {
+        if (dtype == name) return GetDataTypeCode(dtype);
+    }
+    throw std::invalid_argument("Invalid output dtype \"" + dtype + "\"");
+}
+
+void ConvertBlock(const void* src, std::uint16_t src_dtype_code, void* dst, std::uint16_t dst_dtype_code,
+                  std::size_t num_elements, double scale, double offset, double clip_min, double clip_max,
+                  const float* dark, const float* inverse_flat){
+
+    if (dst_dtype_code == 256 &&
+        ConvertBlockToFloat32(src, src_dtype_code, static_cast<float*>(dst), num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat)) {
+        return;
+    }
+
+    // use switch instead of template to match the dtype codes used by the reader and writer
+    switch(src_dtype_code)
+    {
+        case (1): ConvertFrom(static_cast<const std::uint8_t*>(src), dst, dst_dtype_code, num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (2): ConvertFrom(static_cast<const std::uint16_t*>(src), dst, dst_dtype_code, num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (4): ConvertFrom(static_cast<const std::uint32_t*>(src), dst, dst_dtype_code, num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (8): ConvertFrom(static_cast<const std::uint64_t*>(src), dst, dst_dtype_code, num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (16): ConvertFrom(static_cast<const std::int8_t*>(src), dst, dst_dtype_code, num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (32): ConvertFrom(static_cast<const std::int16_t*>(src), dst, dst_dtype_code, num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (64): ConvertFrom(static_cast<const std::int32_t*>(src), dst, dst_dtype_code, num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (128): ConvertFrom(static_cast<const std::int64_t*>(src), dst, dst_dtype_code, num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (256): ConvertFrom(static_cast<const float*>(src), dst, dst_dtype_code, num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        case (512): ConvertFrom(static_cast<const double*>(src), dst, dst_dtype_code, num_elements, scale, offset, clip_min, clip_max, dark, inverse_flat); break;
+        default:
+            throw std::invalid_argument("Error converting image data: unsupported data type");
+    }
+}
+
+} // ns bfiocpp
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace bfiocpp{
+
+// Conversion applied while data is copied out of the chunk cache:
+// out = clip(in * scale + offset, clip_min, clip_max), stored as dtype. Integer outputs
+// are rounded and saturated. scale and offset hold one value or one per channel read.
+struct ReadConversion {
+    std::string dtype = "";             // output dtype, empty keeps the image dtype
+    std::vector<double> scale, offset;  // empty for 1 and 0
+    std::optional<double> clip_min, clip_max;
+
+    bool IsIdentity(std::uint16_t src_dtype_code) const;
+};
+
+// Flat-field and dark-frame references, raw values are corrected to (raw - dark) / flat before
+// the conversion. Planes are height x width, one per channel or a single one for all channels.
+struct ShadingCorrection {
+    std::int64_t height = 0, width = 0;
+    std::vector<std::vector<float>> dark, inverse_flat;   // 1 / flat, 0 where flat is 0
+
+    const float* Dark(std::int64_t channel) const {return dark[dark.size() == 1 ? 0 : channel].data();}
+    const float* InverseFlat(std::int64_t channel) const {return inverse_flat[inverse_flat.size() == 1 ? 0 : channel].data();}
+};
+
+// Converts num_elements from src (src_dtype_code) to dst (dst_dtype_code) with
+// dst = clip(src * scale + offset, clip_min, clip_max). dtype codes follow GetDataTypeCode.
+// With dark and inverse_flat (num_elements each), src is replaced by (src - dark) * inverse_flat
+// in the same pass. float32 outputs of 8 and 16 bit integer or float32 inputs are computed in
+// float, other conversions in double.
+void ConvertBlock(const void* src, std::uint16_t src_dtype_code, void* dst, std::uint16_t dst_dtype_code,
+                  std::size_t num_elements, double scale, double offset, double clip_min, double clip_max,
+                  const float* dark = nullptr, const float* inverse_flat = nullptr);
+
+// GetDataTypeCode for an output dtype name, throws std::invalid_argument if it is not supported.
+std::uint16_t GetOutputDataTypeCode(const std::string& dtype);
+} // ns bfiocpp
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#include "tensorstore/array.h"
+#include "tensorstore/index_space/dim_expression.h"
+#include "map_tiles.h"
+#include "convert.h"
+#include "tsreader.h"
+#include "../writer/tswriter.h"
+
+namespace bfiocpp {
+
+namespace {
+double GetParam(const std::map<std::string, double>& params, const std::string& kernel, const std::string& name,
+                std::optional<double> default_value = std::nullopt){
+    auto it = params.find(name);
+    if (it != params.end()) return it->second;
+    if (default_value.has_value()) return default_value.value();
+    throw std::invalid_argument("Tile kernel \"" + kernel + "\" requires the parameter \"" + name + "\"");
+}
+
+TileKernel Threshold(const std::map<std::string, double>& params){
+    const double value = GetParam(params, "threshold", "value");
+    return [value](double* tile, std::int64_t height, std::int64_t width) {
+        const auto n = height * width;
+        for (std::int64_t i = 0; i < n; ++i) tile[i] = (tile[i] > value) ? 1.0 : 0.0;
+    };
+}
+
+TileKernel Subtract(const std::map<std::string, double>& params){
+    const double value = GetParam(params, "subtract", "value");
+    return [value](double* tile, std::int64_t height, std::int64_t width) {
+        const auto n = height * width;
+        for (std::int64_t i = 0; i < n; ++i) tile[i] = std::max(tile[i] - value, 0.0);
+    };
+}
+
+TileKernel Scale(const std::map<std::string, double>& params){
+    const double factor = GetParam(params, "scale", "factor"), offset = GetParam(params, "scale", "offset", 0.0);
+    return [factor, offset](double* tile, std::int64_t height, std::int64_t width) {
+        const auto n = height * width;
+        for (std::int64_t i = 0; i < n; ++i) tile[i] = tile[i] * factor + offset;
+    };
+}
+
+std::mutex& GetRegistryMutex(){
+    static std::mutex mutex;
+    return mutex;
+}
+
+// kernels by name, the built-in ones are added on first use
+std::map<std::string, TileKernelFactory>& GetRegistry(){
+    static std::map<std::string, TileKernelFactory> registry = {
+        {"threshold", Threshold},
+        {"subtract", Subtract},
+        {"scale", Scale},
+    };
+    return registry;
+}
+} // namespace
+
+void RegisterTileKernel(const std::string& name, TileKernelFactory factory){
+    if (name.empty() || !factory) {
+        throw std::invalid_argument("A tile kernel needs a name and a factory");
+    }
+    std::lock_guard<std::mutex> lock(GetRegistryMutex());
+    GetRegistry()[name] = std::move(factory);
+}
+
+TileKernel GetTileKernel(const std::string& name, const std::map<std::string, double>& params){
+    TileKernelFactory factory;
+    {
+        std::lock_guard<std::mutex> lock(GetRegistryMutex());
+        const auto& registry = GetRegistry();
+        auto it = registry.find(name);
+        if (it != registry.end()) factory = it->second;
+    }
+    if (!factory) {
+        std::string names;
+        for (const auto& kernel_name : GetTileKernelNames()) names += (names.empty() ? "" : ", ") + kernel_name;
+        throw std::invalid_argument("Invalid tile kernel \"" + name + "\", must be one of " + names);
+    }
+    // the factory may be slow or throw, so it runs outside the lock
+    return factory(params);
+}
+
+std::vector<std::string> GetTileKernelNames(){
+    std::lock_guard<std::mutex> lock(GetRegistryMutex());
+    std::vector<std::string> names;
+    for (const auto& [name, factory] : GetRegistry()) names.push_back(name);
+    return names;
+}
+
+ChannelReduction::ChannelReduction():
+    min(std::numeric_limits<double>::infinity()), max(-std::numeric_limits<double>::infinity()) {}
+
+void ChannelReduction::Merge(const ChannelReduction& other){
+    count += other.count;
+    nonzero += other.nonzero;
+    sum += other.sum;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+}
+
+std::vector<ChannelReduction> MapTiles(TsReaderCPP& reader, const TileKernel& kernel,
+                                       const MapTilesOptions& options, TsWriterCPP* output){
+    if (options.tile_height <= 0 || options.tile_width <= 0) {
+        throw std::invalid_argument("Error mapping tiles: tile size must be positive");
+    }
+
+    const auto view = reader.GetTensorStore();
+    const auto shape = view.domain().shape();
+    const std::int64_t num_tsteps = shape[0], num_channels = shape[1], num_layers = shape[2],
+                       height = shape[3], width = shape[4];
+    const std::int64_t tiles_down = (height + options.tile_height - 1) / options.tile_height,
+                       tiles_across = (width + options.tile_width - 1) / options.tile_width;
+    const std::int64_t num_tiles = num_tsteps * num_channels * num_layers * tiles_down * tiles_across;
+
+    const std::uint16_t src_dtype_code = GetDataTypeCode(view.dtype().name());
+    const std::uint16_t out_dtype_code = output ? output->GetDataTypeCode() : 0;
+    const auto out_dtype = output ? GetTensorStoreDataType(out_dtype_code) : tensorstore::DataType();
+
+    const unsigned int num_threads = static_cast<unsigned int>(std::min<std::int64_t>(
+        std::max(1u, options.num_threads > 0 ? options.num_threads : std::thread::hardware_concurrency()), std::max<std::int64_t>(num_tiles, 1)));
+
+    std::atomic<std::int64_t> next_tile{0};
+    std::atomic<bool> failed{false};
+    std::mutex mutex;
+    std::vector<std::string> errors;
+    std::vector<ChannelReduction> reductions(num_channels);
+    for (std::int64_t c = 0; c < num_channels; ++c) reductions[c].channel = c;
+
+    auto worker = [&]() {
+        std::vector<ChannelReduction> partials(num_channels);
+        std::vector<double> tile;
+        try {
+            // tiles are handed out one at a time, an idle thread takes the next one
+            for (std::int64_t index = next_tile++; index < num_tiles && !failed; index = next_tile++) {
+                std::int64_t rest = index;
+                const std::int64_t tx = rest % tiles_across; rest /= tiles_across;
+                const std::int64_t ty = rest % tiles_down; rest /= tiles_down;
+                const std::int64_t z = rest % num_layers; rest /= num_layers;
+                const std::int64_t c = rest % num_channels; rest /= num_channels;
+                const std::int64_t t = rest;
+
+                const std::int64_t y0 = ty * options.tile_height, x0 = tx * options.tile_width;
+                const std::int64_t h = std::min(options.tile_height, height - y0), w = std::min(options.tile_width, width - x0);
+                const auto num_elements = static_cast<std::size_t>(h * w);
+
+                auto tile_transform = (tensorstore::IdentityTransform(view.domain()) |
+                                       tensorstore::Dims(3, 4).SizedInterval({y0, x0}, {h, w}) |
+                                       tensorstore::Dims(0, 1, 2).IndexSlice({t, c, z})).value();
+                auto block = tensorstore::AllocateArray({h, w}, tensorstore::c_order, tensorstore::default_init, view.dtype());
+                auto read_status = tensorstore::Read(view | tile_transform, block).status();
+                if (!read_status.ok()) {
+                    throw std::runtime_error(read_status.ToString());
+                }
+
+                tile.resize(num_elements);
+                ConvertBlock(block.data(), src_dtype_code, tile.data(), 512, num_elements, 1.0, 0.0,
+                             -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity());
+                kernel(tile.data(), h, w);
+
+                auto& reduction = partials[c];
+                for (std::size_t i = 0; i < num_elements; ++i) {
+                    const double value = tile[i];
+                    if (std::isnan(value)) continue;
+                    reduction.min = std::min(reduction.min, value);
+                    reduction.max = std::max(reduction.max, value);
+                    reduction.sum += value;
+                    reduction.nonzero += (value != 0);
+                    ++reduction.count;
+                }
+
+                if (output) {
+                    auto converted = tensorstore::AllocateArray({h, w}, tensorstore::c_order, tensorstore::default_init, out_dtype);
+                    ConvertBlock(tile.data(), 512, converted.data(), out_dtype_code, num_elements, 1.0, 0.0,
+                                 -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity());
+                    output->WriteArray(converted, Seq(y0, y0 + h - 1), Seq(x0, x0 + w - 1), Seq(z, z), Seq(c, c), Seq(t, t));
+                }
+            }
+        } catch (const std::exception& e) {
+            failed = true;
+            std::lock_guard<std::mutex> lock(mutex);
+            errors.emplace_back(e.what());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::int64_t c = 0; c < num_channels; ++c) reductions[c].Merge(partials[c]);
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (unsigned int i = 0; i < num_threads; ++i) threads.emplace_back(worker);
+    for (auto& thread : threads) thread.join();
+
+    if (!errors.empty()) {
+        throw std::runtime_error("Error mapping tiles: " + errors.front());
+    }
+    if (output) {
+        output->Flush();
+    }
+    return reductions;
+}
+
+} // ns bfiocpp
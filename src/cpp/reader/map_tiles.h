@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace bfiocpp{
+
+class TsReaderCPP;
+class TsWriterCPP;
+
+// Processes one height x width tile (c_order, converted to double) in place. Kernels are
+// called concurrently from several threads with different tiles.
+using TileKernel = std::function<void(double* tile, std::int64_t height, std::int64_t width)>;
+
+// Makes a kernel from its params, throws std::invalid_argument for a missing parameter.
+using TileKernelFactory = std::function<TileKernel(const std::map<std::string, double>& params)>;
+
+// Adds a kernel that GetTileKernel (and map_tiles in Python) finds by name, replacing a
+// kernel of the same name. The built-in kernels are:
+//   "threshold" (value): 1 where tile > value, 0 elsewhere
+//   "subtract"  (value): max(tile - value, 0)
+//   "scale"     (factor, offset = 0): tile * factor + offset
+void RegisterTileKernel(const std::string& name, TileKernelFactory factory);
+
+// throws std::invalid_argument for an unknown kernel or a missing parameter
+TileKernel GetTileKernel(const std::string& name, const std::map<std::string, double>& params);
+// names of the registered kernels in alphabetical order
+std::vector<std::string> GetTileKernelNames();
+
+struct MapTilesOptions {
+    std::int64_t tile_height = 1024, tile_width = 1024;
+    unsigned int num_threads = 0;   // 0 uses one thread per core
+};
+
+// Reduction of the kernel output of one channel over all tiles.
+struct ChannelReduction {
+    std::int64_t channel = 0;
+    std::int64_t count = 0, nonzero = 0;
+    double sum = 0, min, max;
+
+    ChannelReduction();
+    void Merge(const ChannelReduction& other);
+};
+
+// Runs kernel over every Y/X tile of every plane of the current level of reader. Idle
+// threads take the next tile from a shared counter, so slow tiles do not hold back the
+// rest. The kernel output is written to output (same shape as the image, converted with
+// saturation to its dtype) if given, and reduced per channel either way. output is
+// flushed before returning.
+std::vector<ChannelReduction> MapTiles(TsReaderCPP& reader, const TileKernel& kernel,
+                                       const MapTilesOptions& options = MapTilesOptions(),
+                                       TsWriterCPP* output = nullptr);
+} // ns bfiocpp
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include "tensorstore/array.h"
+#include "tensorstore/index_space/dim_expression.h"
+
+#include "patch_sampler.h"
+#include "../utilities/utilities.h"
+
+namespace bfiocpp {
+
+PatchSampler::PatchSampler(const std::vector<std::shared_ptr<TsReaderCPP>>& readers, const SamplerOptions& options,
+                           const std::vector<SamplingMask>& masks): _options(options) {
+
+    if (readers.empty()) {
+        throw std::invalid_argument("PatchSampler needs at least one reader");
+    }
+    if (_options.patch_height < 1 || _options.patch_width < 1 || _options.batch_size < 1) {
+        throw std::invalid_argument("patch size and batch size must be positive");
+    }
+    if (!masks.empty() && masks.size() != readers.size()) {
+        throw std::invalid_argument("masks must be empty or hold one mask per reader");
+    }
+    _options.shuffle_buffer_size = std::max(_options.shuffle_buffer_size, _options.batch_size);
+    _options.prefetch = std::max<std::size_t>(_options.prefetch, 1);
+    _random.seed(_options.seed != 0 ? _options.seed : std::random_device{}());
+
+    std::vector<double> stratum_weights;
+    for (std::size_t index = 0; index < readers.size(); ++index) {
+        Image image;
+        image.store = readers[index]->GetTensorStore();
+        const auto shape = image.store.domain().shape();
+        image.tsteps = shape[0];
+        image.depth = shape[2];
+        image.height = shape[3];
+        image.width = shape[4];
+        const auto read_chunk_shape = image.store.chunk_layout().value().read_chunk_shape();
+        image.chunk_height = read_chunk_shape[3] > 0 ? read_chunk_shape[3] : image.height;
+        image.chunk_width = read_chunk_shape[4] > 0 ? read_chunk_shape[4] : image.width;
+
+        if (index == 0) {
+            _dtype = image.store.dtype();
+            _num_channels = shape[1];
+        } else if (image.store.dtype() != _dtype || shape[1] != _num_channels) {
+            throw std::invalid_argument("All images of a PatchSampler need the same dtype and number of channels");
+        }
+        if (image.height < _options.patch_height || image.width < _options.patch_width) {
+            throw std::invalid_argument("Image " + std::to_string(index) + " is smaller than the patch size");
+        }
+
+        const auto num_planes = static_cast<double>(image.tsteps * image.depth);
+        if (masks.empty() || masks[index].weights.empty()) {
+            // every patch position is equally likely
+            stratum_weights.push_back(num_planes * (image.height - _options.patch_height + 1) * (image.width - _options.patch_width + 1));
+            _stratum_cells.emplace_back(index, -1);
+            image.max_weight = 0;
+        } else {
+            image.mask = masks[index];
+            const auto& weights = image.mask.weights;
+            if (image.mask.height < 1 || image.mask.width < 1 || static_cast<std::int64_t>(weights.size()) != image.mask.height * image.mask.width) {
+                throw std::invalid_argument("Mask " + std::to_string(index) + " does not match its height and width");
+            }
+            if (std::any_of(weights.begin(), weights.end(), [](double weight) {return !(weight >= 0);})) {
+                throw std::invalid_argument("Mask " + std::to_string(index) + " has negative weights");
+            }
+            for (std::size_t cell = 0; cell < weights.size(); ++cell) {
+                stratum_weights.push_back(num_planes * weights[cell]);
+                _stratum_cells.emplace_back(index, static_cast<std::int64_t>(cell));
+            }
+            image.max_weight = *std::max_element(weights.begin(), weights.end());
+        }
+        _images.push_back(std::move(image));
+    }
+    if (std::accumulate(stratum_weights.begin(), stratum_weights.end(), 0.0) <= 0) {
+        throw std::invalid_argument("The masks need a positive weight somewhere");
+    }
+    _strata = std::discrete_distribution<std::size_t>(stratum_weights.begin(), stratum_weights.end());
+}
+
+std::string PatchSampler::GetDataType() const {return std::string(_dtype.name());}
+
+std::int64_t PatchSampler::GetChannelCount() const {return _num_channels;}
+
+const SamplerOptions& PatchSampler::GetOptions() const {return _options;}
+
+std::array<std::int64_t, 5> PatchSampler::SamplePosition() {
+    auto uniform = [this](std::int64_t low, std::int64_t high) {
+        return std::uniform_int_distribution<std::int64_t>(low, high)(_random);
+    };
+    const auto [index, cell] = _stratum_cells[_strata(_random)];
+    const auto& image = _images[index];
+    const auto t = uniform(0, image.tsteps - 1);
+    const auto z = uniform(0, image.depth - 1);
+
+    if (cell < 0) {
+        return {static_cast<std::int64_t>(index), t, z, uniform(0, image.height - _options.patch_height),
+                uniform(0, image.width - _options.patch_width)};
+    }
+    // the patch is centered at a random pixel of the mask cell
+    const auto row = cell / image.mask.width, col = cell % image.mask.width;
+    const auto y0 = row * image.height / image.mask.height, y1 = (row + 1) * image.height / image.mask.height;
+    const auto x0 = col * image.width / image.mask.width, x1 = (col + 1) * image.width / image.mask.width;
+    const auto y = std::clamp(uniform(y0, std::max(y0, y1 - 1)) - _options.patch_height / 2, std::int64_t{0}, image.height - _options.patch_height);
+    const auto x = std::clamp(uniform(x0, std::max(x0, x1 - 1)) - _options.patch_width / 2, std::int64_t{0}, image.width - _options.patch_width);
+    return {static_cast<std::int64_t>(index), t, z, y, x};
+}
+
+bool PatchSampler::SampleNearRecentChunk(std::array<std::int64_t, 5>& position) {
+    const auto& chunk = _recent_chunks[std::uniform_int_distribution<std::size_t>(0, _recent_chunks.size() - 1)(_random)];
+    const auto& image = _images[chunk[0]];
+
+    // a patch inside the chunk, or covering it if the chunk is smaller than the patch
+    auto sample_start = [this](std::int64_t chunk_index, std::int64_t chunk_size, std::int64_t size, std::int64_t patch_size) {
+        const auto start = chunk_index * chunk_size, stop = std::min(start + chunk_size, size);
+        const auto low = stop - start >= patch_size ? start : std::max<std::int64_t>(0, stop - patch_size);
+        const auto high = stop - start >= patch_size ? stop - patch_size : std::min(start, size - patch_size);
+        return std::uniform_int_distribution<std::int64_t>(low, high)(_random);
+    };
+    position = {chunk[0], chunk[1], chunk[2],
+                sample_start(chunk[3], image.chunk_height, image.height, _options.patch_height),
+                sample_start(chunk[4], image.chunk_width, image.width, _options.patch_width)};
+
+    if (image.max_weight > 0) {
+        // rejection keeps the mask weights of patches drawn near recent chunks
+        const auto row = (position[3] + _options.patch_height / 2) * image.mask.height / image.height;
+        const auto col = (position[4] + _options.patch_width / 2) * image.mask.width / image.width;
+        const auto weight = image.mask.weights[row * image.mask.width + col];
+        return std::uniform_real_distribution<double>(0, image.max_weight)(_random) < weight;
+    }
+    return true;
+}
+
+void PatchSampler::IssueRead() {
+    std::array<std::int64_t, 5> position;
+    const bool near_recent = !_recent_chunks.empty() && std::bernoulli_distribution(_options.cache_affinity)(_random) &&
+                             SampleNearRecentChunk(position);
+    if (!near_recent) {
+        position = SamplePosition();
+    }
+    const auto& image = _images[position[0]];
+    const auto [index, t, z, y, x] = position;
+
+    // chunks read in the last few batches are likely still in the chunk cache
+    _recent_chunks.push_back({index, t, z, (y + _options.patch_height / 2) / image.chunk_height, (x + _options.patch_width / 2) / image.chunk_width});
+    while (_recent_chunks.size() > std::max<std::size_t>(_options.prefetch, 16)) {
+        _recent_chunks.pop_front();
+    }
+
+    auto patch_store = (image.store | tensorstore::Dims(0, 2).IndexSlice({t, z})
+                                    | tensorstore::Dims(1, 2).SizedInterval({y, x}, {_options.patch_height, _options.patch_width})).value();
+    auto data = tensorstore::AllocateArray({_num_channels, _options.patch_height, _options.patch_width},
+                                           tensorstore::c_order, tensorstore::default_init, _dtype);
+    auto ready = tensorstore::Read(patch_store, data);
+    _pending.push_back({std::move(data), position, std::move(ready)});
+}
+
+void PatchSampler::TopUp() {
+    while (_pending.size() < _options.prefetch) {
+        IssueRead();
+    }
+}
+
+template <typename T>
+std::shared_ptr<std::vector<T>> PatchSampler::StackPatches(const std::vector<Patch>& patches) const {
+    const auto patch_elements = static_cast<std::size_t>(_num_channels * _options.patch_height * _options.patch_width);
+    auto batch = std::make_shared<std::vector<T>>(patches.size() * patch_elements);
+    for (std::size_t index = 0; index < patches.size(); ++index) {
+        std::memcpy(batch->data() + index * patch_elements, patches[index].data.data(), patch_elements * sizeof(T));
+    }
+    return batch;
+}
+
+PatchBatch PatchSampler::NextBatch() {
+
+    // the oldest reads have usually finished while the previous batch was used
+    TopUp();
+    while (_shuffle_buffer.size() < _options.shuffle_buffer_size) {
+        auto patch = std::move(_pending.front());
+        _pending.pop_front();
+        auto status = patch.ready.status();
+        if (!status.ok()) {
+            throw std::runtime_error("Error reading patch: " + status.ToString());
+        }
+        _shuffle_buffer.push_back(std::move(patch));
+        IssueRead();
+    }
+
+    std::vector<Patch> patches;
+    PatchBatch batch;
+    for (std::size_t index = 0; index < _options.batch_size; ++index) {
+        const auto pick = std::uniform_int_distribution<std::size_t>(0, _shuffle_buffer.size() - 1)(_random);
+        std::swap(_shuffle_buffer[pick], _shuffle_buffer.back());
+        batch.positions.push_back(_shuffle_buffer.back().position);
+        patches.push_back(std::move(_shuffle_buffer.back()));
+        _shuffle_buffer.pop_back();
+    }
+
+    switch (GetDataTypeCode(_dtype.name()))
+    {
+    case (1): batch.data = std::make_shared<image_data>(std::move(*StackPatches<std::uint8_t>(patches))); break;
+    case (2): batch.data = std::make_shared<image_data>(std::move(*StackPatches<std::uint16_t>(patches))); break;
+    case (4): batch.data = std::make_shared<image_data>(std::move(*StackPatches<std::uint32_t>(patches))); break;
+    case (8): batch.data = std::make_shared<image_data>(std::move(*StackPatches<std::uint64_t>(patches))); break;
+    case (16): batch.data = std::make_shared<image_data>(std::move(*StackPatches<std::int8_t>(patches))); break;
+    case (32): batch.data = std::make_shared<image_data>(std::move(*StackPatches<std::int16_t>(patches))); break;
+    case (64): batch.data = std::make_shared<image_data>(std::move(*StackPatches<std::int32_t>(patches))); break;
+    case (128): batch.data = std::make_shared<image_data>(std::move(*StackPatches<std::int64_t>(patches))); break;
+    case (256): batch.data = std::make_shared<image_data>(std::move(*StackPatches<float>(patches))); break;
+    default: batch.data = std::make_shared<image_data>(std::move(*StackPatches<double>(patches))); break;
+    }
+
+    // keep reads in flight while the batch is used
+    TopUp();
+    return batch;
+}
+
+} // ns bfiocpp
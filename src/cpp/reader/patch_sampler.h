@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <random>
+#include <vector>
+#include "tensorstore/tensorstore.h"
+#include "tsreader.h"
+
+namespace bfiocpp{
+
+struct SamplerOptions {
+    std::int64_t patch_height = 256, patch_width = 256;
+    std::size_t batch_size = 32;
+    std::size_t shuffle_buffer_size = 256;  // read patches that batches are drawn from at random
+    std::size_t prefetch = 64;              // patch reads kept in flight
+    double cache_affinity = 0.5;            // probability of sampling at a recently read chunk
+    std::uint64_t seed = 0;                 // 0 picks a random seed
+};
+
+// Sampling weights over a grid covering the whole image, the same for every Z and T.
+// Empty weights sample uniformly.
+struct SamplingMask {
+    std::vector<double> weights;            // c_order, height x width
+    std::int64_t height = 0, width = 0;
+};
+
+// Batch of patches, data is (batch, C, patch_height, patch_width)
+struct PatchBatch {
+    std::shared_ptr<image_data> data;
+    std::vector<std::array<std::int64_t, 5>> positions;   // (reader, T, Z, Y, X) of each patch
+};
+
+// Draws random patches with all channels from a set of images. Reads run ahead on the
+// tensorstore threads, and batches are drawn at random from a shuffle buffer of read patches,
+// which lets a share of the patches come from recently read chunks without correlating the batches.
+class PatchSampler{
+public:
+    // masks is empty or holds one mask per reader, all readers need the same dtype and channels
+    PatchSampler(const std::vector<std::shared_ptr<TsReaderCPP>>& readers, const SamplerOptions& options,
+                 const std::vector<SamplingMask>& masks = {});
+    PatchBatch NextBatch();
+    std::string GetDataType() const;
+    std::int64_t GetChannelCount() const;
+    const SamplerOptions& GetOptions() const;
+
+private:
+    struct Image {
+        tensorstore::TensorStore<> store;   // TCZYX
+        std::int64_t height, width, depth, tsteps, chunk_height, chunk_width;
+        SamplingMask mask;
+        double max_weight;
+    };
+    struct Patch {
+        tensorstore::SharedArray<void> data;
+        std::array<std::int64_t, 5> position;
+        tensorstore::Future<void> ready;
+    };
+
+    SamplerOptions _options;
+    std::vector<Image> _images;
+    std::int64_t _num_channels;
+    tensorstore::DataType _dtype;
+    std::mt19937_64 _random;
+    std::discrete_distribution<std::size_t> _strata;    // (image, mask cell) by sampling weight
+    std::vector<std::pair<std::size_t, std::int64_t>> _stratum_cells;
+    std::deque<std::array<std::int64_t, 5>> _recent_chunks;  // (image, T, Z, chunk row, chunk col)
+    std::deque<Patch> _pending;
+    std::vector<Patch> _shuffle_buffer;
+
+    std::array<std::int64_t, 5> SamplePosition();
+    bool SampleNearRecentChunk(std::array<std::int64_t, 5>& position);
+    void IssueRead();
+    void TopUp();
+    template <typename T>
+    std::shared_ptr<std::vector<T>> StackPatches(const std::vector<Patch>& patches) const;
+};
+} // ns bfiocpp
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <tiffio.h>
+#include <nlohmann/json.hpp>
+
+#include "tensorstore/driver/zarr/dtype.h"
+#include "probe.h"
+#include "../ts_driver/tiled_tiff/omexml.h"
+
+namespace bfiocpp {
+
+namespace {
+std::string GetTiffDataType(std::uint16_t sample_format, std::uint16_t bits_per_sample){
+    const std::string bits = std::to_string(bits_per_sample);
+    switch (sample_format) {
+        case SAMPLEFORMAT_UINT: return "uint" + bits;
+        case SAMPLEFORMAT_INT: return "int" + bits;
+        case SAMPLEFORMAT_IEEEFP: return "float" + bits;
+        default: throw std::runtime_error("unsupported sample format " + std::to_string(sample_format));
+    }
+}
+
+void ProbeOmeTiff(const std::string& path, ImageInfo& info){
+    TIFF *tiff_file = TIFFOpen(path.c_str(), "r");
+    if (tiff_file == nullptr) throw std::runtime_error("can not open the file as TIFF");
+
+    std::uint32_t width = 0, height = 0, tile_width = 0, tile_height = 0;
+    std::uint16_t sample_format = SAMPLEFORMAT_UINT, bits_per_sample = 0, num_sub_ifds = 0;
+    toff_t* sub_ifd_offsets = nullptr;
+    char* description = nullptr;
+    TIFFGetField(tiff_file, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tiff_file, TIFFTAG_IMAGELENGTH, &height);
+    TIFFGetFieldDefaulted(tiff_file, TIFFTAG_SAMPLEFORMAT, &sample_format);
+    TIFFGetFieldDefaulted(tiff_file, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+    const bool tiled = TIFFIsTiled(tiff_file) != 0;
+    if (tiled) {
+        TIFFGetField(tiff_file, TIFFTAG_TILEWIDTH, &tile_width);
+        TIFFGetField(tiff_file, TIFFTAG_TILELENGTH, &tile_height);
+    }
+    if (TIFFGetField(tiff_file, TIFFTAG_SUBIFD, &num_sub_ifds, &sub_ifd_offsets) == 0) num_sub_ifds = 0;
+
+    std::string ome_xml_text;
+    if (TIFFGetField(tiff_file, TIFFTAG_IMAGEDESCRIPTION, &description) != 0 && description != nullptr) ome_xml_text = description;
+    TIFFClose(tiff_file);
+
+    // the OME-XML Pixels element has the Z, C and T sizes, the driver assumes 1 without it
+    OmeXml ome_xml;
+    if (!ome_xml_text.empty()) ome_xml.ParseOmeXml(ome_xml_text.data());
+
+    info.height = height;
+    info.width = width;
+    info.depth = static_cast<std::int64_t>(ome_xml.nz);
+    info.num_channels = static_cast<std::int64_t>(ome_xml.nc);
+    info.num_tsteps = static_cast<std::int64_t>(ome_xml.nt);
+    // strips are read as 1024 row blocks spanning the image width
+    info.tile_height = tiled ? tile_height : 1024;
+    info.tile_width = tiled ? tile_width : width;
+    info.data_type = GetTiffDataType(sample_format, bits_per_sample);
+    info.num_levels = 1 + num_sub_ifds;
+}
+
+::nlohmann::json ReadJson(const std::filesystem::path& path){
+    std::ifstream file(path);
+    if (!file) throw std::runtime_error("can not read " + path.string());
+    auto json = ::nlohmann::json::parse(file, nullptr, false);
+    if (json.is_discarded() || !json.is_object()) throw std::runtime_error(path.string() + " is not a JSON object");
+    return json;
+}
+
+std::vector<std::int64_t> GetShape(const ::nlohmann::json& json, const std::string& key){
+    const auto value = json.value(key, ::nlohmann::json());
+    if (!value.is_array() || value.empty()) throw std::runtime_error("missing \"" + key + "\" in the array metadata");
+    return value.get<std::vector<std::int64_t>>();
+}
+
+void ProbeZarr(const std::string& path, FileType file_type, const std::string& axes_list, ImageInfo& info){
+    // a multiscales group is described by its first level
+    auto array_path = std::filesystem::path(path);
+    const auto levels = GetZarrMultiscaleLevels(path, file_type);
+    if (!levels.empty()) {
+        array_path /= levels[0].path;
+        info.num_levels = levels.size();
+    }
+
+    std::vector<std::int64_t> shape, chunk_shape;
+    if (file_type == FileType::OmeZarrV3) {
+        const auto metadata = ReadJson(array_path / "zarr.json");
+        shape = GetShape(metadata, "shape");
+        chunk_shape = GetShape(metadata.value("chunk_grid", ::nlohmann::json::object()).value("configuration", ::nlohmann::json::object()),
+                               "chunk_shape");
+        // a sharded array is read in its inner chunks
+        for (const auto& codec : metadata.value("codecs", ::nlohmann::json::array())) {
+            if (codec.is_object() && codec.value("name", "") == "sharding_indexed") {
+                chunk_shape = GetShape(codec.value("configuration", ::nlohmann::json::object()), "chunk_shape");
+            }
+        }
+        info.data_type = metadata.value("data_type", "");
+    } else {
+        const auto metadata = ReadJson(array_path / ".zarray");
+        shape = GetShape(metadata, "shape");
+        chunk_shape = GetShape(metadata, "chunks");
+        auto dtype = tensorstore::internal_zarr::ParseDType(metadata.value("dtype", ::nlohmann::json()));
+        if (!dtype.ok() || dtype->has_fields) throw std::runtime_error("unsupported dtype in " + (array_path / ".zarray").string());
+        info.data_type = std::string(dtype->fields[0].dtype.name());
+    }
+    if (shape.size() < 2 || chunk_shape.size() != shape.size()) {
+        throw std::runtime_error("the array must have at least 2 dimensions and a chunk size for each");
+    }
+
+    // the same axes as TsReaderCPP, Y and X are the last two dimensions
+    const auto rank = shape.size();
+    std::optional<int> t_index, c_index, z_index;
+    if (rank == 5) {
+        t_index = 0;
+        c_index = 1;
+        z_index = 2;
+    } else {
+        std::tie(t_index, c_index, z_index) = ParseMultiscaleMetadata(axes_list, static_cast<int>(rank));
+    }
+    info.height = shape[rank - 2];
+    info.width = shape[rank - 1];
+    info.tile_height = chunk_shape[rank - 2];
+    info.tile_width = chunk_shape[rank - 1];
+    info.num_tsteps = t_index ? shape[*t_index] : 1;
+    info.num_channels = c_index ? shape[*c_index] : 1;
+    info.depth = z_index ? shape[*z_index] : 1;
+}
+} // namespace
+
+ImageInfo ProbeImage(const std::string& path, FileType file_type, const std::string& axes_list){
+    ImageInfo info;
+    info.path = path;
+    try {
+        if (file_type == FileType::OmeTiff) {
+            ProbeOmeTiff(path, info);
+        } else {
+            ProbeZarr(path, file_type, axes_list, info);
+        }
+    } catch (const std::exception& e) {
+        throw std::runtime_error("Error probing " + path + ": " + e.what());
+    }
+    return info;
+}
+
+std::vector<ImageInfo> ProbeImages(const std::vector<std::string>& paths, FileType file_type,
+                                   const std::string& axes_list, unsigned int num_threads){
+    std::vector<ImageInfo> infos(paths.size());
+    const auto threads_to_start = std::min<std::size_t>(
+        std::max(1u, num_threads > 0 ? num_threads : std::thread::hardware_concurrency()), std::max<std::size_t>(paths.size(), 1));
+
+    // probes are small blocking reads, so every thread takes the next file as it finishes one
+    std::atomic<std::size_t> next_path{0};
+    auto worker = [&]() {
+        for (auto index = next_path++; index < paths.size(); index = next_path++) {
+            try {
+                infos[index] = ProbeImage(paths[index], file_type, axes_list);
+            } catch (const std::exception& e) {
+                infos[index].path = paths[index];
+                infos[index].error = e.what();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threads_to_start);
+    for (std::size_t i = 0; i < threads_to_start; ++i) threads.emplace_back(worker);
+    for (auto& thread : threads) thread.join();
+    return infos;
+}
+
+} // ns bfiocpp
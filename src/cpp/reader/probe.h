@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../utilities/utilities.h"
+
+namespace bfiocpp{
+
+// Shape, dtype and tiling of level 0 of an image, as TsReaderCPP would report them.
+struct ImageInfo {
+    std::string path;
+    std::int64_t height = 0, width = 0, depth = 1, num_channels = 1, num_tsteps = 1;
+    std::int64_t tile_height = 0, tile_width = 0;   // read chunk (TIFF tile, 1024 row strip or zarr chunk)
+    std::string data_type;
+    std::size_t num_levels = 1;
+    std::string error;                              // set by ProbeImages for a file that failed
+};
+
+// Reads only the metadata of an image: the first IFD tags and the OME-XML Pixels of an
+// OME-TIFF, or the .zarray / zarr.json of a zarr array (the first level of a multiscales
+// group). No tensorstore driver, cache or executor is created. axes_list is interpreted like
+// TsReaderCPP does for zarr arrays that are not TCZYX. Throws std::runtime_error if the
+// metadata can not be read.
+ImageInfo ProbeImage(const std::string& path, FileType file_type, const std::string& axes_list = "");
+
+// ProbeImage of every path on num_threads threads (0 for one per core). A file that fails has
+// its error set instead of throwing.
+std::vector<ImageInfo> ProbeImages(const std::vector<std::string>& paths, FileType file_type,
+                                   const std::string& axes_list = "", unsigned int num_threads = 0);
+} // ns bfiocpp
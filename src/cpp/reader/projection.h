@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace bfiocpp{
+
+enum class ProjectionMethod {Max, Min, Sum, Mean};
+
+// "max", "min", "sum" or "mean", throws std::invalid_argument otherwise
+ProjectionMethod GetProjectionMethod(const std::string& method);
+
+// max and min keep the image dtype, sum and mean accumulate in double
+inline bool ProjectsToDouble(ProjectionMethod method) {
+    return method == ProjectionMethod::Sum || method == ProjectionMethod::Mean;
+}
+
+// Accumulates a rows x cols block of src (src_dtype_code, c_order) into dst, whose rows are
+// dst_row_stride elements apart. dst is double for sum and mean and the src type otherwise,
+// mean is accumulated as a sum.
+void AccumulateProjection(const void* src, std::uint16_t src_dtype_code, void* dst, ProjectionMethod method,
+                          std::int64_t rows, std::int64_t cols, std::int64_t dst_row_stride);
+} // ns bfiocpp
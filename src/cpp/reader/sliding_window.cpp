@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include "tensorstore/array.h"
+#include "tensorstore/index_space/dim_expression.h"
+#include "sliding_window.h"
+#include "convert.h"
+#include "tsreader.h"
+#include "../writer/tswriter.h"
+
+namespace bfiocpp {
+
+namespace {
+// start of every window along an axis, the last window is moved back to end at the image edge
+std::vector<std::int64_t> GetWindowStarts(std::int64_t length, std::int64_t window, std::int64_t overlap){
+    std::vector<std::int64_t> starts;
+    for (std::int64_t start = 0; ; start += window - overlap) {
+        if (start + window >= length) {
+            starts.push_back(std::max<std::int64_t>(length - window, 0));
+            return starts;
+        }
+        starts.push_back(start);
+    }
+}
+
+// blending weight of every position of a window along an axis, first and last are set for
+// windows at the image edge, where nothing else covers the overlap
+std::vector<double> GetWindowProfile(const std::string& blend, std::int64_t size, std::int64_t overlap, bool first, bool last){
+    std::vector<double> profile(size, 1.0);
+    if (blend == "gaussian") {
+        const double center = (size - 1) / 2.0, sigma = std::max(size / 8.0, 1.0);
+        for (std::int64_t i = 0; i < size; ++i) {
+            // never 0, so pixels covered only by a window edge keep a result
+            profile[i] = std::max(std::exp(-0.5 * std::pow((i - center) / sigma, 2)), 1e-6);
+        }
+    } else if (blend == "crop") {
+        const std::int64_t begin = first ? 0 : overlap / 2, end = last ? size : size - overlap / 2;
+        for (std::int64_t i = 0; i < size; ++i) profile[i] = (i >= begin && i < end) ? 1.0 : 0.0;
+    }
+    return profile;
+}
+
+struct Window {
+    std::int64_t t, z, y, x, height, width;
+    std::int64_t row, col;  // position in the window grid of the plane
+};
+
+// weighted sum of the results of the windows overlapping an output chunk
+struct BlendBuffer {
+    std::vector<double> values, weights;
+    std::int64_t remaining_windows = 0;
+};
+
+struct PendingWindow {
+    std::size_t index;
+    tensorstore::SharedArray<void> data;
+    tensorstore::Future<void> future;
+};
+
+} // namespace
+
+void RunSlidingWindow(TsReaderCPP& reader, TsWriterCPP& output, const WindowCallback& callback,
+                      const SlidingWindowOptions& options){
+    if (options.window_height <= 0 || options.window_width <= 0) {
+        throw std::invalid_argument("Error running sliding window: window size must be positive");
+    }
+    if (options.overlap_height < 0 || options.overlap_width < 0 ||
+        options.overlap_height >= options.window_height || options.overlap_width >= options.window_width) {
+        throw std::invalid_argument("Error running sliding window: overlap must be at least 0 and smaller than the window");
+    }
+    if (options.blend != "gaussian" && options.blend != "constant" && options.blend != "crop") {
+        throw std::invalid_argument("Invalid blend \"" + options.blend + "\", must be gaussian, constant or crop");
+    }
+    if (options.output_channels < 0) {
+        throw std::invalid_argument("Error running sliding window: output_channels must not be negative");
+    }
+
+    const auto view = reader.GetTensorStore();
+    const auto shape = view.domain().shape();
+    const std::int64_t num_tsteps = shape[0], num_channels = shape[1], num_layers = shape[2],
+                       height = shape[3], width = shape[4];
+    const std::int64_t output_channels = options.output_channels > 0 ? options.output_channels : num_channels;
+    const std::uint16_t src_dtype_code = GetDataTypeCode(view.dtype().name());
+    const std::uint16_t out_dtype_code = output.GetDataTypeCode();
+    const auto out_dtype = GetTensorStoreDataType(out_dtype_code);
+    const auto [chunk_height, chunk_width] = output.GetChunkShapeYX();
+    const std::int64_t chunks_down = (height + chunk_height - 1) / chunk_height,
+                       chunks_across = (width + chunk_width - 1) / chunk_width;
+
+    // the window grid is the same for every plane
+    const auto row_starts = GetWindowStarts(height, options.window_height, options.overlap_height);
+    const auto col_starts = GetWindowStarts(width, options.window_width, options.overlap_width);
+    std::vector<Window> windows;
+    for (std::int64_t t = 0; t < num_tsteps; ++t) {
+        for (std::int64_t z = 0; z < num_layers; ++z) {
+            for (std::size_t row = 0; row < row_starts.size(); ++row) {
+                for (std::size_t col = 0; col < col_starts.size(); ++col) {
+                    windows.push_back({t, z, row_starts[row], col_starts[col],
+                                       std::min(options.window_height, height), std::min(options.window_width, width),
+                                       static_cast<std::int64_t>(row), static_cast<std::int64_t>(col)});
+                }
+            }
+        }
+    }
+
+    // windows overlapping every output chunk of a plane, a chunk is written when all are done
+    std::vector<std::int64_t> windows_per_chunk(chunks_down * chunks_across, 0);
+    for (std::size_t index = 0; index < row_starts.size() * col_starts.size(); ++index) {
+        const auto& window = windows[index];
+        for (auto cy = window.y / chunk_height; cy <= (window.y + window.height - 1) / chunk_height; ++cy) {
+            for (auto cx = window.x / chunk_width; cx <= (window.x + window.width - 1) / chunk_width; ++cx) {
+                ++windows_per_chunk[cy * chunks_across + cx];
+            }
+        }
+    }
+
+    std::deque<PendingWindow> pending;
+    std::size_t next_window = 0;
+    auto issue_reads = [&]() {
+        while (next_window < windows.size() && pending.size() < std::max<std::size_t>(options.prefetch, 1)) {
+            const auto& window = windows[next_window];
+            auto window_transform = (tensorstore::IdentityTransform(view.domain()) |
+                                     tensorstore::Dims(3, 4).SizedInterval({window.y, window.x}, {window.height, window.width}) |
+                                     tensorstore::Dims(0, 2).IndexSlice({window.t, window.z})).value();
+            auto data = tensorstore::AllocateArray({num_channels, window.height, window.width}, tensorstore::c_order,
+                                                   tensorstore::default_init, view.dtype());
+            auto future = tensorstore::Read(view | window_transform, data);
+            pending.push_back({next_window, std::move(data), std::move(future)});
+            ++next_window;
+        }
+    };
+
+    std::map<std::array<std::int64_t, 4>, BlendBuffer> buffers;
+    std::vector<float> input, result;
+    std::vector<double> blended;
+    const double lowest = -std::numeric_limits<double>::infinity(), highest = std::numeric_limits<double>::infinity();
+
+    issue_reads();
+    while (!pending.empty()) {
+        auto current = std::move(pending.front());
+        pending.pop_front();
+        // keep the reads ahead of the callback
+        issue_reads();
+
+        auto read_status = current.future.status();
+        if (!read_status.ok()) {
+            throw std::runtime_error("Error reading image: " + read_status.ToString());
+        }
+
+        const auto& window = windows[current.index];
+        const auto window_size = window.height * window.width;
+        input.resize(num_channels * window_size);
+        ConvertBlock(current.data.data(), src_dtype_code, input.data(), 256, input.size(), 1.0, 0.0, lowest, highest);
+        result.assign(output_channels * window_size, 0.0f);
+        callback(input.data(), num_channels, window.height, window.width, result.data(), output_channels);
+
+        const auto row_profile = GetWindowProfile(options.blend, window.height, options.overlap_height,
+                                                  window.row == 0, window.row + 1 == static_cast<std::int64_t>(row_starts.size()));
+        const auto col_profile = GetWindowProfile(options.blend, window.width, options.overlap_width,
+                                                  window.col == 0, window.col + 1 == static_cast<std::int64_t>(col_starts.size()));
+
+        for (auto cy = window.y / chunk_height; cy <= (window.y + window.height - 1) / chunk_height; ++cy) {
+            for (auto cx = window.x / chunk_width; cx <= (window.x + window.width - 1) / chunk_width; ++cx) {
+                const std::int64_t chunk_y = cy * chunk_height, chunk_x = cx * chunk_width;
+                const std::int64_t chunk_h = std::min(chunk_height, height - chunk_y), chunk_w = std::min(chunk_width, width - chunk_x);
+                auto [it, created] = buffers.try_emplace({window.t, window.z, cy, cx});
+                auto& buffer = it->second;
+                if (created) {
+                    buffer.values.assign(output_channels * chunk_h * chunk_w, 0.0);
+                    buffer.weights.assign(chunk_h * chunk_w, 0.0);
+                    buffer.remaining_windows = windows_per_chunk[cy * chunks_across + cx];
+                }
+
+                // overlap of the window and the chunk in image coordinates
+                const auto y_begin = std::max(window.y, chunk_y), y_end = std::min(window.y + window.height, chunk_y + chunk_h);
+                const auto x_begin = std::max(window.x, chunk_x), x_end = std::min(window.x + window.width, chunk_x + chunk_w);
+                for (auto y = y_begin; y < y_end; ++y) {
+                    const auto row_weight = row_profile[y - window.y];
+                    for (auto x = x_begin; x < x_end; ++x) {
+                        buffer.weights[(y - chunk_y) * chunk_w + (x - chunk_x)] += row_weight * col_profile[x - window.x];
+                    }
+                    for (std::int64_t c = 0; c < output_channels; ++c) {
+                        const float* src = result.data() + c * window_size + (y - window.y) * window.width;
+                        double* dst = buffer.values.data() + (c * chunk_h + (y - chunk_y)) * chunk_w;
+                        for (auto x = x_begin; x < x_end; ++x) {
+                            dst[x - chunk_x] += row_weight * col_profile[x - window.x] * src[x - window.x];
+                        }
+                    }
+                }
+
+                if (--buffer.remaining_windows > 0) continue;
+
+                // every window overlapping the chunk is done, normalize and write it
+                const auto plane_size = chunk_h * chunk_w;
+                blended.resize(buffer.values.size());
+                for (std::int64_t c = 0; c < output_channels; ++c) {
+                    for (std::int64_t i = 0; i < plane_size; ++i) {
+                        const double weight = buffer.weights[i];
+                        blended[c * plane_size + i] = weight > 0 ? buffer.values[c * plane_size + i] / weight : 0.0;
+                    }
+                }
+                auto converted = tensorstore::AllocateArray({output_channels, chunk_h, chunk_w}, tensorstore::c_order,
+                                                            tensorstore::default_init, out_dtype);
+                ConvertBlock(blended.data(), 512, converted.data(), out_dtype_code, blended.size(), 1.0, 0.0, lowest, highest);
+                output.WriteArray(converted, Seq(chunk_y, chunk_y + chunk_h - 1), Seq(chunk_x, chunk_x + chunk_w - 1),
+                                  Seq(window.z, window.z), Seq(0, output_channels - 1), Seq(window.t, window.t));
+                buffers.erase(it);
+            }
+        }
+    }
+
+    output.Flush();
+}
+
+} // ns bfiocpp
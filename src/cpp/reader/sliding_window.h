@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace bfiocpp{
+
+class TsReaderCPP;
+class TsWriterCPP;
+
+// Fills result, a (output_channels, height, width) float buffer, from window, a
+// (channels, height, width) float window of all channels of the input.
+using WindowCallback = std::function<void(const float* window, std::int64_t channels, std::int64_t height, std::int64_t width,
+                                          float* result, std::int64_t output_channels)>;
+
+struct SlidingWindowOptions {
+    std::int64_t window_height = 512, window_width = 512;
+    // overlap of neighboring windows in Y and X, e.g. twice the receptive field halo
+    std::int64_t overlap_height = 64, overlap_width = 64;
+    // how overlapping results are combined:
+    //   "gaussian": weighted by a gaussian centered on each window (sigma = size / 8)
+    //   "constant": averaged
+    //   "crop": every window keeps its center and drops overlap / 2 at each inner edge
+    std::string blend = "gaussian";
+    std::int64_t output_channels = 0;   // 0 keeps the input channel count
+    std::size_t prefetch = 8;           // windows read ahead of the callback
+};
+
+// Runs callback over overlapping windows of every Z/T plane of the current level of reader
+// and writes the blended result to output, which must have the image shape in Y, X, Z and T
+// and output_channels channels. Windows are read ahead while the callback runs, results are
+// accumulated in buffers aligned to the output chunks, and a chunk is written as soon as every
+// window that overlaps it is done. output is flushed before returning.
+void RunSlidingWindow(TsReaderCPP& reader, TsWriterCPP& output, const WindowCallback& callback,
+                      const SlidingWindowOptions& options = SlidingWindowOptions());
+} // ns bfiocpp
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+#include "statistics.h"
+
+namespace bfiocpp {
+
+namespace {
+// values of a block are summed and their squared differences from the block mean taken in
+// a second pass while the block is in cache
+constexpr std::size_t kMomentBlockSize = 4096;
+
+// Chan et al. pairwise update of the count, sum and m2 of stats with those of another set
+void MergeMoments(ImageStatistics& stats, std::int64_t count, double sum, double m2){
+    if (count == 0) return;
+    if (stats.count > 0) {
+        const double delta = sum / count - stats.sum / stats.count;
+        stats.m2 += delta * delta * (static_cast<double>(stats.count) * count / (stats.count + count));
+    }
+    stats.m2 += m2;
+    stats.sum += sum;
+    stats.count += count;
+}
+
+template <typename T>
+void AccumulateTyped(const T* data, std::size_t num_elements, ImageStatistics& stats){
+    if (num_elements == 0) return;
+
+    if constexpr (std::is_integral_v<T> && sizeof(T) <= 2) {
+        // integer accumulators keep the loop free of dependencies on floating point
+        // rounding so it vectorizes, squares of 16 bit values fit 2^32 values in 64 bits
+        T lo = std::numeric_limits<T>::max(), hi = std::numeric_limits<T>::lowest();
+        std::int64_t sum = 0;
+        std::uint64_t sum_squares = 0;
+        for (std::size_t i = 0; i < num_elements; ++i) {
+            const T value = data[i];
+            lo = std::min(lo, value);
+            hi = std::max(hi, value);
+            sum += value;
+            sum_squares += static_cast<std::uint64_t>(static_cast<std::int64_t>(value) * value);
+        }
+        stats.min = std::min(stats.min, static_cast<double>(lo));
+        stats.max = std::max(stats.max, static_cast<double>(hi));
+        // the sums are exact, so the only error is the rounding of this difference
+        const double m2 = static_cast<double>(sum_squares) - static_cast<double>(sum) * (static_cast<double>(sum) / num_elements);
+        MergeMoments(stats, static_cast<std::int64_t>(num_elements), static_cast<double>(sum), std::max(0.0, m2));
+    } else {
+        double lo = std::numeric_limits<double>::infinity(), hi = -std::numeric_limits<double>::infinity();
+        for (std::size_t block = 0; block < num_elements; block += kMomentBlockSize) {
+            const std::size_t block_end = std::min(num_elements, block + kMomentBlockSize);
+            double sum = 0;
+            std::size_t count = 0;
+            for (std::size_t i = block; i < block_end; ++i) {
+                const double value = static_cast<double>(data[i]);
+                if constexpr (std::is_floating_point_v<T>) {
+                    if (std::isnan(value)) continue;
+                }
+                lo = std::min(lo, value);
+                hi = std::max(hi, value);
+                sum += value;
+                ++count;
+            }
+            if (count == 0) continue;
+
+            const double mean = sum / count;
+            double m2 = 0;
+            for (std::size_t i = block; i < block_end; ++i) {
+                const double value = static_cast<double>(data[i]);
+                if constexpr (std::is_floating_point_v<T>) {
+                    if (std::isnan(value)) continue;
+                }
+                m2 += (value - mean) * (value - mean);
+            }
+            MergeMoments(stats, static_cast<std::int64_t>(count), sum, m2);
+        }
+        stats.min = std::min(stats.min, lo);
+        stats.max = std::max(stats.max, hi);
+    }
+
+    if (stats.histogram.empty()) return;
+    auto* bins = stats.histogram.data();
+    const auto num_bins = static_cast<std::int64_t>(stats.histogram.size());
+    if constexpr (std::is_integral_v<T> && sizeof(T) <= 2) {
+        if (stats.histogram_min == static_cast<double>(std::numeric_limits<T>::lowest()) &&
+            stats.histogram_max - stats.histogram_min == static_cast<double>(num_bins)) {
+            // one bin per value
+            for (std::size_t i = 0; i < num_elements; ++i) {
+                ++bins[static_cast<std::int64_t>(data[i]) - std::numeric_limits<T>::lowest()];
+            }
+            return;
+        }
+    }
+    const double bin_scale = num_bins / (stats.histogram_max - stats.histogram_min);
+    for (std::size_t i = 0; i < num_elements; ++i) {
+        const double value = static_cast<double>(data[i]);
+        if constexpr (std::is_floating_point_v<T>) {
+            if (std::isnan(value)) continue;
+        }
+        const double bin = std::floor((value - stats.histogram_min) * bin_scale);
+        ++bins[bin < 0 ? 0 : (bin >= num_bins ? num_bins - 1 : static_cast<std::int64_t>(bin))];
+    }
+}
+} // namespace
+
+ImageStatistics::ImageStatistics():
+    min(std::numeric_limits<double>::infinity()), max(-std::numeric_limits<double>::infinity()) {}
+
+double ImageStatistics::Mean() const {
+    return count > 0 ? sum / count : std::numeric_limits<double>::quiet_NaN();
+}
+
+double ImageStatistics::StandardDeviation() const {
+    if (count == 0) return std::numeric_limits<double>::quiet_NaN();
+    return std::sqrt(m2 / count);
+}
+
+double ImageStatistics::Percentile(double percent) const {
+    if (percent < 0 || percent > 100) {
+        throw std::invalid_argument("percentile must be between 0 and 100");
+    }
+    std::int64_t total = 0;
+    for (auto bin_count : histogram) total += bin_count;
+    if (total == 0) return std::numeric_limits<double>::quiet_NaN();
+
+    const double bin_width = (histogram_max - histogram_min) / histogram.size();
+    const double rank = percent / 100.0 * total;
+    std::int64_t cumulative = 0;
+    for (std::size_t bin = 0; bin < histogram.size(); ++bin) {
+        if (histogram[bin] == 0) continue;
+        if (cumulative + histogram[bin] >= rank) {
+            // values are assumed to be spread evenly over the bin
+            const double fraction = (rank - cumulative) / histogram[bin];
+            return std::clamp(histogram_min + (bin + fraction) * bin_width, min, max);
+        }
+        cumulative += histogram[bin];
+    }
+    return max;
+}
+
+void ImageStatistics::Merge(const ImageStatistics& other){
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+    MergeMoments(*this, other.count, other.sum, other.m2);
+    if (histogram.size() != other.histogram.size()) {
+        throw std::invalid_argument("Error merging statistics: histograms have different bins");
+    }
+    for (std::size_t bin = 0; bin < histogram.size(); ++bin) histogram[bin] += other.histogram[bin];
+}
+
+void AccumulateStatistics(const void* data, std::uint16_t dtype_code, std::size_t num_elements, ImageStatistics& stats){
+    switch(dtype_code)
+    {
+        case (1): AccumulateTyped(static_cast<const std::uint8_t*>(data), num_elements, stats); break;
+        case (2): AccumulateTyped(static_cast<const std::uint16_t*>(data), num_elements, stats); break;
+        case (4): AccumulateTyped(static_cast<const std::uint32_t*>(data), num_elements, stats); break;
+        case (8): AccumulateTyped(static_cast<const std::uint64_t*>(data), num_elements, stats); break;
+        case (16): AccumulateTyped(static_cast<const std::int8_t*>(data), num_elements, stats); break;
+        case (32): AccumulateTyped(static_cast<const std::int16_t*>(data), num_elements, stats); break;
+        case (64): AccumulateTyped(static_cast<const std::int32_t*>(data), num_elements, stats); break;
+        case (128): AccumulateTyped(static_cast<const std::int64_t*>(data), num_elements, stats); break;
+        case (256): AccumulateTyped(static_cast<const float*>(data), num_elements, stats); break;
+        case (512): AccumulateTyped(static_cast<const double*>(data), num_elements, stats); break;
+        default:
+            throw std::invalid_argument("Error computing statistics: unsupported data type");
+    }
+}
+
+int GetDefaultHistogramBins(std::uint16_t dtype_code){
+    switch(dtype_code)
+    {
+        case (1): case (16): return 256;
+        case (2): case (32): return 65536;
+        default: return 1024;
+    }
+}
+
+std::optional<std::pair<double, double>> GetDefaultHistogramRange(std::uint16_t dtype_code){
+    // the upper bound is exclusive, so every integer value gets a bin of width 1
+    switch(dtype_code)
+    {
+        case (1): return std::make_pair(0.0, 256.0);
+        case (2): return std::make_pair(0.0, 65536.0);
+        case (16): return std::make_pair(-128.0, 128.0);
+        case (32): return std::make_pair(-32768.0, 32768.0);
+        default: return std::nullopt;
+    }
+}
+
+} // ns bfiocpp
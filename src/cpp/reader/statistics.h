@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace bfiocpp{
+
+struct StatisticsOptions {
+    bool per_layer = false;     // separate statistics for every Z
+    bool per_tstep = false;     // separate statistics for every T
+    // 0 picks one bin per value for 8 and 16 bit integers and 1024 bins otherwise
+    int num_bins = 0;
+    // histogram range, by default the dtype range for 8 and 16 bit integers and the
+    // data range otherwise (which takes a second pass over the image)
+    std::optional<double> histogram_min, histogram_max;
+};
+
+// Statistics of one channel, optionally of a single Z and/or T.
+struct ImageStatistics {
+    std::int64_t tstep = -1, channel = 0, layer = -1;  // -1 when aggregated over the dimension
+    std::int64_t count = 0;                             // NaNs are not counted
+    double min, max, sum = 0;
+    double m2 = 0;                                      // sum of squared differences from the mean
+    // bins cover [histogram_min, histogram_max), values outside fall into the edge bins
+    double histogram_min = 0, histogram_max = 0;
+    std::vector<std::int64_t> histogram;
+
+    ImageStatistics();
+    double Mean() const;
+    double StandardDeviation() const;
+    // percentile (0 - 100) estimated from the histogram
+    double Percentile(double percent) const;
+    void Merge(const ImageStatistics& other);
+};
+
+// Adds num_elements values to stats, dtype_code follows GetDataTypeCode. The histogram
+// is only updated if stats.histogram is not empty.
+void AccumulateStatistics(const void* data, std::uint16_t dtype_code, std::size_t num_elements, ImageStatistics& stats);
+
+// Default histogram bins and range of a dtype, the range is empty if it has to come from the data.
+int GetDefaultHistogramBins(std::uint16_t dtype_code);
+std::optional<std::pair<double, double>> GetDefaultHistogramRange(std::uint16_t dtype_code);
+} // ns bfiocpp
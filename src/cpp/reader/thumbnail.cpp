@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+#include "tensorstore/index_space/dim_expression.h"
+#include "thumbnail.h"
+#include "tsreader.h"
+
+namespace bfiocpp {
+
+namespace {
+// index of the center pixel of every one of count equal blocks along an axis of length size
+tensorstore::SharedArray<const tensorstore::Index, 1> GetBlockCenters(std::int64_t size, std::int64_t count){
+    auto centers = tensorstore::AllocateArray<tensorstore::Index>({count});
+    for (std::int64_t i = 0; i < count; ++i) {
+        centers(i) = std::min(static_cast<std::int64_t>((i + 0.5) * size / count), size - 1);
+    }
+    return centers;
+}
+
+tensorstore::SharedArray<const void> ReadThumbnail(TsReaderCPP& reader, const ThumbnailOptions& options){
+    if (options.max_size <= 0) {
+        throw std::invalid_argument("Error reading thumbnail: max_size must be positive");
+    }
+    if (options.layer < 0 || options.layer >= reader.GetImageDepth() || options.tstep < 0 || options.tstep >= reader.GetTstepCount()) {
+        throw std::out_of_range("Error reading thumbnail: layer or tstep is out of range");
+    }
+
+    // size of the thumbnail from the full resolution image
+    reader.SetLevel(0);
+    const std::int64_t full_height = reader.GetImageHeight(), full_width = reader.GetImageWidth();
+    std::int64_t height = full_height, width = full_width;
+    if (std::max(full_height, full_width) > options.max_size) {
+        const double scale = static_cast<double>(options.max_size) / std::max(full_height, full_width);
+        height = std::max<std::int64_t>(std::llround(full_height * scale), 1);
+        width = std::max<std::int64_t>(std::llround(full_width * scale), 1);
+    }
+
+    // a pyramid level already holds most of the decimation
+    reader.SetLevel(reader.GetLevelForSize(height, width));
+    const auto view = reader.GetTensorStore();
+    const auto shape = view.domain().shape();
+    height = std::min(height, shape[3]);
+    width = std::min(width, shape[4]);
+
+    auto thumbnail_transform = (tensorstore::IdentityTransform(view.domain()) |
+                                tensorstore::Dims(0, 2).IndexSlice({options.tstep, options.layer}) |
+                                tensorstore::Dims(1, 2).OuterIndexArraySlice(GetBlockCenters(shape[3], height),
+                                                                             GetBlockCenters(shape[4], width))).value();
+    auto data = tensorstore::AllocateArray({shape[1], height, width}, tensorstore::c_order, tensorstore::default_init, view.dtype());
+    auto read_status = tensorstore::Read(view | thumbnail_transform, data).status();
+    if (!read_status.ok()) {
+        throw std::runtime_error("Error reading thumbnail: " + read_status.ToString());
+    }
+    return data;
+}
+} // namespace
+
+tensorstore::SharedArray<const void> GetThumbnail(TsReaderCPP& reader, const ThumbnailOptions& options){
+    const auto level = reader.GetLevel();
+    try {
+        auto thumbnail = ReadThumbnail(reader, options);
+        reader.SetLevel(level);
+        return thumbnail;
+    } catch (...) {
+        reader.SetLevel(level);
+        throw;
+    }
+}
+
+std::vector<ThumbnailResult> GetThumbnails(const std::vector<std::string>& files, FileType file_type,
+                                           const std::string& axes_list, const ThumbnailOptions& options,
+                                           unsigned int num_threads){
+    std::vector<ThumbnailResult> thumbnails(files.size());
+    const auto num_files = static_cast<std::int64_t>(files.size());
+    const unsigned int threads_to_start = static_cast<unsigned int>(std::min<std::int64_t>(
+        std::max(1u, num_threads > 0 ? num_threads : std::thread::hardware_concurrency()), std::max<std::int64_t>(num_files, 1)));
+
+    // the readers share the cache pool and I/O limits of one context
+    const auto context = GetReadContext();
+    std::atomic<std::int64_t> next_file{0};
+
+    // every thread opens and reads one file at a time, the reads of a file run on the tensorstore pool
+    auto worker = [&]() {
+        for (std::int64_t index = next_file++; index < num_files; index = next_file++) {
+            try {
+                TsReaderCPP reader(files[index], file_type, axes_list, {}, context);
+                thumbnails[index].thumbnail = GetThumbnail(reader, options);
+            } catch (const std::exception& e) {
+                thumbnails[index].error = "Error reading thumbnail of " + files[index] + ": " + e.what();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threads_to_start);
+    for (unsigned int i = 0; i < threads_to_start; ++i) threads.emplace_back(worker);
+    for (auto& thread : threads) thread.join();
+    return thumbnails;
+}
+
+} // ns bfiocpp
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "tensorstore/array.h"
+#include "../utilities/utilities.h"
+
+namespace bfiocpp{
+
+class TsReaderCPP;
+
+struct ThumbnailOptions {
+    std::int64_t max_size = 1024;       // longest side of the thumbnail
+    std::int64_t layer = 0, tstep = 0;  // plane of the thumbnail, all channels are read
+};
+
+struct ThumbnailResult {
+    tensorstore::SharedArray<const void> thumbnail;  // null if the file failed
+    std::string error;
+};
+
+// (channels, height, width) thumbnail of a plane of reader in its dtype, with the aspect ratio
+// of the image and its longest side max_size (smaller images are returned at full size). It is
+// read from the coarsest pyramid level at least that large, and sampled there with one pixel
+// (the center) per block, so only the chunks (tiles or strips) holding a sampled pixel are read
+// and decoded, and only the sampled pixels are copied out. Chunks are skipped only where they
+// are smaller than a block, so for an image without a pyramid level close to the thumbnail
+// size whose chunks are larger than a block, every chunk of the plane is still decoded. The
+// current level of reader is restored afterwards.
+tensorstore::SharedArray<const void> GetThumbnail(TsReaderCPP& reader, const ThumbnailOptions& options = ThumbnailOptions());
+
+// GetThumbnail of every file, opened with file_type and axes_list. num_threads files (0 for one
+// per core) are opened and read at the same time. A file that fails has its error set instead
+// of a thumbnail.
+std::vector<ThumbnailResult> GetThumbnails(const std::vector<std::string>& files, FileType file_type,
+                                           const std::string& axes_list,
+                                           const ThumbnailOptions& options = ThumbnailOptions(),
+                                           unsigned int num_threads = 0);
+} // ns bfiocpp
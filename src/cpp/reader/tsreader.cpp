@@ -1,10 +1,24 @@
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cctype>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <tuple>
 #include "tensorstore/context.h"
 #include "tensorstore/array.h"
 #include "tensorstore/driver/zarr/dtype.h"
 #include "tensorstore/index_space/dim_expression.h"
 #include "tensorstore/kvstore/kvstore.h"
 #include "tensorstore/open.h"
+#include "tensorstore/util/executor.h"
+#include "tensorstore/util/future.h"
 
 #include "tsreader.h"
 #include "../utilities/utilities.h"
@@ -15,21 +29,121 @@ using ::tensorstore::internal_zarr::ChooseBaseDType;
 
 namespace bfiocpp{
 
-TsReaderCPP::TsReaderCPP(const std::string& fname, FileType ft, const std::string& axes_list=""): _filename(fname), _file_type (ft) {
+namespace {
+// TCZYX indices of the axes in axis_order, TCZYX if it is empty. Axes left out of it must
+// have length 1 in sizes (TCZYX).
+std::vector<int> GetOutputAxes(const std::string& axis_order, const std::array<std::int64_t, 5>& sizes) {
+    constexpr std::string_view kAxes = "TCZYX";
+    if (axis_order.empty()) return {0, 1, 2, 3, 4};
 
-    auto read_spec = [fname, ft](){
-        if (ft == FileType::OmeTiff){
-            return GetOmeTiffSpecToRead(fname);
-        } else {
-            return GetZarrSpecToRead(fname, ft);
+    std::vector<int> output_axes;
+    for (char axis : axis_order) {
+        const auto index = kAxes.find(static_cast<char>(std::toupper(static_cast<unsigned char>(axis))));
+        if (index == std::string_view::npos || std::find(output_axes.begin(), output_axes.end(), static_cast<int>(index)) != output_axes.end()) {
+            throw std::invalid_argument("Invalid axis order \"" + axis_order + "\", must be unique axes of TCZYX");
+        }
+        output_axes.push_back(static_cast<int>(index));
+    }
+    for (int axis = 0; axis < 5; ++axis) {
+        if (sizes[axis] != 1 && std::find(output_axes.begin(), output_axes.end(), axis) == output_axes.end()) {
+            throw std::invalid_argument(std::string("Axis ") + kAxes[axis] + " has length " + std::to_string(sizes[axis])
+                                        + " and can not be left out of the axis order");
         }
-    }();
+    }
+    return output_axes;
+}
+
+// element strides of the TCZYX axes in a c_order output with output_axes, 0 for squeezed axes
+std::array<std::int64_t, 5> GetOutputStrides(const std::vector<int>& output_axes, const std::array<std::int64_t, 5>& sizes) {
+    std::array<std::int64_t, 5> strides = {0, 0, 0, 0, 0};
+    std::int64_t stride = 1;
+    for (auto axis = output_axes.rbegin(); axis != output_axes.rend(); ++axis) {
+        strides[*axis] = stride;
+        stride *= sizes[*axis];
+    }
+    return strides;
+}
+
+bool IsDefaultOrder(const std::vector<int>& output_axes) {
+    return output_axes == std::vector<int>{0, 1, 2, 3, 4};
+}
+
+// first plane of every channel of a flat-field or dark-frame reference as float
+std::vector<std::vector<float>> ReadReferencePlanes(TsReaderCPP& reference, const std::string& name,
+                                                    std::int64_t height, std::int64_t width, std::int64_t num_channels) {
+    if (reference.GetImageHeight() != height || reference.GetImageWidth() != width) {
+        throw std::invalid_argument(name + " reference is " + std::to_string(reference.GetImageHeight()) + "x" + std::to_string(reference.GetImageWidth()) +
+                                    ", the image is " + std::to_string(height) + "x" + std::to_string(width));
+    }
+    const auto reference_channels = reference.GetChannelCount();
+    if (reference_channels != 1 && reference_channels != num_channels) {
+        throw std::invalid_argument(name + " reference must have 1 channel or one per image channel (" + std::to_string(num_channels) + ")");
+    }
+    ReadConversion to_float;
+    to_float.dtype = "float32";
+    auto data = reference.GetImageData(Seq(0, height - 1, 1), Seq(0, width - 1, 1), Seq(0, 0, 1), Seq(0, reference_channels - 1, 1), Seq(0, 0, 1), to_float);
+    const auto& values = std::get<std::vector<float>>(*data);
+
+    std::vector<std::vector<float>> planes;
+    const auto plane_size = height * width;
+    for (std::int64_t c = 0; c < reference_channels; ++c) {
+        planes.emplace_back(values.begin() + c * plane_size, values.begin() + (c + 1) * plane_size);
+    }
+    return planes;
+}
+} // namespace
+
+TsReaderCPP::TsReaderCPP(const std::string& fname, FileType ft, const std::string& axes_list, const std::vector<std::int64_t>& tiles_per_chunk,
+                         const std::optional<tensorstore::Context>& context): _filename(fname), _file_type (ft), _axes_list(axes_list), _tiles_per_chunk(tiles_per_chunk), _level(0),
+                         _context(context.has_value() ? context.value() : (ft == FileType::OmeTiff ? GetReadContext() : tensorstore::Context::Default())) {
+
+    if (!_tiles_per_chunk.empty() && (_tiles_per_chunk.size() != 2 || _tiles_per_chunk[0] < 1 || _tiles_per_chunk[1] < 1)) {
+        throw std::invalid_argument("tiles_per_chunk must be two positive integers [Y, X]");
+    }
+
+    // a multiscales group or SubIFD pyramid is opened at its first level
+    _levels = FindLevels(_filename, _file_type);
+    Open(0);
+    _full_image_height = _image_height;
+    _full_image_width = _image_width;
+}
+
+TsReaderCPP::TsReaderCPP(const std::string& fname, FileType ft, const std::string& axes_list, const tensorstore::Context& context,
+                         std::vector<MultiscaleLevel> levels, Store level_source): _filename(fname), _file_type (ft), _axes_list(axes_list),
+                         _levels(std::move(levels)), _level(0), _context(context) {
+    SetSource(std::move(level_source));
+    _full_image_height = _image_height;
+    _full_image_width = _image_width;
+}
+
+std::vector<MultiscaleLevel> TsReaderCPP::FindLevels(const std::string& fname, FileType ft) {
+    return (ft == FileType::OmeTiff) ? GetOmeTiffLevels(fname) : GetZarrMultiscaleLevels(fname, ft);
+}
+
+tensorstore::Spec TsReaderCPP::GetReadSpec(const std::string& fname, FileType ft, const std::vector<MultiscaleLevel>& levels,
+                                           std::size_t level, const std::vector<std::int64_t>& tiles_per_chunk) {
+    if (ft == FileType::OmeTiff){
+        return GetOmeTiffSpecToRead(fname, static_cast<int>(level), tiles_per_chunk);
+    }
+    return GetZarrSpecToRead(levels.empty() ? fname : fname + "/" + levels[level].path, ft);
+}
+
+void TsReaderCPP::Open(std::size_t level) {
 
-    TENSORSTORE_CHECK_OK_AND_ASSIGN(source, tensorstore::Open(
-                read_spec,
+    auto level_source = tensorstore::Open(
+                GetReadSpec(_filename, _file_type, _levels, level, _tiles_per_chunk),
+                _context,
                 tensorstore::OpenMode::open,
-                tensorstore::ReadWriteMode::read).result());
-    
+                tensorstore::ReadWriteMode::read).result();
+    if (!level_source.ok()) {
+        throw std::runtime_error("Error opening " + _filename + ": " + level_source.status().ToString());
+    }
+    SetSource(*std::move(level_source));
+}
+
+void TsReaderCPP::SetSource(Store level_source) {
+
+    source = std::move(level_source);
     auto image_shape = source.domain().shape();
     const auto read_chunk_shape = source.chunk_layout().value().read_chunk_shape();
     if (_file_type == FileType::OmeTiff){
@@ -60,7 +174,7 @@ TsReaderCPP::TsReaderCPP(const std::string& fname, FileType ft, const std::strin
             _z_index.emplace(2);
         } else {
             assert(image_shape.size() >= 2);
-            std::tie(_t_index, _c_index, _z_index) = ParseMultiscaleMetadata(axes_list, image_shape.size());
+            std::tie(_t_index, _c_index, _z_index) = ParseMultiscaleMetadata(_axes_list, image_shape.size());
             _image_height = image_shape[image_shape.size()-2];
             _image_width = image_shape[image_shape.size()-1];
             if (_t_index.has_value()) {
@@ -97,9 +211,52 @@ std::int64_t TsReaderCPP::GetTileWidth() const {return _tile_width;}
 std::int64_t TsReaderCPP::GetChannelCount() const {return _num_channels;} 
 std::int64_t TsReaderCPP::GetTstepCount() const {return _num_tsteps;} 
 std::string TsReaderCPP::GetDataType() const {return _data_type;} 
+std::size_t TsReaderCPP::GetLevelCount() const {return _levels.empty() ? 1 : _levels.size();}
+std::size_t TsReaderCPP::GetLevel() const {return _level;}
 
-template <typename T>
-std::shared_ptr<std::vector<T>> TsReaderCPP::GetImageDataTemplated(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps){
+std::vector<double> TsReaderCPP::GetLevelScale(std::size_t level) const {
+    if (level >= GetLevelCount()) {
+        throw std::out_of_range("Level " + std::to_string(level) + " is out of range, the image has " + std::to_string(GetLevelCount()) + " level(s)");
+    }
+    const auto rank = static_cast<std::size_t>(source.rank());
+    std::vector<double> scale(rank, 1.0);
+    if (level == 0) return scale;
+
+    const auto& base_scale = _levels[0].scale;
+    const auto& level_scale = _levels[level].scale;
+    if (base_scale.size() == rank && level_scale.size() == rank) {
+        for (std::size_t d = 0; d < rank; ++d) {
+            if (base_scale[d] > 0) scale[d] = level_scale[d] / base_scale[d];
+        }
+    } else {
+        // no usable scale transforms, assume the usual factor 2 pyramid in Y and X
+        scale[rank-2] = scale[rank-1] = static_cast<double>(std::int64_t{1} << level);
+    }
+    return scale;
+}
+
+void TsReaderCPP::SetLevel(std::size_t level) {
+    if (level >= GetLevelCount()) {
+        throw std::out_of_range("Level " + std::to_string(level) + " is out of range, the image has " + std::to_string(GetLevelCount()) + " level(s)");
+    }
+    if (level == _level) return;
+    Open(level);
+    _level = level;
+}
+
+std::size_t TsReaderCPP::GetLevelForSize(std::int64_t min_height, std::int64_t min_width) const {
+    // level sizes follow from the scale factors, so no other level has to be opened
+    for (auto level = GetLevelCount(); level-- > 1;) {
+        const auto scale = GetLevelScale(level);
+        const auto rank = scale.size();
+        const auto level_height = static_cast<std::int64_t>(std::ceil(_full_image_height / scale[rank-2]));
+        const auto level_width = static_cast<std::int64_t>(std::ceil(_full_image_width / scale[rank-1]));
+        if (level_height >= min_height && level_width >= min_width) return level;
+    }
+    return 0;
+}
+
+std::pair<tensorstore::IndexTransform<>, std::vector<std::int64_t>> TsReaderCPP::GetReadRegion(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps) const {
 
     const auto data_height = rows.Stop() - rows.Start() + 1;
     const auto data_width = cols.Stop() - cols.Start() + 1;
@@ -107,8 +264,9 @@ std::shared_ptr<std::vector<T>> TsReaderCPP::GetImageDataTemplated(const Seq& ro
     const auto data_num_channels = channels.Stop() - channels.Start() + 1;
     const auto data_tsteps = tsteps.Stop() - tsteps.Start() + 1;
 
-    auto read_buffer = std::make_shared<std::vector<T>>(data_height*data_width*data_depth*data_num_channels*data_tsteps); 
     tensorstore::IndexTransform<> read_transform = tensorstore::IdentityTransform(source.domain());
+    std::vector<std::int64_t> array_shape;
+    array_shape.reserve(5); 
 
     if (_file_type == FileType::OmeTiff) {
         read_transform = (std::move(read_transform) | tensorstore::Dims(0).ClosedInterval(tsteps.Start(), tsteps.Stop()) |
@@ -116,12 +274,8 @@ std::shared_ptr<std::vector<T>> TsReaderCPP::GetImageDataTemplated(const Seq& ro
                                                         tensorstore::Dims(2).ClosedInterval(layers.Start(), layers.Stop()) |
                                                         tensorstore::Dims(3).ClosedInterval(rows.Start(), rows.Stop()) |
                                                         tensorstore::Dims(4).ClosedInterval(cols.Start(), cols.Stop())).value(); 
-
-        auto array = tensorstore::Array(read_buffer->data(), {data_tsteps, data_num_channels, data_depth, data_height, data_width}, tensorstore::c_order);
-        tensorstore::Read(source | read_transform, tensorstore::UnownedToShared(array)).value();
+        array_shape = {data_tsteps, data_num_channels, data_depth, data_height, data_width};
     } else {
-        std::vector<std::int64_t> array_shape;
-        array_shape.reserve(5); 
         auto source_shape = source.domain().shape();
         int x_index = static_cast<int>(source_shape.size()) - 1; 
         int y_index = static_cast<int>(source_shape.size()) - 2;
@@ -143,47 +297,279 @@ std::shared_ptr<std::vector<T>> TsReaderCPP::GetImageDataTemplated(const Seq& ro
         
         array_shape.push_back(data_height);
         array_shape.push_back(data_width);
-        
-        auto array = tensorstore::Array(read_buffer->data(), array_shape, tensorstore::c_order);
-        tensorstore::Read(source | read_transform, tensorstore::UnownedToShared(array)).value();
     }
+    return {std::move(read_transform), std::move(array_shape)};
+}
+
+tensorstore::IndexTransform<> TsReaderCPP::GetOrderedReadRegion(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+                                                              const std::vector<int>& output_axes) const {
+
+    auto read_transform = GetReadRegion(rows, cols, layers, channels, tsteps).first;
+
+    // source dimension of each TCZYX axis, axes absent from a zarr array have none
+    const auto rank = static_cast<int>(source.rank());
+    std::array<std::optional<int>, 5> source_dims;
+    if (_file_type == FileType::OmeTiff) {
+        source_dims = {0, 1, 2, 3, 4};
+    } else {
+        source_dims = {_t_index, _c_index, _z_index, rank - 2, rank - 1};
+    }
+    const std::array<std::int64_t, 5> starts = {tsteps.Start(), channels.Start(), layers.Start(), rows.Start(), cols.Start()};
+
+    // squeezed axes are sliced away, highest dimension first so the others keep their index
+    std::vector<std::pair<int, std::int64_t>> squeezed;
+    for (int axis = 0; axis < 5; ++axis) {
+        if (source_dims[axis].has_value() && std::find(output_axes.begin(), output_axes.end(), axis) == output_axes.end()) {
+            squeezed.emplace_back(source_dims[axis].value(), starts[axis]);
+        }
+    }
+    std::sort(squeezed.rbegin(), squeezed.rend());
+    std::vector<int> kept_dims(rank);
+    std::iota(kept_dims.begin(), kept_dims.end(), 0);
+    for (const auto& [dim, start] : squeezed) {
+        read_transform = (std::move(read_transform) | tensorstore::Dims(dim).IndexSlice(start)).value();
+        kept_dims.erase(std::find(kept_dims.begin(), kept_dims.end(), dim));
+    }
+
+    // the copy out of the chunk cache then writes the data in output order
+    std::vector<tensorstore::DimensionIndex> permutation;
+    for (auto axis : output_axes) {
+        if (source_dims[axis].has_value()) {
+            permutation.push_back(std::find(kept_dims.begin(), kept_dims.end(), source_dims[axis].value()) - kept_dims.begin());
+        }
+    }
+    read_transform = (std::move(read_transform) | tensorstore::Dims(tensorstore::span<const tensorstore::DimensionIndex>(permutation)).Transpose()).value();
+
+    for (std::size_t position = 0; position < output_axes.size(); ++position) {
+        if (!source_dims[output_axes[position]].has_value()) {
+            read_transform = (std::move(read_transform) | tensorstore::Dims(static_cast<tensorstore::DimensionIndex>(position)).AddNew().SizedInterval(0, 1)).value();
+        }
+    }
+    return read_transform;
+}
+
+template <typename T>
+std::shared_ptr<std::vector<T>> TsReaderCPP::GetImageDataTemplated(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+                                                                   const std::vector<int>& output_axes){
+
+    const auto data_height = rows.Stop() - rows.Start() + 1;
+    const auto data_width = cols.Stop() - cols.Start() + 1;
+    const auto data_depth = layers.Stop() - layers.Start() + 1;
+    const auto data_num_channels = channels.Stop() - channels.Start() + 1;
+    const auto data_tsteps = tsteps.Stop() - tsteps.Start() + 1;
+
+    auto read_buffer = std::make_shared<std::vector<T>>(data_height*data_width*data_depth*data_num_channels*data_tsteps); 
+    auto [read_transform, array_shape] = GetReadRegion(rows, cols, layers, channels, tsteps);
+    if (!IsDefaultOrder(output_axes)) {
+        const std::array<std::int64_t, 5> sizes = {data_tsteps, data_num_channels, data_depth, data_height, data_width};
+        read_transform = GetOrderedReadRegion(rows, cols, layers, channels, tsteps, output_axes);
+        array_shape.clear();
+        for (auto axis : output_axes) array_shape.push_back(sizes[axis]);
+    }
+
+    auto array = tensorstore::Array(read_buffer->data(), array_shape, tensorstore::c_order);
+    tensorstore::Read(source | read_transform, tensorstore::UnownedToShared(array)).value();
 
     return read_buffer;
 }
 
+template <typename T>
+std::shared_ptr<std::vector<T>> TsReaderCPP::GetImageDataConverted(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+                                                                   const ReadConversion& conversion, const std::vector<int>& output_axes){
+
+    const auto data_height = rows.Stop() - rows.Start() + 1;
+    const auto data_width = cols.Stop() - cols.Start() + 1;
+    const auto data_num_channels = channels.Stop() - channels.Start() + 1;
+    const auto strides = GetOutputStrides(output_axes, {tsteps.Stop() - tsteps.Start() + 1, data_num_channels,
+                                                        layers.Stop() - layers.Start() + 1, data_height, data_width});
+    // blocks of whole rows are contiguous in the output unless X and Y are reordered
+    const bool contiguous_rows = strides[4] == 1 && strides[3] == data_width;
+
+    for (const auto* values : {&conversion.scale, &conversion.offset}) {
+        if (values->size() > 1 && static_cast<std::int64_t>(values->size()) != data_num_channels) {
+            throw std::invalid_argument("scale and offset must have 1 value or 1 value per channel read ("
+                                        + std::to_string(data_num_channels) + ")");
+        }
+    }
+    auto get_channel_value = [](const std::vector<double>& values, std::int64_t channel, double default_value) {
+        if (values.empty()) return default_value;
+        return values[values.size() == 1 ? 0 : channel];
+    };
+    const auto clip_min = conversion.clip_min.value_or(-std::numeric_limits<double>::infinity());
+    const auto clip_max = conversion.clip_max.value_or(std::numeric_limits<double>::infinity());
+    const auto dst_dtype_code = GetOutputDataTypeCode(conversion.dtype.empty() ? _data_type : conversion.dtype);
+    const auto src_dtype_code = _data_type_code;
+    const auto shading = _shading;
+
+    auto read_buffer = std::make_shared<std::vector<T>>(data_height*data_width*(layers.Stop() - layers.Start() + 1)*data_num_channels*(tsteps.Stop() - tsteps.Start() + 1));
+
+    // blocks follow the chunk grid, so each chunk is read and decoded once even without a
+    // chunk cache. They group whole chunks up to about 1 MiB, small enough to still be in
+    // cache when they are converted on the thread that copied them out of the chunks.
+    constexpr std::int64_t kBlockBytes = std::int64_t{1} << 20;
+    const auto read_chunk_shape = source.chunk_layout().value().read_chunk_shape();
+    const auto rank = source.rank();
+    const auto chunk_height = read_chunk_shape[rank - 2] > 0 ? static_cast<std::int64_t>(read_chunk_shape[rank - 2]) : _image_height;
+    const auto chunk_width = read_chunk_shape[rank - 1] > 0 ? static_cast<std::int64_t>(read_chunk_shape[rank - 1]) : _image_width;
+    const auto element_size = static_cast<std::int64_t>(source.dtype().size());
+    std::int64_t block_height = chunk_height, block_width = chunk_width;
+    if (data_width * chunk_height * element_size <= kBlockBytes) {
+        // whole rows, so blocks are contiguous in the output
+        block_width = _image_width;
+        block_height = std::max<std::int64_t>(1, kBlockBytes / (data_width * chunk_height * element_size)) * chunk_height;
+    } else {
+        block_width = std::max<std::int64_t>(1, kBlockBytes / (chunk_height * chunk_width * element_size)) * chunk_width;
+    }
+    auto split = [](std::int64_t start, std::int64_t stop, std::int64_t block_size) {
+        std::vector<std::pair<std::int64_t, std::int64_t>> blocks;
+        for (auto block_start = start; block_start <= stop; ) {
+            const auto block_stop = std::min(stop, (block_start / block_size + 1) * block_size - 1);
+            blocks.emplace_back(block_start, block_stop);
+            block_start = block_stop + 1;
+        }
+        return blocks;
+    };
+    const auto row_blocks = split(rows.Start(), rows.Stop(), block_height);
+    const auto col_blocks = split(cols.Start(), cols.Stop(), block_width);
+
+    const std::size_t max_pending_blocks = 2 * std::max(1u, std::thread::hardware_concurrency());
+    std::deque<tensorstore::Future<void>> pending_blocks;
+    std::vector<std::string> errors;
+    auto wait_for_blocks = [&](std::size_t max_remaining) {
+        while (pending_blocks.size() > max_remaining) {
+            auto status = pending_blocks.front().status();
+            pending_blocks.pop_front();
+            if (!status.ok()) errors.emplace_back(status.ToString());
+        }
+    };
+
+    for (auto t = tsteps.Start(); t <= tsteps.Stop(); ++t) {
+        for (auto c = channels.Start(); c <= channels.Stop(); ++c) {
+            const auto scale = get_channel_value(conversion.scale, c - channels.Start(), 1.0);
+            const auto offset = get_channel_value(conversion.offset, c - channels.Start(), 0.0);
+            for (auto z = layers.Start(); z <= layers.Stop(); ++z) {
+                for (const auto& [row_start, row_stop] : row_blocks) {
+                    for (const auto& [col_start, col_stop] : col_blocks) {
+                        const auto block_rows = row_stop - row_start + 1;
+                        const auto block_cols = col_stop - col_start + 1;
+                        auto [block_transform, block_shape] = GetReadRegion(Seq(row_start, row_stop, 1), Seq(col_start, col_stop, 1),
+                                                                            Seq(z, z, 1), Seq(c, c, 1), Seq(t, t, 1));
+                        auto block = tensorstore::AllocateArray(block_shape, tensorstore::c_order, tensorstore::default_init, source.dtype());
+                        const auto num_elements = static_cast<std::size_t>(block_rows * block_cols);
+                        T* output = read_buffer->data() + (t - tsteps.Start()) * strides[0] + (c - channels.Start()) * strides[1]
+                                                        + (z - layers.Start()) * strides[2] + (row_start - rows.Start()) * strides[3]
+                                                        + (col_start - cols.Start()) * strides[4];
+                        const bool contiguous = contiguous_rows && block_cols == data_width;
+                        // references of the first row of the block, rows are shading->width apart
+                        const auto reference_offset = shading ? row_start * shading->width + col_start : 0;
+                        const float* dark = shading ? shading->Dark(c) + reference_offset : nullptr;
+                        const float* inverse_flat = shading ? shading->InverseFlat(c) + reference_offset : nullptr;
+
+                        pending_blocks.push_back(tensorstore::MapFuture(
+                            tensorstore::InlineExecutor{},
+                            [block, read_buffer, output, num_elements, block_rows, block_cols, strides, contiguous,
+                             src_dtype_code, dst_dtype_code, scale, offset, clip_min, clip_max, shading, dark, inverse_flat]
+                            (const tensorstore::Result<void>& read_result) -> tensorstore::Result<void> {
+                                if (!read_result.ok()) return read_result.status();
+                                auto convert = [&](T* dst) {
+                                    if (!shading) {
+                                        ConvertBlock(block.data(), src_dtype_code, dst, dst_dtype_code, num_elements, scale, offset, clip_min, clip_max);
+                                        return;
+                                    }
+                                    // the block is a window of the reference planes, so it is corrected row by row
+                                    const auto row_bytes = block_cols * block.dtype().size();
+                                    for (std::int64_t block_row = 0; block_row < block_rows; ++block_row) {
+                                        ConvertBlock(static_cast<const char*>(block.data()) + block_row * row_bytes, src_dtype_code,
+                                                     dst + block_row * block_cols, dst_dtype_code, block_cols, scale, offset, clip_min, clip_max,
+                                                     dark + block_row * shading->width, inverse_flat + block_row * shading->width);
+                                    }
+                                };
+                                if (contiguous) {
+                                    convert(output);
+                                } else {
+                                    // converted while still in cache, then scattered into the output order
+                                    std::vector<T> converted(num_elements);
+                                    convert(converted.data());
+                                    for (std::int64_t block_row = 0; block_row < block_rows; ++block_row) {
+                                        const T* src = converted.data() + block_row * block_cols;
+                                        T* dst = output + block_row * strides[3];
+                                        for (std::int64_t col = 0; col < block_cols; ++col) dst[col * strides[4]] = src[col];
+                                    }
+                                }
+                                return tensorstore::MakeResult();
+                            },
+                            tensorstore::Read(source | block_transform, block)));
+                        // bounds the memory of blocks that are read but not converted yet
+                        wait_for_blocks(max_pending_blocks);
+                    }
+                }
+            }
+        }
+    }
+    wait_for_blocks(0);
+
+    if (!errors.empty()) {
+        throw std::runtime_error("Error reading image: " + errors.front());
+    }
+    return read_buffer;
+}
+
+
+std::shared_ptr<image_data> TsReaderCPP::GetImageData(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+                                                       const ReadConversion& conversion, const std::string& axis_order) {
+    const auto output_axes = GetOutputAxes(axis_order, {tsteps.Stop() - tsteps.Start() + 1, channels.Stop() - channels.Start() + 1,
+                                                        layers.Stop() - layers.Start() + 1, rows.Stop() - rows.Start() + 1,
+                                                        cols.Stop() - cols.Start() + 1});
+    if (_shading && (_shading->height != _image_height || _shading->width != _image_width)) {
+        throw std::invalid_argument("The flat-field and dark-frame references do not match the size of the current level");
+    }
+    if (!conversion.IsIdentity(_data_type_code) || _shading) {
+        switch (GetOutputDataTypeCode(conversion.dtype.empty() ? _data_type : conversion.dtype))
+        {
+        case (1): return std::make_shared<image_data>(std::move(*(GetImageDataConverted<std::uint8_t>(rows, cols, layers, channels, tsteps, conversion, output_axes))));
+        case (2): return std::make_shared<image_data>(std::move(*(GetImageDataConverted<std::uint16_t>(rows, cols, layers, channels, tsteps, conversion, output_axes))));
+        case (4): return std::make_shared<image_data>(std::move(*(GetImageDataConverted<std::uint32_t>(rows, cols, layers, channels, tsteps, conversion, output_axes))));
+        case (8): return std::make_shared<image_data>(std::move(*(GetImageDataConverted<std::uint64_t>(rows, cols, layers, channels, tsteps, conversion, output_axes))));
+        case (16): return std::make_shared<image_data>(std::move(*(GetImageDataConverted<std::int8_t>(rows, cols, layers, channels, tsteps, conversion, output_axes))));
+        case (32): return std::make_shared<image_data>(std::move(*(GetImageDataConverted<std::int16_t>(rows, cols, layers, channels, tsteps, conversion, output_axes))));
+        case (64): return std::make_shared<image_data>(std::move(*(GetImageDataConverted<std::int32_t>(rows, cols, layers, channels, tsteps, conversion, output_axes))));
+        case (128): return std::make_shared<image_data>(std::move(*(GetImageDataConverted<std::int64_t>(rows, cols, layers, channels, tsteps, conversion, output_axes))));
+        case (256): return std::make_shared<image_data>(std::move(*(GetImageDataConverted<float>(rows, cols, layers, channels, tsteps, conversion, output_axes))));
+        default: return std::make_shared<image_data>(std::move(*(GetImageDataConverted<double>(rows, cols, layers, channels, tsteps, conversion, output_axes))));
+        }
+    }
 
-std::shared_ptr<image_data> TsReaderCPP::GetImageData(const Seq& rows, const Seq& cols, const Seq& layers = Seq(0,0), const Seq& channels = Seq(0,0), const Seq& tsteps = Seq(0,0)) {
     switch (_data_type_code)
     {
     case (1):
-        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::uint8_t>(rows, cols, layers, channels, tsteps))));
+        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::uint8_t>(rows, cols, layers, channels, tsteps, output_axes))));
         break;
     case (2):
-        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::uint16_t>(rows, cols, layers, channels, tsteps))));
+        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::uint16_t>(rows, cols, layers, channels, tsteps, output_axes))));
         break;    
     case (4):
-        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::uint32_t>(rows, cols, layers, channels, tsteps))));
+        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::uint32_t>(rows, cols, layers, channels, tsteps, output_axes))));
         break;
     case (8):
-        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::uint64_t>(rows, cols, layers, channels, tsteps))));
+        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::uint64_t>(rows, cols, layers, channels, tsteps, output_axes))));
         break;
     case (16):
-        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::int8_t>(rows, cols, layers, channels, tsteps))));
+        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::int8_t>(rows, cols, layers, channels, tsteps, output_axes))));
         break;
     case (32):
-        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::int16_t>(rows, cols, layers, channels, tsteps))));
+        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::int16_t>(rows, cols, layers, channels, tsteps, output_axes))));
         break;    
     case (64):
-        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::int32_t>(rows, cols, layers, channels, tsteps))));
+        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::int32_t>(rows, cols, layers, channels, tsteps, output_axes))));
         break;
     case (128):
-        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::int64_t>(rows, cols, layers, channels, tsteps))));
+        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<std::int64_t>(rows, cols, layers, channels, tsteps, output_axes))));
         break;
     case (256):
-        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<float>(rows, cols, layers, channels, tsteps))));
+        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<float>(rows, cols, layers, channels, tsteps, output_axes))));
         break;
     case (512):
-        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<double>(rows, cols, layers, channels, tsteps))));
+        return std::make_shared<image_data>(std::move(*(GetImageDataTemplated<double>(rows, cols, layers, channels, tsteps, output_axes))));
         break;
     default:
         break;
@@ -191,8 +577,344 @@ std::shared_ptr<image_data> TsReaderCPP::GetImageData(const Seq& rows, const Seq
 } 
 
 
+void TsReaderCPP::SetShadingCorrection(const std::shared_ptr<TsReaderCPP>& flat, const std::shared_ptr<TsReaderCPP>& dark) {
+    if (!flat && !dark) {
+        _shading.reset();
+        return;
+    }
+    auto shading = std::make_shared<ShadingCorrection>();
+    shading->height = _image_height;
+    shading->width = _image_width;
+    const auto plane_size = static_cast<std::size_t>(_image_height * _image_width);
+    // a missing reference is a single plane of zeros or ones, so the kernel has no branches
+    shading->dark = dark ? ReadReferencePlanes(*dark, "dark", _image_height, _image_width, _num_channels)
+                         : std::vector<std::vector<float>>{std::vector<float>(plane_size, 0.0f)};
+    if (flat) {
+        shading->inverse_flat = ReadReferencePlanes(*flat, "flat", _image_height, _image_width, _num_channels);
+        for (auto& plane : shading->inverse_flat) {
+            for (auto& value : plane) value = (value != 0.0f) ? 1.0f / value : 0.0f;
+        }
+    } else {
+        shading->inverse_flat = {std::vector<float>(plane_size, 1.0f)};
+    }
+    _shading = std::move(shading);
+}
+
+std::optional<tensorstore::SharedArray<const void>> TsReaderCPP::GetChunkData(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps) {
+
+    if (_shading || layers.Start() != layers.Stop() || channels.Start() != channels.Stop() || tsteps.Start() != tsteps.Stop()) {
+        return std::nullopt;
+    }
+    const auto read_chunk_shape = source.chunk_layout().value().read_chunk_shape();
+    const auto rank = source.rank();
+    auto is_chunk = [](std::int64_t start, std::int64_t stop, std::int64_t chunk_size, std::int64_t size) {
+        return chunk_size > 0 && start % chunk_size == 0 && stop == std::min(start + chunk_size, size) - 1;
+    };
+    if (!is_chunk(rows.Start(), rows.Stop(), read_chunk_shape[rank - 2], _image_height) ||
+        !is_chunk(cols.Start(), cols.Stop(), read_chunk_shape[rank - 1], _image_width)) {
+        return std::nullopt;
+    }
+
+    auto read_transform = GetReadRegion(rows, cols, layers, channels, tsteps).first;
+    auto data = tensorstore::Read<tensorstore::zero_origin>(source | read_transform).result();
+    if (!data.ok()) {
+        throw std::runtime_error("Error reading image: " + data.status().ToString());
+    }
+    return *std::move(data);
+}
+
+void TsReaderCPP::CheckNoShadingCorrection() const {
+    if (_shading) {
+        throw std::runtime_error("Only data() applies the shading correction, remove it with set_shading_correction() before other reads");
+    }
+}
+
+tensorstore::TensorStore<> TsReaderCPP::GetTensorStore() const {
+    CheckNoShadingCorrection();
+    return (source | GetOrderedReadRegion(Seq(0, _image_height - 1, 1), Seq(0, _image_width - 1, 1), Seq(0, _image_depth - 1, 1),
+                                          Seq(0, _num_channels - 1, 1), Seq(0, _num_tsteps - 1, 1), {0, 1, 2, 3, 4})).value();
+}
+
+void TsReaderCPP::ForEachChunk(const ChunkCallback& process) {
+    CheckNoShadingCorrection();
+
+    const auto domain = source.domain();
+    const auto rank = domain.rank();
+    const auto read_chunk_shape = source.chunk_layout().value().read_chunk_shape();
+
+    std::vector<std::int64_t> chunk_shape(rank), grid_shape(rank), grid_index(rank, 0);
+    std::int64_t num_chunks = 1;
+    for (tensorstore::DimensionIndex d = 0; d < rank; ++d) {
+        chunk_shape[d] = read_chunk_shape[d] > 0 ? read_chunk_shape[d] : domain.shape()[d];
+        grid_shape[d] = chunk_shape[d] > 0 ? (domain.shape()[d] + chunk_shape[d] - 1) / chunk_shape[d] : 0;
+        num_chunks *= grid_shape[d];
+    }
+
+    // a few chunks per thread keep every thread busy while bounding memory
+    const std::size_t max_pending_chunks = 2 * std::max(1u, std::thread::hardware_concurrency());
+    std::deque<tensorstore::Future<void>> pending_chunks;
+    std::vector<std::string> errors;
+    auto wait_for_chunks = [&](std::size_t max_remaining) {
+        while (pending_chunks.size() > max_remaining) {
+            auto status = pending_chunks.front().status();
+            pending_chunks.pop_front();
+            if (!status.ok()) errors.emplace_back(status.ToString());
+        }
+    };
+
+    for (std::int64_t chunk = 0; chunk < num_chunks; ++chunk) {
+        std::vector<std::int64_t> origin(rank), shape(rank);
+        tensorstore::IndexTransform<> chunk_transform = tensorstore::IdentityTransform(domain);
+        for (tensorstore::DimensionIndex d = 0; d < rank; ++d) {
+            origin[d] = domain.origin()[d] + grid_index[d] * chunk_shape[d];
+            shape[d] = std::min(chunk_shape[d], domain.origin()[d] + domain.shape()[d] - origin[d]);
+            chunk_transform = (std::move(chunk_transform) | tensorstore::Dims(d).SizedInterval(origin[d], shape[d])).value();
+        }
+        auto data = tensorstore::AllocateArray(shape, tensorstore::c_order, tensorstore::default_init, source.dtype());
+
+        pending_chunks.push_back(tensorstore::MapFuture(
+            tensorstore::InlineExecutor{},
+            [&process, data, origin = std::move(origin)](const tensorstore::Result<void>& read_result) -> tensorstore::Result<void> {
+                if (!read_result.ok()) return read_result.status();
+                process(data, origin);
+                return tensorstore::MakeResult();
+            },
+            tensorstore::Read(source | chunk_transform, data)));
+        wait_for_chunks(max_pending_chunks);
+
+        for (auto d = rank - 1; d >= 0; --d) {
+            if (++grid_index[d] < grid_shape[d]) break;
+            grid_index[d] = 0;
+        }
+    }
+    wait_for_chunks(0);
+
+    if (!errors.empty()) {
+        throw std::runtime_error("Error reading image: " + errors.front());
+    }
+}
+
+std::vector<ImageStatistics> TsReaderCPP::ComputeStatistics(const StatisticsOptions& options) {
+
+    if (options.num_bins < 0) {
+        throw std::invalid_argument("num_bins must not be negative");
+    }
+    if (options.histogram_min.has_value() != options.histogram_max.has_value() ||
+        (options.histogram_min.has_value() && !(options.histogram_min.value() < options.histogram_max.value()))) {
+        throw std::invalid_argument("histogram range must be given as min < max");
+    }
+
+    const auto num_bins = options.num_bins > 0 ? options.num_bins : GetDefaultHistogramBins(_data_type_code);
+    auto histogram_range = GetDefaultHistogramRange(_data_type_code);
+    if (options.histogram_min.has_value()) {
+        histogram_range.emplace(options.histogram_min.value(), options.histogram_max.value());
+    }
+
+    const auto num_tsteps = options.per_tstep ? _num_tsteps : 1;
+    const auto num_layers = options.per_layer ? _image_depth : 1;
+    std::vector<ImageStatistics> statistics(num_tsteps * _num_channels * num_layers);
+    for (std::int64_t t = 0; t < num_tsteps; ++t) {
+        for (std::int64_t c = 0; c < _num_channels; ++c) {
+            for (std::int64_t z = 0; z < num_layers; ++z) {
+                auto& group = statistics[(t * _num_channels + c) * num_layers + z];
+                group.tstep = options.per_tstep ? t : -1;
+                group.channel = c;
+                group.layer = options.per_layer ? z : -1;
+            }
+        }
+    }
+
+    // chunks are reduced plane by plane into partial statistics that are merged once per chunk
+    std::mutex statistics_mutex;
+    auto accumulate = [&](bool values, bool histogram) {
+        ForEachChunk([&, values, histogram](const tensorstore::SharedArray<const void>& data, const std::vector<std::int64_t>& origin) {
+            const auto rank = data.rank();
+            const auto plane_elements = static_cast<std::size_t>(data.shape()[rank - 2] * data.shape()[rank - 1]);
+            const auto num_planes = plane_elements > 0 ? static_cast<std::size_t>(data.num_elements()) / plane_elements : 0;
+            const auto* plane_data = static_cast<const char*>(data.data());
+            const auto plane_bytes = plane_elements * data.dtype().size();
+
+            std::vector<std::pair<std::size_t, ImageStatistics>> partials;
+            std::vector<std::int64_t> plane_index(rank - 2, 0);
+            for (std::size_t plane = 0; plane < num_planes; ++plane, plane_data += plane_bytes) {
+                auto position = [&](const std::optional<int>& index) {
+                    return index.has_value() ? origin[index.value()] + plane_index[index.value()] : 0;
+                };
+                const auto group = static_cast<std::size_t>(((options.per_tstep ? position(_t_index) : 0) * _num_channels + position(_c_index)) * num_layers
+                                                            + (options.per_layer ? position(_z_index) : 0));
+                auto partial = std::find_if(partials.begin(), partials.end(), [group](const auto& p) {return p.first == group;});
+                if (partial == partials.end()) {
+                    ImageStatistics empty;
+                    if (histogram) {
+                        empty.histogram.assign(num_bins, 0);
+                        empty.histogram_min = statistics[group].histogram_min;
+                        empty.histogram_max = statistics[group].histogram_max;
+                    }
+                    partial = partials.emplace(partials.end(), group, std::move(empty));
+                }
+                AccumulateStatistics(plane_data, _data_type_code, plane_elements, partial->second);
+
+                for (auto d = static_cast<std::int64_t>(plane_index.size()) - 1; d >= 0; --d) {
+                    if (++plane_index[d] < data.shape()[d]) break;
+                    plane_index[d] = 0;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(statistics_mutex);
+            for (const auto& [group, partial] : partials) {
+                auto& total = statistics[group];
+                if (values) {
+                    total.Merge(partial);
+                } else {
+                    for (std::size_t bin = 0; bin < partial.histogram.size(); ++bin) total.histogram[bin] += partial.histogram[bin];
+                }
+            }
+        });
+    };
+
+    auto init_histograms = [&](auto get_range) {
+        for (auto& group : statistics) {
+            std::tie(group.histogram_min, group.histogram_max) = get_range(group);
+            group.histogram.assign(num_bins, 0);
+        }
+    };
+    if (histogram_range.has_value()) {
+        init_histograms([&](const ImageStatistics&) {return histogram_range.value();});
+        accumulate(true, true);
+    } else {
+        // the bins span the data range of every group, which takes a second pass
+        accumulate(true, false);
+        init_histograms([](const ImageStatistics& group) {
+            if (group.count == 0) return std::make_pair(0.0, 1.0);
+            return std::make_pair(group.min, group.max > group.min ? group.max : group.min + 1.0);
+        });
+        accumulate(false, true);
+    }
+    return statistics;
+}
+
+template <typename T>
+std::shared_ptr<std::vector<T>> TsReaderCPP::GetProjectionTemplated(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+                                                                    ProjectionMethod method, bool along_z){
+
+    const auto data_height = rows.Stop() - rows.Start() + 1;
+    const auto data_width = cols.Stop() - cols.Start() + 1;
+    const auto data_depth = layers.Stop() - layers.Start() + 1;
+    const auto data_num_channels = channels.Stop() - channels.Start() + 1;
+    const auto data_tsteps = tsteps.Stop() - tsteps.Start() + 1;
+    const auto plane_elements = data_height * data_width;
+
+    const T initial_value = method == ProjectionMethod::Max ? std::numeric_limits<T>::lowest() :
+                            method == ProjectionMethod::Min ? std::numeric_limits<T>::max() : T(0);
+    auto projection = std::make_shared<std::vector<T>>(plane_elements * data_num_channels * (along_z ? data_tsteps : data_depth), initial_value);
+
+    // tiles follow the chunk grid in Y and X, so each read decodes whole chunks of one plane
+    const auto read_chunk_shape = source.chunk_layout().value().read_chunk_shape();
+    const auto rank = source.rank();
+    auto split = [](std::int64_t start, std::int64_t stop, std::int64_t chunk_size) {
+        std::vector<std::pair<std::int64_t, std::int64_t>> tiles;
+        for (auto tile_start = start; tile_start <= stop; ) {
+            const auto tile_stop = chunk_size > 0 ? std::min(stop, (tile_start / chunk_size + 1) * chunk_size - 1) : stop;
+            tiles.emplace_back(tile_start, tile_stop);
+            tile_start = tile_stop + 1;
+        }
+        return tiles;
+    };
+    const auto row_tiles = split(rows.Start(), rows.Stop(), read_chunk_shape[rank - 2]);
+    const auto col_tiles = split(cols.Start(), cols.Stop(), read_chunk_shape[rank - 1]);
+    const auto tiles_per_plane = row_tiles.size() * col_tiles.size();
+
+    // planes of the same tile may complete on different threads
+    auto tile_mutexes = std::make_shared<std::vector<std::mutex>>(projection->size() / plane_elements * tiles_per_plane);
+
+    const std::size_t max_pending_blocks = 2 * std::max(1u, std::thread::hardware_concurrency());
+    std::deque<tensorstore::Future<void>> pending_blocks;
+    std::vector<std::string> errors;
+    auto wait_for_blocks = [&](std::size_t max_remaining) {
+        while (pending_blocks.size() > max_remaining) {
+            auto status = pending_blocks.front().status();
+            pending_blocks.pop_front();
+            if (!status.ok()) errors.emplace_back(status.ToString());
+        }
+    };
+
+    const auto src_dtype_code = _data_type_code;
+    for (auto t = tsteps.Start(); t <= tsteps.Stop(); ++t) {
+        for (auto c = channels.Start(); c <= channels.Stop(); ++c) {
+            for (auto z = layers.Start(); z <= layers.Stop(); ++z) {
+                const auto plane = along_z ? (t - tsteps.Start()) * data_num_channels + (c - channels.Start())
+                                           : (c - channels.Start()) * data_depth + (z - layers.Start());
+                for (std::size_t row_tile = 0; row_tile < row_tiles.size(); ++row_tile) {
+                    const auto [row_start, row_stop] = row_tiles[row_tile];
+                    for (std::size_t col_tile = 0; col_tile < col_tiles.size(); ++col_tile) {
+                        const auto [col_start, col_stop] = col_tiles[col_tile];
+                        auto [block_transform, block_shape] = GetReadRegion(Seq(row_start, row_stop, 1), Seq(col_start, col_stop, 1),
+                                                                            Seq(z, z, 1), Seq(c, c, 1), Seq(t, t, 1));
+                        auto block = tensorstore::AllocateArray(block_shape, tensorstore::c_order, tensorstore::default_init, source.dtype());
+                        T* output = projection->data() + plane * plane_elements + (row_start - rows.Start()) * data_width + (col_start - cols.Start());
+                        auto* tile_mutex = &(*tile_mutexes)[plane * tiles_per_plane + row_tile * col_tiles.size() + col_tile];
+
+                        pending_blocks.push_back(tensorstore::MapFuture(
+                            tensorstore::InlineExecutor{},
+                            [block, projection, tile_mutexes, output, tile_mutex, src_dtype_code, method,
+                             block_rows = row_stop - row_start + 1, block_cols = col_stop - col_start + 1, data_width]
+                            (const tensorstore::Result<void>& read_result) -> tensorstore::Result<void> {
+                                if (!read_result.ok()) return read_result.status();
+                                std::lock_guard<std::mutex> lock(*tile_mutex);
+                                AccumulateProjection(block.data(), src_dtype_code, output, method, block_rows, block_cols, data_width);
+                                return tensorstore::MakeResult();
+                            },
+                            tensorstore::Read(source | block_transform, block)));
+                        // bounds the memory of blocks that are read but not accumulated yet
+                        wait_for_blocks(max_pending_blocks);
+                    }
+                }
+            }
+        }
+    }
+    wait_for_blocks(0);
+
+    if (!errors.empty()) {
+        throw std::runtime_error("Error reading image: " + errors.front());
+    }
+    if (method == ProjectionMethod::Mean) {
+        const auto num_projected = static_cast<T>(along_z ? data_depth : data_tsteps);
+        for (auto& value : *projection) value /= num_projected;
+    }
+    return projection;
+}
+
+std::shared_ptr<image_data> TsReaderCPP::GetProjection(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+                                                       const std::string& method, const std::string& axis) {
+    CheckNoShadingCorrection();
+    const auto projection_method = GetProjectionMethod(method);
+    if (axis != "Z" && axis != "T") {
+        throw std::invalid_argument("Invalid projection axis \"" + axis + "\", must be Z or T");
+    }
+    const bool along_z = axis == "Z";
+
+    if (ProjectsToDouble(projection_method)) {
+        return std::make_shared<image_data>(std::move(*(GetProjectionTemplated<double>(rows, cols, layers, channels, tsteps, projection_method, along_z))));
+    }
+    switch (_data_type_code)
+    {
+    case (1): return std::make_shared<image_data>(std::move(*(GetProjectionTemplated<std::uint8_t>(rows, cols, layers, channels, tsteps, projection_method, along_z))));
+    case (2): return std::make_shared<image_data>(std::move(*(GetProjectionTemplated<std::uint16_t>(rows, cols, layers, channels, tsteps, projection_method, along_z))));
+    case (4): return std::make_shared<image_data>(std::move(*(GetProjectionTemplated<std::uint32_t>(rows, cols, layers, channels, tsteps, projection_method, along_z))));
+    case (8): return std::make_shared<image_data>(std::move(*(GetProjectionTemplated<std::uint64_t>(rows, cols, layers, channels, tsteps, projection_method, along_z))));
+    case (16): return std::make_shared<image_data>(std::move(*(GetProjectionTemplated<std::int8_t>(rows, cols, layers, channels, tsteps, projection_method, along_z))));
+    case (32): return std::make_shared<image_data>(std::move(*(GetProjectionTemplated<std::int16_t>(rows, cols, layers, channels, tsteps, projection_method, along_z))));
+    case (64): return std::make_shared<image_data>(std::move(*(GetProjectionTemplated<std::int32_t>(rows, cols, layers, channels, tsteps, projection_method, along_z))));
+    case (128): return std::make_shared<image_data>(std::move(*(GetProjectionTemplated<std::int64_t>(rows, cols, layers, channels, tsteps, projection_method, along_z))));
+    case (256): return std::make_shared<image_data>(std::move(*(GetProjectionTemplated<float>(rows, cols, layers, channels, tsteps, projection_method, along_z))));
+    default: return std::make_shared<image_data>(std::move(*(GetProjectionTemplated<double>(rows, cols, layers, channels, tsteps, projection_method, along_z))));
+    }
+}
+
 void TsReaderCPP::SetIterReadRequests(std::int64_t const tile_width, std::int64_t const tile_height, std::int64_t const row_stride, std::int64_t const col_stride){
     iter_request_list.clear();
+    _iter_row_stride = row_stride;
+    _iter_col_stride = col_stride;
     for(std::int64_t t=0; t<_num_tsteps;++t){
         for(std::int64_t c=0; c<_num_channels;++c){
             for(std::int64_t z=0; z<_image_depth;++z){
@@ -215,4 +937,65 @@ void TsReaderCPP::SetIterReadRequests(std::int64_t const tile_width, std::int64_
         }
     }
 }
-}
\ No newline at end of file
+
+std::pair<std::int64_t, std::int64_t> TsReaderCPP::GetIterTileShape() const {return {_iter_row_stride, _iter_col_stride};}
+
+template <typename T>
+std::shared_ptr<std::vector<T>> TsReaderCPP::GetIterTileBatchTemplated(std::size_t first, std::size_t count){
+
+    const auto tile_elements = _iter_row_stride * _iter_col_stride;
+    auto read_buffer = std::make_shared<std::vector<T>>(count * tile_elements);
+
+    const std::size_t max_pending_tiles = 2 * std::max(1u, std::thread::hardware_concurrency());
+    std::deque<tensorstore::Future<void>> pending_tiles;
+    std::vector<std::string> errors;
+    auto wait_for_tiles = [&](std::size_t max_remaining) {
+        while (pending_tiles.size() > max_remaining) {
+            auto status = pending_tiles.front().status();
+            pending_tiles.pop_front();
+            if (!status.ok()) errors.emplace_back(status.ToString());
+        }
+    };
+
+    for (std::size_t index = 0; index < count; ++index) {
+        const auto [t, c, z, y_min, y_max, x_min, x_max] = iter_request_list[first + index];
+        auto [tile_transform, tile_shape] = GetReadRegion(Seq(y_min, y_max, 1), Seq(x_min, x_max, 1), Seq(z, z, 1), Seq(c, c, 1), Seq(t, t, 1));
+
+        // the tile is read straight into its slot, rows are col_stride apart
+        std::vector<tensorstore::Index> byte_strides(tile_shape.size(), 0);
+        byte_strides[byte_strides.size() - 2] = _iter_col_stride * sizeof(T);
+        byte_strides[byte_strides.size() - 1] = sizeof(T);
+        tensorstore::ArrayView<T> tile(read_buffer->data() + index * tile_elements, tensorstore::StridedLayoutView<>(tile_shape, byte_strides));
+        pending_tiles.push_back(tensorstore::Read(source | tile_transform, tensorstore::UnownedToShared(tile)));
+        wait_for_tiles(max_pending_tiles);
+    }
+    wait_for_tiles(0);
+
+    if (!errors.empty()) {
+        throw std::runtime_error("Error reading image: " + errors.front());
+    }
+    return read_buffer;
+}
+
+std::shared_ptr<image_data> TsReaderCPP::GetIterTileBatch(std::size_t first, std::size_t count) {
+    CheckNoShadingCorrection();
+    if (first > iter_request_list.size()) {
+        throw std::out_of_range("Tile batch starts after the last of " + std::to_string(iter_request_list.size()) + " iterator requests");
+    }
+    count = std::min(count, iter_request_list.size() - first);
+
+    switch (_data_type_code)
+    {
+    case (1): return std::make_shared<image_data>(std::move(*(GetIterTileBatchTemplated<std::uint8_t>(first, count))));
+    case (2): return std::make_shared<image_data>(std::move(*(GetIterTileBatchTemplated<std::uint16_t>(first, count))));
+    case (4): return std::make_shared<image_data>(std::move(*(GetIterTileBatchTemplated<std::uint32_t>(first, count))));
+    case (8): return std::make_shared<image_data>(std::move(*(GetIterTileBatchTemplated<std::uint64_t>(first, count))));
+    case (16): return std::make_shared<image_data>(std::move(*(GetIterTileBatchTemplated<std::int8_t>(first, count))));
+    case (32): return std::make_shared<image_data>(std::move(*(GetIterTileBatchTemplated<std::int16_t>(first, count))));
+    case (64): return std::make_shared<image_data>(std::move(*(GetIterTileBatchTemplated<std::int32_t>(first, count))));
+    case (128): return std::make_shared<image_data>(std::move(*(GetIterTileBatchTemplated<std::int64_t>(first, count))));
+    case (256): return std::make_shared<image_data>(std::move(*(GetIterTileBatchTemplated<float>(first, count))));
+    default: return std::make_shared<image_data>(std::move(*(GetIterTileBatchTemplated<double>(first, count))));
+    }
+}
+}
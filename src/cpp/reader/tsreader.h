@@ -1,13 +1,18 @@
 #pragma once
 
 #include <string>
+#include <functional>
 #include <memory>
 #include <vector>
 #include <variant>
 #include <optional>
+#include "tensorstore/context.h"
 #include "tensorstore/tensorstore.h"
 #include "../utilities/sequence.h"
 #include "../utilities/utilities.h"
+#include "convert.h"
+#include "projection.h"
+#include "statistics.h"
 using image_data = std::variant<std::vector<std::uint8_t>,
                                 std::vector<std::uint16_t>, 
                                 std::vector<std::uint32_t>, 
@@ -24,9 +29,18 @@ using iter_indicies = std::tuple<std::int64_t,std::int64_t,std::int64_t,std::int
 
 namespace bfiocpp{
 
+class BatchOpen;
+
 class TsReaderCPP{
 public:
-    TsReaderCPP(const std::string& fname, FileType ft, const std::string& axes_list );
+    // tiles_per_chunk groups [Y, X] native OME-TIFF tiles into one chunk, which is read
+    // in one request; empty keeps one tile per chunk. Readers sharing a context share its
+    // cache pool and I/O concurrency limits. Without a context an OME-TIFF reader gets its
+    // own GetReadContext() and a zarr reader the tensorstore default. Throws
+    // std::runtime_error if the file can not be opened.
+    TsReaderCPP(const std::string& fname, FileType ft, const std::string& axes_list,
+                const std::vector<std::int64_t>& tiles_per_chunk = {},
+                const std::optional<tensorstore::Context>& context = std::nullopt);
     std::int64_t GetImageHeight() const ;
     std::int64_t GetImageWidth () const ;
     std::int64_t GetImageDepth () const ;
@@ -36,12 +50,51 @@ public:
     std::int64_t GetChannelCount () const;
     std::int64_t GetTstepCount () const;
     std::string GetDataType() const;
-    std::shared_ptr<image_data> GetImageData(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps);
+    // conversion is fused into the read, so the native data is never held in full. axis_order
+    // (e.g. "YXC", default "TCZYX") is the layout of the returned data, axes left out of it must
+    // have length 1 in the region and are squeezed
+    std::shared_ptr<image_data> GetImageData(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+                                             const ReadConversion& conversion = ReadConversion(), const std::string& axis_order = "");
+    // max, min, sum or mean of a region along axis "Z" or "T", which has length 1 in the result.
+    // Planes are streamed tile by tile, so only the output and a few chunks are in memory.
+    std::shared_ptr<image_data> GetProjection(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+                                              const std::string& method, const std::string& axis = "Z");
+    // (raw - dark) / flat applied by GetImageData before any conversion. flat and dark (either may
+    // be null) are images with the Y/X size of the current level and 1 channel or one per channel,
+    // the first plane of each is read into memory. Both null removes the correction. The other
+    // reads (GetTensorStore and everything built on it, GetProjection, GetIterTileBatch and
+    // ComputeStatistics) throw std::runtime_error while a correction is set.
+    void SetShadingCorrection(const std::shared_ptr<TsReaderCPP>& flat, const std::shared_ptr<TsReaderCPP>& dark);
+    // a region that is exactly one read chunk (clipped at the image edge) of a single plane, read
+    // into an array allocated by tensorstore without the zero-filled buffer of GetImageData;
+    // empty for any other region
+    std::optional<tensorstore::SharedArray<const void>> GetChunkData(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps);
     void SetIterReadRequests(std::int64_t const tile_width, std::int64_t const tile_height, std::int64_t const row_stride, std::int64_t const col_stride);
+    // requests [first, first + count) of iter_request_list read concurrently into one
+    // (count, row_stride, col_stride) buffer, tiles at the image edge are zero padded
+    std::shared_ptr<image_data> GetIterTileBatch(std::size_t first, std::size_t count);
+    std::pair<std::int64_t, std::int64_t> GetIterTileShape() const;
+    // levels of an OME-Zarr multiscales group or OME-TIFF SubIFD pyramid, other images have a single level
+    std::size_t GetLevelCount() const;
+    std::size_t GetLevel() const;
+    // scale factors of a level relative to level 0, in array dimension order
+    std::vector<double> GetLevelScale(std::size_t level) const;
+    void SetLevel(std::size_t level);
+    // coarsest level that is at least min_height x min_width, level 0 if none is
+    std::size_t GetLevelForSize(std::int64_t min_height, std::int64_t min_width) const;
+    // TCZYX view of the current level, axes the image does not have are added with length 1
+    tensorstore::TensorStore<> GetTensorStore() const;
+    // per channel (and optionally per Z/T) statistics and histograms of the current level,
+    // computed chunk by chunk in parallel without reading the whole image
+    std::vector<ImageStatistics> ComputeStatistics(const StatisticsOptions& options = StatisticsOptions());
     //tuple of (T,C,Z,Y_min, Y_max, X_min, X_max)
     std::vector<iter_indicies> iter_request_list;
 
 private:
+    friend class BatchOpen;
+
+    using Store = tensorstore::TensorStore<void, -1, tensorstore::ReadWriteMode::dynamic>;
+
     std::string _filename, _data_type;
     std::int64_t    _image_height, 
                     _image_width, 
@@ -53,14 +106,58 @@ private:
                     _num_tsteps;
     std::uint16_t _data_type_code;
     FileType _file_type;
+    std::string _axes_list;
+
+    std::vector<MultiscaleLevel> _levels;
+    std::vector<std::int64_t> _tiles_per_chunk;
+    std::size_t _level;
+    std::int64_t _full_image_height, _full_image_width;
 
     std::optional<int>_z_index, _c_index, _t_index;
+    std::int64_t _iter_row_stride = 0, _iter_col_stride = 0;
+    std::shared_ptr<const ShadingCorrection> _shading;
+    tensorstore::Context _context;
+
+    Store source;
+
+    // a reader of the level 0 store opened by BatchOpen
+    TsReaderCPP(const std::string& fname, FileType ft, const std::string& axes_list, const tensorstore::Context& context,
+                std::vector<MultiscaleLevel> levels, Store level_source);
 
-    tensorstore::TensorStore<void, -1, tensorstore::ReadWriteMode::dynamic> source;
+    // levels of a multiscales group or SubIFD pyramid, empty for a single level image
+    static std::vector<MultiscaleLevel> FindLevels(const std::string& fname, FileType ft);
+    static tensorstore::Spec GetReadSpec(const std::string& fname, FileType ft, const std::vector<MultiscaleLevel>& levels,
+                                         std::size_t level, const std::vector<std::int64_t>& tiles_per_chunk);
 
+    void Open(std::size_t level);
+    // throws for the reads that would skip the shading correction
+    void CheckNoShadingCorrection() const;
+    // sizes and axes of the level in level_source, which becomes the source
+    void SetSource(Store level_source);
 
+    // read transform of a region and the c_order shape of its data, without absent dimensions
+    std::pair<tensorstore::IndexTransform<>, std::vector<std::int64_t>> GetReadRegion(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps) const;
+
+    // calls process(chunk data, chunk origin) for every chunk of the native chunk grid, from
+    // the threads completing the reads, with a bounded number of chunks in memory
+    using ChunkCallback = std::function<void(const tensorstore::SharedArray<const void>&, const std::vector<std::int64_t>&)>;
+    void ForEachChunk(const ChunkCallback& process);
+
+    // read transform of a region with its dimensions in output_axes order (TCZYX indices)
+    tensorstore::IndexTransform<> GetOrderedReadRegion(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+                                                       const std::vector<int>& output_axes) const;
+
+    template <typename T>
+    std::shared_ptr<std::vector<T>> GetImageDataTemplated(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+                                                          const std::vector<int>& output_axes);
+    template <typename T>
+    std::shared_ptr<std::vector<T>> GetImageDataConverted(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+                                                          const ReadConversion& conversion, const std::vector<int>& output_axes);
+    template <typename T>
+    std::shared_ptr<std::vector<T>> GetIterTileBatchTemplated(std::size_t first, std::size_t count);
     template <typename T>
-    std::shared_ptr<std::vector<T>> GetImageDataTemplated(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps);                 
+    std::shared_ptr<std::vector<T>> GetProjectionTemplated(const Seq& rows, const Seq& cols, const Seq& layers, const Seq& channels, const Seq& tsteps,
+                                                           ProjectionMethod method, bool along_z);
 };
 }
 
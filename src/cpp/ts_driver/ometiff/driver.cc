@@ -22,7 +22,10 @@
 #include "tensorstore/tensorstore.h"
 #include "tensorstore/util/constant_vector.h"
 #include "tensorstore/util/future.h"
+#include "tensorstore/serialization/std_vector.h"
 
+#include <array>
+#include <cstring>
 #include <iostream>
 #include <numeric>
 #include <tuple>
@@ -36,6 +39,20 @@ namespace {
 namespace jb = tensorstore::internal_json_binding;
 
 constexpr const char kMetadataKey[] = "IMAGE_DESCRIPTION";
+// Metadata cache entries of SubIFD levels or aggregated tiles are
+// "<path>__VARIANT__<suffix>", the suffix is appended to kMetadataKey.
+constexpr const char kVariantSeparator[] = "__VARIANT__";
+
+// "_s<level>" for SubIFD levels and "_t<ny>x<nx>" for chunks of ny x nx tiles,
+// shared by the metadata and chunk keys of the tiled_tiff kvstore.
+std::string GetKeySuffix(int level, span<const Index> tiles_per_chunk) {
+  std::string suffix;
+  if (level > 0) StrAppend(&suffix, "_s", level);
+  if (tiles_per_chunk[0] > 1 || tiles_per_chunk[1] > 1) {
+    StrAppend(&suffix, "_t", tiles_per_chunk[0], "x", tiles_per_chunk[1]);
+  }
+  return suffix;
+}
 
 using internal_kvs_backed_chunk_driver::KvsDriverSpec;
 
@@ -50,9 +67,14 @@ class OmeTiffDriverSpec
                                               /*Parent=*/KvsDriverSpec>;
 
   OmeTiffMetadataConstraints metadata_constraints;
+  // resolution level, 0 is the full resolution and n > 0 the n-th SubIFD
+  int level = 0;
+  // [Y, X] native tiles per chunk, read in one kvstore request
+  std::vector<Index> tiles_per_chunk{1, 1};
 
   constexpr static auto ApplyMembers = [](auto& x, auto f) {
-    return f(internal::BaseCast<KvsDriverSpec>(x), x.metadata_constraints);
+    return f(internal::BaseCast<KvsDriverSpec>(x), x.metadata_constraints, x.level,
+             x.tiles_per_chunk);
   };
 
   static inline const auto default_json_binder = jb::Sequence(
@@ -74,7 +96,24 @@ class OmeTiffDriverSpec
                 return absl::OkStatus();
               },
               jb::Projection<&OmeTiffDriverSpec::metadata_constraints>(
-                  jb::DefaultInitializedValue()))));
+                  jb::DefaultInitializedValue()))),
+      jb::Member("level",
+                 jb::Projection<&OmeTiffDriverSpec::level>(
+                     jb::DefaultValue([](auto* v) { *v = 0; },
+                                      jb::Integer<int>(0)))),
+      jb::Member("tilesPerChunk",
+                 jb::Validate(
+                     [](const auto& options, auto* obj) {
+                       if (obj->tiles_per_chunk.size() != 2) {
+                         return absl::InvalidArgumentError(
+                             "\"tilesPerChunk\" must be [Y, X]");
+                       }
+                       return absl::OkStatus();
+                     },
+                     jb::Projection<&OmeTiffDriverSpec::tiles_per_chunk>(
+                         jb::DefaultValue(
+                             [](auto* v) { *v = {1, 1}; },
+                             jb::Array(jb::Integer<Index>(1)))))));
   
   absl::Status ApplyOptions(SpecOptions&& options) override {
     if (options.minimal_spec) {
@@ -103,6 +142,15 @@ Result<std::shared_ptr<const OmeTiffMetadata>> ParseEncodedMetadata(
   if (raw_data.is_discarded()) {
     return absl::FailedPreconditionError("Invalid JSON");
   }
+  // resolution level and tile aggregation written by the tiled_tiff kvstore
+  int level = raw_data.value("level", 0);
+  int num_levels = raw_data.value("numLevels", 1);
+  auto tiles_per_chunk =
+      raw_data.value("tilesPerChunk", std::array<Index, 2>{1, 1});
+  raw_data.erase("level");
+  raw_data.erase("numLevels");
+  raw_data.erase("tilesPerChunk");
+
   // create ifd lookup table
   std::map<std::tuple<size_t, size_t, size_t>, size_t> ifd_lookup_table;
 
@@ -116,6 +164,9 @@ Result<std::shared_ptr<const OmeTiffMetadata>> ParseEncodedMetadata(
   
 
   metadata.ifd_lookup_table = ifd_lookup_table;
+  metadata.level = level;
+  metadata.num_levels = num_levels;
+  metadata.tiles_per_chunk = tiles_per_chunk;
   return std::make_shared<OmeTiffMetadata>(std::move(metadata));
 }
 
@@ -128,7 +179,12 @@ class MetadataCache : public internal_kvs_backed_chunk_driver::MetadataCache {
 
   // Metadata is stored as IMAGE_DESCRIPTION tag inside tiff.
   std::string GetMetadataStorageKey(std::string_view entry_key) override {
-    // metadata is in the same file
+    // metadata is in the same file, variants use IMAGE_DESCRIPTION[_s<n>][_t<ny>x<nx>]
+    auto pos = entry_key.rfind(kVariantSeparator);
+    if (pos != std::string_view::npos) {
+      return tensorstore::StrCat(entry_key.substr(0, pos), "__TAG__/", kMetadataKey,
+                                 entry_key.substr(pos + std::strlen(kVariantSeparator)));
+    }
     return tensorstore::StrCat(entry_key, "__TAG__/", kMetadataKey);
 //    return std::string(entry_key);
   }
@@ -274,6 +330,7 @@ class DataCache : public internal_kvs_backed_chunk_driver::DataCache {
     StrAppend(&key, "_", cell_indices[3]*chunk_shape[3]);
     StrAppend(&key, "_", cell_indices[4]*chunk_shape[4]);
     StrAppend(&key, "_", ifd);
+    StrAppend(&key, GetKeySuffix(md.level, md.tiles_per_chunk));
     return key;
   }
 
@@ -302,6 +359,9 @@ class DataCache : public internal_kvs_backed_chunk_driver::DataCache {
     constraints.shape = metadata.shape;
     constraints.dtype = metadata.dtype;
     constraints.dim_order = metadata.dim_order;
+    spec.level = metadata.level;
+    spec.tiles_per_chunk.assign(metadata.tiles_per_chunk.begin(),
+                                metadata.tiles_per_chunk.end());
     constraints.extra_attributes = metadata.extra_attributes;
     constraints.chunk_shape =
         std::vector<Index>(metadata.chunk_layout.shape().begin(),
@@ -351,6 +411,10 @@ class OmeTiffDriver::OpenState : public OmeTiffDriver::OpenStateBase {
     return spec().store.path;
   }
   std::string GetMetadataCacheEntryKey() override { 
+    auto suffix = GetKeySuffix(spec().level, spec().tiles_per_chunk);
+    if (!suffix.empty()) {
+      return tensorstore::StrCat(spec().store.path, kVariantSeparator, suffix);
+    }
     return spec().store.path; 
   }
   
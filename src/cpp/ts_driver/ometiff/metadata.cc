@@ -126,6 +126,7 @@ std::string OmeTiffMetadata::GetCompatibilityKey() const {
   obj.emplace("blockSize", ::nlohmann::json::array_t(chunk_shape.begin(),
                                                      chunk_shape.end()));
   obj.emplace("dataType", dtype.name());
+  obj.emplace("level", level);
   return ::nlohmann::json(obj).dump();
 }
 
@@ -1,6 +1,7 @@
 #ifndef TENSORSTORE_DRIVER_OMETIFF_METADATA_H_
 #define TENSORSTORE_DRIVER_OMETIFF_METADATA_H_
 
+#include <array>
 #include <string>
 #include <map>
 #include <tuple>
@@ -30,6 +31,12 @@ class OmeTiffMetadata {
         bool tiled;
         short dim_order;
         std::map<std::tuple<size_t, size_t, size_t>, size_t> ifd_lookup_table;
+        /// Resolution level, 0 is the full resolution IFD and n > 0 its n-th SubIFD.
+        int level = 0;
+        /// Number of resolution levels stored in the file.
+        int num_levels = 1;
+        /// Native tiles per chunk in Y and X, chunk_shape already includes them.
+        std::array<Index, 2> tiles_per_chunk = {1, 1};
           /// Contains all additional attributes, excluding attributes parsed into the
   /// data members above.
         ::nlohmann::json::object_t extra_attributes;
@@ -17,6 +17,8 @@
 #include <algorithm>
 #include <cctype>
 #include <chrono>
+#include <cstring>
+#include <tuple>
 
 #include "absl/functional/function_ref.h"
 #include "absl/status/status.h"
@@ -183,6 +185,80 @@ std::string GetDataType(short sample_format, short bits_per_sample){
   }
 }
 
+/// Makes resolution `level` of IFD `ifd_dir` the current directory. Level 0 is the
+/// IFD itself and level n > 0 its n-th SubIFD, which is how bioformats stores pyramids.
+bool SetResolutionLevel(TIFF* tiff, uint32_t ifd_dir, uint32_t level) {
+  if (TIFFSetDirectory(tiff, ifd_dir) == 0) return false;
+  if (level == 0) return true;
+  uint16_t num_sub_ifds = 0;
+  toff_t* sub_ifd_offsets = nullptr;
+  if (TIFFGetField(tiff, TIFFTAG_SUBIFD, &num_sub_ifds, &sub_ifd_offsets) == 0 ||
+      level > num_sub_ifds) {
+    return false;
+  }
+  // the offsets belong to the current directory, so copy before switching
+  const toff_t offset = sub_ifd_offsets[level - 1];
+  return TIFFSetSubDirectory(tiff, offset) != 0;
+}
+
+/// Number of resolution levels of the current IFD, 1 if it has no SubIFDs.
+uint32_t GetNumResolutionLevels(TIFF* tiff) {
+  uint16_t num_sub_ifds = 0;
+  toff_t* sub_ifd_offsets = nullptr;
+  if (TIFFGetField(tiff, TIFFTAG_SUBIFD, &num_sub_ifds, &sub_ifd_offsets) == 0) return 1;
+  return static_cast<uint32_t>(num_sub_ifds) + 1;
+}
+
+/// Parses the optional "_s<level>" and "_t<ny>x<nx>" parts of a key suffix.
+void ParseKeySuffix(const std::smatch& match, std::size_t first_group, uint32_t& level,
+                    uint32_t& tiles_y, uint32_t& tiles_x) {
+  level = match[first_group].matched ? std::stoul(match[first_group].str()) : 0;
+  tiles_y = match[first_group + 1].matched ? std::stoul(match[first_group + 1].str()) : 1;
+  tiles_x = match[first_group + 2].matched ? std::stoul(match[first_group + 2].str()) : 1;
+}
+
+/// Reads the tiles_y x tiles_x tiles starting at pixel (y_pos, x_pos) of the current
+/// directory into one chunk buffer. Tiles past the image edge are left as zeros and
+/// the others are read in file order, so the reads are sequential on disk.
+absl::Status ReadTileBlock(TIFF* tiff, uint32_t y_pos, uint32_t x_pos,
+                           uint32_t tiles_y, uint32_t tiles_x, char* chunk) {
+  uint32_t tile_width = 0, tile_height = 0, image_width = 0, image_height = 0;
+  TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tile_width);
+  TIFFGetField(tiff, TIFFTAG_TILELENGTH, &tile_height);
+  TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &image_width);
+  TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &image_height);
+  const auto tile_size = TIFFTileSize(tiff);
+  const auto tile_row_size = tile_size / tile_height;
+  const auto chunk_row_size = tile_row_size * tiles_x;
+  std::memset(chunk, 0, tile_size * tiles_y * tiles_x);
+
+  toff_t* tile_offsets = nullptr;
+  TIFFGetField(tiff, TIFFTAG_TILEOFFSETS, &tile_offsets);
+  // (file offset, tile index, row in block, column in block)
+  std::vector<std::tuple<toff_t, uint32_t, uint32_t, uint32_t>> tiles;
+  for (uint32_t ty = 0; ty < tiles_y; ++ty) {
+    for (uint32_t tx = 0; tx < tiles_x; ++tx) {
+      const uint32_t y = y_pos + ty * tile_height, x = x_pos + tx * tile_width;
+      if (y >= image_height || x >= image_width) continue;
+      const auto tile = TIFFComputeTile(tiff, x, y, 0, 0);
+      tiles.emplace_back(tile_offsets ? tile_offsets[tile] : tile, tile, ty, tx);
+    }
+  }
+  std::sort(tiles.begin(), tiles.end());
+
+  std::vector<char> tile_buffer(tile_size);
+  for (const auto& [offset, tile, ty, tx] : tiles) {
+    if (TIFFReadEncodedTile(tiff, tile, tile_buffer.data(), tile_size) == -1) {
+      return absl::DataLossError(tensorstore::StrCat("Error reading tile ", tile));
+    }
+    char* dst = chunk + ty * tile_height * chunk_row_size + tx * tile_row_size;
+    for (uint32_t row = 0; row < tile_height; ++row) {
+      std::memcpy(dst + row * chunk_row_size, tile_buffer.data() + row * tile_row_size, tile_row_size);
+    }
+  }
+  return absl::OkStatus();
+}
+
 /// Implements `TiledTiffKeyValueStore::Read`.
 
 // if we can override this in each cache class, that may work
@@ -217,7 +293,13 @@ struct ReadTask {
     }
 
     if (pos != std::string::npos){
-      if (tag_value == img_tag){
+      // IMAGE_DESCRIPTION is the full resolution, _s<n> selects the n-th SubIFD level
+      // and _t<ny>x<nx> makes every chunk ny x nx native tiles
+      std::smatch metadata_match;
+      const std::regex metadata_regex(img_tag + "(?:_s(\\d+))?(?:_t(\\d+)x(\\d+))?");
+      if (std::regex_match(tag_value, metadata_match, metadata_regex)){
+        uint32_t level, tiles_y, tiles_x;
+        ParseKeySuffix(metadata_match, 1, level, tiles_y, tiles_x);
         std::ostringstream oss, tiff_data_str;
         TIFF *tiff_ = TIFFOpen(actual_full_path.c_str(), "r");
         if (tiff_ != nullptr) 
@@ -232,7 +314,27 @@ struct ReadTask {
           short
             sample_format = 0,          
             bits_per_sample = 0;
-                    
+
+          OmeXml ome_data = OmeXml();
+          ome_data.tiff_data_list.emplace_back(std::make_tuple(0,0,0,0));
+          char* infobuf = nullptr;
+          TIFFGetField(tiff_, TIFFTAG_IMAGEDESCRIPTION , &infobuf);
+          if (infobuf != nullptr && strlen(infobuf)>0){
+            ome_data.ParseOmeXml(infobuf);
+          } else {
+          // no metadata, so assuming a single IFD
+          ome_data.tiff_data_list.emplace_back(std::make_tuple(0,0,0,0));
+          }
+
+          // reduced resolutions are SubIFDs, their size and tiling come from the first one
+          const uint32_t num_levels = GetNumResolutionLevels(tiff_);
+          if (level >= num_levels || !SetResolutionLevel(tiff_, 0, level)) {
+            TIFFClose(tiff_);
+            return absl::NotFoundError(tensorstore::StrCat(
+                "Resolution level ", level, " not found in ", actual_full_path,
+                ", the file has ", num_levels, " level(s)"));
+          }
+
           TIFFGetField(tiff_, TIFFTAG_IMAGEWIDTH, &image_width);
           TIFFGetField(tiff_, TIFFTAG_IMAGELENGTH, &image_height);
           TIFFGetField(tiff_, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
@@ -242,31 +344,25 @@ struct ReadTask {
           std::string dtype = GetDataType(sample_format, bits_per_sample);
           
           if (TIFFIsTiled(tiff_) == 0) {
+            // strips are read as 1024 row blocks spanning the image width
             tile_width = image_width;
             tile_height = 1024;
+            tiles_x = 1;
           } else {
             TIFFGetField(tiff_, TIFFTAG_TILEWIDTH, &tile_width);
             TIFFGetField(tiff_, TIFFTAG_TILELENGTH, &tile_height);
           }
 
-          OmeXml ome_data = OmeXml();
-          ome_data.tiff_data_list.emplace_back(std::make_tuple(0,0,0,0));
-          char* infobuf;
-          TIFFGetField(tiff_, TIFFTAG_IMAGEDESCRIPTION , &infobuf);
-          if (strlen(infobuf)>0){
-            ome_data.ParseOmeXml(infobuf);
-          } else {
-          // no metadata, so assuming a single IFD
-          ome_data.tiff_data_list.emplace_back(std::make_tuple(0,0,0,0));
-          }
-
 
           oss << "{"; //start creating JSON string
           oss << "\"dimensions\": [" << ome_data.nt << "," << ome_data.nc << "," << ome_data.nz << ","  << image_height << "," << image_width <<  "],"
-              << "\"blockSize\": [1,1,1," << tile_height << "," << tile_width << "],"
+              << "\"blockSize\": [1,1,1," << tile_height * tiles_y << "," << tile_width * tiles_x << "],"
               << "\"dataType\": \"" << dtype << "\","
               << "\"samplePerPixel\": \"" << sample_per_pixel << "\","
               << "\"dimOrder\": " << ome_data.dim_order << ","
+              << "\"level\": " << level << ","
+              << "\"numLevels\": " << num_levels << ","
+              << "\"tilesPerChunk\": [" << tiles_y << "," << tiles_x << "],"
               << "\"omeXml\": " << ome_data.ToJsonStr() << ",";
           oss.seekp(-1, oss.cur);
           oss << "}"; // finish JSON string
@@ -280,17 +376,34 @@ struct ReadTask {
       else // parse tile indices
       { 
         std::smatch match_result;
-        std::regex tile_indices_regex("_(\\d+)_(\\d+)_(\\d+)");
+        std::regex tile_indices_regex("_(\\d+)_(\\d+)_(\\d+)(?:_s(\\d+))?(?:_t(\\d+)x(\\d+))?");
         if (regex_match(tag_value, match_result, tile_indices_regex)){
           uint32_t x_pos = std::stoi(match_result[2].str());
           uint32_t y_pos = std::stoi(match_result[1].str());
           uint32_t ifd_dir = std::stoi(match_result[3].str());
+          uint32_t level, tiles_y, tiles_x;
+          ParseKeySuffix(match_result, 4, level, tiles_y, tiles_x);
           TIFF *tiff_ = TIFFOpen(actual_full_path.c_str(), "r");
           if (tiff_ != nullptr) 
           {
-            if (TIFFIsTiled(tiff_) != 0){ // tiled tiff image
+            if (!SetResolutionLevel(tiff_, ifd_dir, level)) {
+              TIFFClose(tiff_);
+              return absl::NotFoundError(tensorstore::StrCat(
+                  "IFD ", ifd_dir, " level ", level, " not found in ", actual_full_path));
+            }
+            if (TIFFIsTiled(tiff_) != 0 && tiles_y * tiles_x > 1){ // block of tiles in one chunk
+              internal::FlatCordBuilder buffer(TIFFTileSize(tiff_) * tiles_y * tiles_x);
+              auto status = ReadTileBlock(tiff_, y_pos, x_pos, tiles_y, tiles_x, buffer.data());
+              TIFFClose(tiff_);
+              if (!status.ok()) {
+                read_result.state = ReadResult::kMissing;
+                return tensorstore::MaybeAnnotateStatus(
+                    status, tensorstore::StrCat("Error reading file: ", actual_full_path));
+              }
+              read_result.state = ReadResult::kValue;
+              read_result.value = std::move(buffer).Build();
+            } else if (TIFFIsTiled(tiff_) != 0){ // tiled tiff image
               auto t_szb = TIFFTileSize(tiff_);
-              TIFFSetDirectory(tiff_, ifd_dir);
               internal::FlatCordBuilder buffer(t_szb);
               auto errcode = TIFFReadTile(tiff_, buffer.data(), x_pos, y_pos, 0, 0);
               TIFFClose(tiff_);      
@@ -304,14 +417,13 @@ struct ReadTask {
                 return StatusFromErrno("Error reading file: ", actual_full_path);
               }
             } else { // raster image
-              uint32_t tile_height = 1024, image_height = 0, image_width = 0; // hardcoded tile height
+              uint32_t tile_height = 1024 * tiles_y, image_height = 0, image_width = 0; // hardcoded tile height
               TIFFGetField(tiff_, TIFFTAG_IMAGELENGTH, &image_height);
               TIFFGetField(tiff_, TIFFTAG_IMAGEWIDTH, &image_width);
               uint32_t tile_width = image_width;
               uint32_t start_row = y_pos; 
               uint32_t end_row = std::min(y_pos+tile_height, image_height); 
               auto line_size = TIFFScanlineSize(tiff_);
-              TIFFSetDirectory(tiff_, ifd_dir);
               internal::FlatCordBuilder buffer(line_size*tile_height);
               auto buf_ptr = buffer.data();
 
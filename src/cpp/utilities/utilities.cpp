@@ -4,6 +4,10 @@
 #include <cassert>
 #include <tiffio.h>
 #include <thread>
+#include <stdexcept>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
 
 #include "tensorstore/driver/zarr/dtype.h"
 
@@ -11,17 +15,22 @@
 using ::tensorstore::internal_zarr::ChooseBaseDType;
 
 namespace bfiocpp {
-tensorstore::Spec GetOmeTiffSpecToRead(const std::string& filename){
+tensorstore::Context GetReadContext(){
+    return tensorstore::Context(tensorstore::Context::Spec::FromJson({
+                              {"cache_pool", {{"total_bytes_limit", 1000000000}}},
+                              {"data_copy_concurrency", {{"limit", 8}}},
+                              {"file_io_concurrency", {{"limit", 8}}},
+                            }).value());
+}
+
+tensorstore::Spec GetOmeTiffSpecToRead(const std::string& filename, int level, const std::vector<std::int64_t>& tiles_per_chunk){
     return tensorstore::Spec::FromJson({{"driver", "ometiff"},
+                            {"level", level},
+                            {"tilesPerChunk", tiles_per_chunk.empty() ? std::vector<std::int64_t>{1, 1} : tiles_per_chunk},
 
                             {"kvstore", {{"driver", "tiled_tiff"},
                                          {"path", filename}}
                             },
-                            {"context", {
-                              {"cache_pool", {{"total_bytes_limit", 1000000000}}},
-                              {"data_copy_concurrency", {{"limit", 8}}},
-                              {"file_io_concurrency", {{"limit", 8}}},
-                            }},
                             }).value();
 }
 
@@ -51,6 +60,24 @@ uint16_t GetDataTypeCode (std::string_view type_name){
   else {return 2;}
 }
 
+tensorstore::DataType GetTensorStoreDataType(uint16_t data_type_code){
+    switch (data_type_code)
+    {
+    case 1: return tensorstore::dtype_v<std::uint8_t>;
+    case 2: return tensorstore::dtype_v<std::uint16_t>;
+    case 4: return tensorstore::dtype_v<std::uint32_t>;
+    case 8: return tensorstore::dtype_v<std::uint64_t>;
+    case 16: return tensorstore::dtype_v<std::int8_t>;
+    case 32: return tensorstore::dtype_v<std::int16_t>;
+    case 64: return tensorstore::dtype_v<std::int32_t>;
+    case 128: return tensorstore::dtype_v<std::int64_t>;
+    case 256: return tensorstore::dtype_v<float>;
+    case 512: return tensorstore::dtype_v<double>;
+    default:
+        throw std::invalid_argument("Unsupported data type code " + std::to_string(data_type_code));
+    }
+}
+
 std::string GetEncodedType(uint16_t data_type_code){
     switch (data_type_code)
     {
@@ -170,54 +197,244 @@ std::string GetZarrV3DataType(uint16_t data_type_code) {
     }
 }
 
+namespace {
+int GetCompressionLevel(const CompressionOptions& compression){
+    if (compression.level >= 0) return compression.level;
+    if (compression.codec == "blosc") return 5;
+    if (compression.codec == "zstd") return 3;
+    return 6; // gzip
+}
+
+void ValidateCompressionOptions(const CompressionOptions& compression){
+    const auto& codec = compression.codec;
+    if (codec != "" && codec != "none" && codec != "blosc" && codec != "zstd" && codec != "gzip") {
+        throw std::invalid_argument("Invalid compression codec \"" + codec + "\". Supported codecs are none, blosc, zstd and gzip.");
+    }
+    if (codec == "blosc") {
+        const auto& cname = compression.blosc_cname;
+        if (cname != "lz4" && cname != "lz4hc" && cname != "blosclz" && cname != "zstd" && cname != "zlib") {
+            throw std::invalid_argument("Invalid blosc compressor \"" + cname + "\". Supported compressors are lz4, lz4hc, blosclz, zstd and zlib.");
+        }
+        const auto& shuffle = compression.shuffle;
+        if (shuffle != "noshuffle" && shuffle != "shuffle" && shuffle != "bitshuffle") {
+            throw std::invalid_argument("Invalid blosc shuffle \"" + shuffle + "\". Supported values are noshuffle, shuffle and bitshuffle.");
+        }
+    }
+    // a negative level selects the codec default
+    if (compression.level >= 0 && codec != "" && codec != "none") {
+        const int max_level = (codec == "zstd") ? 22 : 9;
+        if (compression.level > max_level) {
+            throw std::invalid_argument("Invalid " + codec + " compression level " + std::to_string(compression.level)
+                                        + ". Supported levels are 0 to " + std::to_string(max_level) + ".");
+        }
+    }
+}
+
+::nlohmann::json GetZarrV2Compressor(const CompressionOptions& compression){
+    if (compression.codec == "none") return nullptr;
+    if (compression.codec == "blosc") {
+        int shuffle = (compression.shuffle == "bitshuffle") ? 2 : (compression.shuffle == "shuffle") ? 1 : 0;
+        return {{"id", "blosc"},
+                {"cname", compression.blosc_cname},
+                {"clevel", GetCompressionLevel(compression)},
+                {"shuffle", shuffle}};
+    }
+    if (compression.codec == "zstd") {
+        return {{"id", "zstd"}, {"level", GetCompressionLevel(compression)}};
+    }
+    return {{"id", "gzip"}, {"level", GetCompressionLevel(compression)}};
+}
+
+// Codecs that follow the "bytes" codec in a zarr v3 codec chain.
+::nlohmann::json::array_t GetZarrV3CompressionCodecs(const CompressionOptions& compression, std::size_t type_size){
+    if (compression.codec == "" || compression.codec == "none") return {};
+    if (compression.codec == "blosc") {
+        return {{{"name", "blosc"},
+                 {"configuration", {{"cname", compression.blosc_cname},
+                                    {"clevel", GetCompressionLevel(compression)},
+                                    {"shuffle", compression.shuffle},
+                                    {"typesize", type_size},
+                                    {"blocksize", 0}}}}};
+    }
+    if (compression.codec == "zstd") {
+        return {{{"name", "zstd"}, {"configuration", {{"level", GetCompressionLevel(compression)}, {"checksum", false}}}}};
+    }
+    return {{{"name", "gzip"}, {"configuration", {{"level", GetCompressionLevel(compression)}}}}};
+}
+
+void ValidateShardingOptions(const ShardingOptions& sharding, const std::vector<std::int64_t>& chunk_shape, FileType ft){
+    if (sharding.shard_shape.empty()) return;
+    if (ft != FileType::OmeZarrV3) {
+        throw std::invalid_argument("Sharding is only supported for Zarr v3");
+    }
+    if (sharding.shard_shape.size() != chunk_shape.size()) {
+        throw std::invalid_argument("shard_shape must have the same number of dimensions as chunk_shape");
+    }
+    for (std::size_t i = 0; i < chunk_shape.size(); ++i) {
+        if (chunk_shape[i] <= 0 || sharding.shard_shape[i] % chunk_shape[i] != 0) {
+            throw std::invalid_argument("shard_shape must be a multiple of chunk_shape in every dimension");
+        }
+    }
+    if (sharding.index_location != "start" && sharding.index_location != "end") {
+        throw std::invalid_argument("Invalid shard index_location \"" + sharding.index_location + "\". Supported values are start and end.");
+    }
+}
+
+std::size_t GetZarrV3TypeSize(const std::string& dtype){
+    if (dtype == "uint8" || dtype == "int8") return 1;
+    if (dtype == "uint16" || dtype == "int16") return 2;
+    if (dtype == "uint32" || dtype == "int32" || dtype == "float32") return 4;
+    return 8;
+}
+} // namespace
+
 tensorstore::Spec GetZarrSpecToWrite(   const std::string& filename,
                                         const std::vector<std::int64_t>& image_shape,
                                         const std::vector<std::int64_t>& chunk_shape,
                                         const std::string& dtype,
-                                        FileType ft){
+                                        FileType ft,
+                                        const CompressionOptions& compression,
+                                        const ShardingOptions& sharding){
+
+    ValidateCompressionOptions(compression);
+    ValidateShardingOptions(sharding, chunk_shape, ft);
+    const unsigned int num_threads = (compression.num_threads > 0) ? compression.num_threads : std::thread::hardware_concurrency();
 
     if (ft == FileType::OmeZarrV3) {
         // Zarr v3 spec
+        ::nlohmann::json::array_t codecs{{{"name", "bytes"}, {"configuration", {{"endian", "little"}}}}};
+        for (auto& codec : GetZarrV3CompressionCodecs(compression, GetZarrV3TypeSize(dtype))) {
+            codecs.push_back(std::move(codec));
+        }
+
+        // with sharding, the chunk grid is made of shards that hold chunk_shape inner chunks
+        auto grid_chunk_shape = chunk_shape;
+        if (!sharding.shard_shape.empty()) {
+            grid_chunk_shape = sharding.shard_shape;
+            ::nlohmann::json::array_t index_codecs{{{"name", "bytes"}, {"configuration", {{"endian", "little"}}}},
+                                                   {{"name", "crc32c"}}};
+            ::nlohmann::json sharding_codec{{"name", "sharding_indexed"},
+                                            {"configuration", {
+                                                {"chunk_shape", chunk_shape},
+                                                {"codecs", codecs},
+                                                {"index_codecs", index_codecs},
+                                                {"index_location", sharding.index_location}
+                                            }}};
+            codecs = ::nlohmann::json::array_t{std::move(sharding_codec)};
+        }
         return tensorstore::Spec::FromJson({{"driver", "zarr3"},
                                 {"kvstore", {{"driver", "file"},
                                              {"path", filename}}
                                 },
                                 {"context", {
                                   {"cache_pool", {{"total_bytes_limit", 1000000000}}},
-                                  {"data_copy_concurrency", {{"limit", std::thread::hardware_concurrency()}}},
+                                  {"data_copy_concurrency", {{"limit", num_threads}}},
                                   {"file_io_concurrency", {{"limit", std::thread::hardware_concurrency()}}},
                                 }},
                                 {"metadata", {
                                               {"shape", image_shape},
                                               {"chunk_grid", {
                                                   {"name", "regular"},
-                                                  {"configuration", {{"chunk_shape", chunk_shape}}}
+                                                  {"configuration", {{"chunk_shape", grid_chunk_shape}}}
                                               }},
                                               {"chunk_key_encoding", {{"name", "default"}}},
                                               {"data_type", dtype},
-                                              {"codecs", {{{"name", "bytes"}, {"configuration", {{"endian", "little"}}}}}}
+                                              {"codecs", codecs}
                                               },
                                 }}).value();
     } else {
         // Zarr v2 spec (existing)
         // valid values for dtype are subset of
         // https://google.github.io/tensorstore/spec.html#json-dtype
+        ::nlohmann::json metadata{
+                                  {"zarr_format", 2},
+                                  {"shape", image_shape},
+                                  {"chunks", chunk_shape},
+                                  {"dtype", dtype},
+                                 };
+        if (compression.codec != "") {
+            metadata["compressor"] = GetZarrV2Compressor(compression);
+        }
         return tensorstore::Spec::FromJson({{"driver", "zarr"},
                                 {"kvstore", {{"driver", "file"},
                                              {"path", filename}}
                                 },
                                 {"context", {
                                   {"cache_pool", {{"total_bytes_limit", 1000000000}}},
-                                  {"data_copy_concurrency", {{"limit", std::thread::hardware_concurrency()}}},
+                                  {"data_copy_concurrency", {{"limit", num_threads}}},
                                   {"file_io_concurrency", {{"limit", std::thread::hardware_concurrency()}}},
                                 }},
-                                {"metadata", {
-                                              {"zarr_format", 2},
-                                              {"shape", image_shape},
-                                              {"chunks", chunk_shape},
-                                              {"dtype", dtype},
-                                              },
-                                }}).value();
+                                {"metadata", metadata},
+                                }).value();
+    }
+}
+
+std::vector<MultiscaleLevel> GetZarrMultiscaleLevels(const std::string& filename, FileType ft){
+    std::vector<MultiscaleLevel> levels;
+    const auto attributes_path = std::filesystem::path(filename) / ((ft == FileType::OmeZarrV3) ? "zarr.json" : ".zattrs");
+    std::ifstream attributes_file(attributes_path);
+    if (!attributes_file) return levels;
+
+    auto attributes = ::nlohmann::json::parse(attributes_file, nullptr, false);
+    if (attributes.is_discarded() || !attributes.is_object()) return levels;
+    if (ft == FileType::OmeZarrV3) {
+        // NGFF 0.5 nests the metadata in an "ome" attribute
+        attributes = attributes.value("attributes", ::nlohmann::json::object());
+        if (attributes.contains("ome")) attributes = attributes["ome"];
+        if (!attributes.is_object()) return levels;
+    }
+
+    const auto multiscales = attributes.value("multiscales", ::nlohmann::json::array());
+    if (!multiscales.is_array() || multiscales.empty() || !multiscales[0].is_object()) return levels;
+
+    const auto datasets = multiscales[0].value("datasets", ::nlohmann::json::array());
+    if (!datasets.is_array()) return levels;
+    for (const auto& dataset : datasets) {
+        if (!dataset.is_object() || !dataset.contains("path") || !dataset["path"].is_string()) continue;
+
+        MultiscaleLevel level;
+        level.path = dataset["path"].get<std::string>();
+        const auto transforms = dataset.value("coordinateTransformations", ::nlohmann::json::array());
+        for (const auto& transform : transforms) {
+            if (!transform.is_object() || transform.value("type", "") != "scale") continue;
+            const auto scale = transform.value("scale", ::nlohmann::json::array());
+            if (!scale.is_array()) continue;
+            for (const auto& factor : scale) {
+                level.scale.push_back(factor.is_number() ? factor.get<double>() : 1.0);
+            }
+        }
+        levels.push_back(std::move(level));
+    }
+    return levels;
+}
+
+std::vector<MultiscaleLevel> GetOmeTiffLevels(const std::string& filename){
+    std::vector<MultiscaleLevel> levels;
+    TIFF *tiff_file = TIFFOpen(filename.c_str(), "r");
+    if (tiff_file == nullptr) return levels;
+
+    uint16_t num_sub_ifds = 0;
+    toff_t* sub_ifd_offsets = nullptr;
+    if (TIFFGetField(tiff_file, TIFFTAG_SUBIFD, &num_sub_ifds, &sub_ifd_offsets) != 0 && num_sub_ifds > 0) {
+        // the offsets belong to the first directory, which is left when reading a SubIFD
+        std::vector<toff_t> offsets(sub_ifd_offsets, sub_ifd_offsets + num_sub_ifds);
+        uint32_t full_width = 0, full_height = 0;
+        TIFFGetField(tiff_file, TIFFTAG_IMAGEWIDTH, &full_width);
+        TIFFGetField(tiff_file, TIFFTAG_IMAGELENGTH, &full_height);
+        levels.push_back({"0", {1.0, 1.0, 1.0, 1.0, 1.0}});
+
+        for (std::size_t i = 0; i < offsets.size(); ++i) {
+            uint32_t width = 0, height = 0;
+            if (TIFFSetSubDirectory(tiff_file, offsets[i]) == 0) break;
+            TIFFGetField(tiff_file, TIFFTAG_IMAGEWIDTH, &width);
+            TIFFGetField(tiff_file, TIFFTAG_IMAGELENGTH, &height);
+            if (width == 0 || height == 0) break;
+            levels.push_back({std::to_string(i+1), {1.0, 1.0, 1.0,
+                                                    static_cast<double>(full_height) / height,
+                                                    static_cast<double>(full_width) / width}});
+        }
     }
+    TIFFClose(tiff_file);
+    return levels;
 }
-} // ns bfiocpp
\ No newline at end of file
+} // ns bfiocpp
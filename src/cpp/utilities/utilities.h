@@ -6,6 +6,7 @@
 #include<cmath>
 #include <tuple>
 #include <optional>
+#include "tensorstore/context.h"
 #include "tensorstore/tensorstore.h"
 #include "tensorstore/spec.h"
 
@@ -13,10 +14,41 @@ namespace bfiocpp {
 
 enum class FileType {OmeTiff, OmeZarrV2, OmeZarrV3};
 
-tensorstore::Spec GetOmeTiffSpecToRead(const std::string& filename);
+// Chunk compression used by GetZarrSpecToWrite.
+struct CompressionOptions {
+    std::string codec = "";             // "" keeps the tensorstore default, or none, blosc, zstd, gzip
+    std::string blosc_cname = "lz4";    // lz4, lz4hc, blosclz, zstd, zlib
+    std::string shuffle = "shuffle";    // noshuffle, shuffle, bitshuffle (blosc only)
+    int level = -1;                     // codec specific default when negative
+    int num_threads = 0;                // encoding concurrency, hardware concurrency when 0
+};
+
+// Zarr v3 sharding used by GetZarrSpecToWrite. The chunk shape becomes the inner chunk
+// shape and the compression options apply to the inner chunks.
+struct ShardingOptions {
+    std::vector<std::int64_t> shard_shape;  // empty disables sharding
+    std::string index_location = "end";     // start or end
+};
+
+// A level of an NGFF multiscales group, path is relative to the group.
+struct MultiscaleLevel {
+    std::string path;
+    std::vector<double> scale;  // from the scale coordinateTransformation, empty if there is none
+};
+
+// 1 GB cache pool and 8 concurrent copies and file reads, for OME-TIFF readers and readers of
+// many files that share one context
+tensorstore::Context GetReadContext();
+
+// tiles_per_chunk is [Y, X] native tiles per chunk, empty keeps one tile per chunk. The spec has
+// no context of its own, so the cache and I/O limits come from the context it is opened with.
+tensorstore::Spec GetOmeTiffSpecToRead(const std::string& filename, int level = 0,
+                                       const std::vector<std::int64_t>& tiles_per_chunk = {});
 tensorstore::Spec GetZarrSpecToRead(const std::string& filename, FileType ft);
 
 uint16_t GetDataTypeCode (std::string_view type_name);
+// tensorstore dtype of a GetDataTypeCode code, throws std::invalid_argument for unknown codes
+tensorstore::DataType GetTensorStoreDataType(uint16_t data_type_code);
 std::string GetEncodedType(uint16_t data_type_code);
 std::string GetUTCString();
 std::string GetOmeXml(const std::string& file_path);
@@ -25,6 +57,14 @@ tensorstore::Spec GetZarrSpecToWrite(const std::string& filename,
                                     const std::vector<std::int64_t>& image_shape,
                                     const std::vector<std::int64_t>& chunk_shape,
                                     const std::string& dtype,
-                                    FileType ft);
+                                    FileType ft,
+                                    const CompressionOptions& compression = CompressionOptions(),
+                                    const ShardingOptions& sharding = ShardingOptions());
 std::string GetZarrV3DataType(uint16_t data_type_code);
+// Levels listed in the multiscales metadata of an OME-Zarr group (.zattrs for v2,
+// zarr.json for v3). Empty if filename is not a multiscales group, e.g. an array.
+std::vector<MultiscaleLevel> GetZarrMultiscaleLevels(const std::string& filename, FileType ft);
+// Resolution levels of an OME-TIFF pyramid stored in SubIFDs of the first IFD, path is the
+// level index. Empty if the file has no SubIFDs.
+std::vector<MultiscaleLevel> GetOmeTiffLevels(const std::string& filename);
 } // ns bfiocpp
\ No newline at end of file
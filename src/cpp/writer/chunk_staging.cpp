@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "chunk_staging.h"
+
+namespace bfiocpp {
+
+namespace {
+// Calls fn(row_index) for every row (all dimensions but the last) of a box of the given shape.
+template <typename Fn>
+void ForEachRow(const std::vector<std::int64_t>& shape, Fn&& fn){
+    const auto rank = shape.size();
+    for (auto extent : shape) {
+        if (extent <= 0) return;
+    }
+    std::vector<std::int64_t> index(rank, 0);
+    while (true) {
+        fn(index);
+        if (rank < 2) return;
+        // advance the row counter, last dimension is handled by the callback
+        auto d = static_cast<std::int64_t>(rank) - 2;
+        for (; d >= 0; --d) {
+            if (++index[d] < shape[d]) break;
+            index[d] = 0;
+        }
+        if (d < 0) return;
+    }
+}
+
+std::vector<std::int64_t> GetStrides(const std::vector<std::int64_t>& shape){
+    std::vector<std::int64_t> strides(shape.size(), 1);
+    for (auto d = static_cast<std::int64_t>(shape.size()) - 2; d >= 0; --d) {
+        strides[d] = strides[d+1] * shape[d+1];
+    }
+    return strides;
+}
+
+std::int64_t GetVolume(const std::vector<std::int64_t>& shape){
+    std::int64_t volume = 1;
+    for (auto extent : shape) volume *= extent;
+    return volume;
+}
+} // namespace
+
+void CopyBox(const std::uint8_t* src, const std::vector<std::int64_t>& src_origin, const std::vector<std::int64_t>& src_shape,
+             std::uint8_t* dst, const std::vector<std::int64_t>& dst_origin, const std::vector<std::int64_t>& dst_shape,
+             const std::vector<std::int64_t>& box_origin, const std::vector<std::int64_t>& box_shape,
+             std::size_t element_size){
+
+    const auto rank = box_shape.size();
+    const auto src_strides = GetStrides(src_shape);
+    const auto dst_strides = GetStrides(dst_shape);
+    const auto row_bytes = box_shape[rank-1] * element_size;
+
+    ForEachRow(box_shape, [&](const std::vector<std::int64_t>& index){
+        std::int64_t src_offset = 0, dst_offset = 0;
+        for (std::size_t d = 0; d < rank; ++d) {
+            const auto position = box_origin[d] + index[d];
+            src_offset += (position - src_origin[d]) * src_strides[d];
+            dst_offset += (position - dst_origin[d]) * dst_strides[d];
+        }
+        std::memcpy(dst + dst_offset*element_size, src + src_offset*element_size, row_bytes);
+    });
+}
+
+std::int64_t StagedChunk::NumElements() const {return GetVolume(shape);}
+
+bool StagedChunk::IsFullyWritten() const {
+    const auto num_elements = NumElements();
+    if (written_elements < num_elements) return false;
+
+    // regions may overlap, so check the actual coverage
+    const auto rank = shape.size();
+    const auto strides = GetStrides(shape);
+    std::vector<bool> covered(num_elements, false);
+    for (std::size_t i = 0; i < written_origins.size(); ++i) {
+        const auto& box_origin = written_origins[i];
+        const auto& box_shape = written_shapes[i];
+        ForEachRow(box_shape, [&](const std::vector<std::int64_t>& index){
+            std::int64_t offset = 0;
+            for (std::size_t d = 0; d < rank; ++d) {
+                offset += (box_origin[d] + index[d] - origin[d]) * strides[d];
+            }
+            std::fill_n(covered.begin() + offset, box_shape[rank-1], true);
+        });
+    }
+    return std::all_of(covered.begin(), covered.end(), [](bool c){return c;});
+}
+
+ChunkStagingBuffer::ChunkStagingBuffer(const std::vector<std::int64_t>& image_shape,
+                                       const std::vector<std::int64_t>& chunk_shape,
+                                       std::size_t element_size,
+                                       std::size_t max_bytes,
+                                       CommitFn commit):
+    _image_shape(image_shape),
+    _chunk_shape(chunk_shape),
+    _element_size(element_size),
+    _max_bytes(max_bytes),
+    _staged_bytes(0),
+    _commit(std::move(commit)) {
+
+    if (_image_shape.size() != _chunk_shape.size()) {
+        throw std::invalid_argument("image_shape and chunk_shape must have the same rank");
+    }
+    for (std::size_t d = 0; d < _image_shape.size(); ++d) {
+        if (_chunk_shape[d] <= 0) {
+            throw std::invalid_argument("chunk_shape must be positive");
+        }
+        _grid_shape.push_back((_image_shape[d] + _chunk_shape[d] - 1) / _chunk_shape[d]);
+    }
+}
+
+StagedChunk& ChunkStagingBuffer::GetChunk(const std::vector<std::int64_t>& grid_indices){
+    std::int64_t key = 0;
+    for (std::size_t d = 0; d < _grid_shape.size(); ++d) {
+        key = key*_grid_shape[d] + grid_indices[d];
+    }
+
+    auto it = _chunk_lookup.find(key);
+    if (it != _chunk_lookup.end()) {
+        // mark as most recently written
+        _chunks.splice(_chunks.end(), _chunks, it->second);
+        return it->second->second;
+    }
+
+    StagedChunk chunk;
+    for (std::size_t d = 0; d < _grid_shape.size(); ++d) {
+        auto chunk_origin = grid_indices[d] * _chunk_shape[d];
+        chunk.origin.push_back(chunk_origin);
+        chunk.shape.push_back(std::min(_chunk_shape[d], _image_shape[d] - chunk_origin));
+    }
+    const auto chunk_bytes = static_cast<std::size_t>(chunk.NumElements()) * _element_size;
+    Evict(chunk_bytes);
+
+    chunk.data.resize(chunk_bytes);
+    _staged_bytes += chunk_bytes;
+    _chunks.emplace_back(key, std::move(chunk));
+    _chunk_lookup.emplace(key, std::prev(_chunks.end()));
+    return _chunks.back().second;
+}
+
+void ChunkStagingBuffer::Evict(std::size_t bytes_needed){
+    while (!_chunks.empty() && _staged_bytes + bytes_needed > _max_bytes) {
+        auto [key, chunk] = std::move(_chunks.front());
+        _chunks.pop_front();
+        _chunk_lookup.erase(key);
+        _staged_bytes -= chunk.data.size();
+        _commit(std::move(chunk), false);
+    }
+}
+
+void ChunkStagingBuffer::Stage(const void* data, const std::vector<std::int64_t>& origin, const std::vector<std::int64_t>& shape){
+    const auto rank = _image_shape.size();
+    if (origin.size() != rank || shape.size() != rank) {
+        throw std::invalid_argument("staged region must have the same rank as the image");
+    }
+
+    std::vector<std::int64_t> first_chunk(rank), num_chunks(rank);
+    for (std::size_t d = 0; d < rank; ++d) {
+        if (shape[d] <= 0) return;
+        if (origin[d] < 0 || origin[d] + shape[d] > _image_shape[d]) {
+            throw std::out_of_range("staged region is outside of the image bounds");
+        }
+        first_chunk[d] = origin[d] / _chunk_shape[d];
+        num_chunks[d] = (origin[d] + shape[d] - 1) / _chunk_shape[d] - first_chunk[d] + 1;
+    }
+
+    const auto* src = static_cast<const std::uint8_t*>(data);
+    std::vector<std::int64_t> offset(rank, 0);
+    while (true) {
+        std::vector<std::int64_t> grid_indices(rank);
+        for (std::size_t d = 0; d < rank; ++d) grid_indices[d] = first_chunk[d] + offset[d];
+
+        auto& chunk = GetChunk(grid_indices);
+
+        std::vector<std::int64_t> box_origin(rank), box_shape(rank);
+        for (std::size_t d = 0; d < rank; ++d) {
+            box_origin[d] = std::max(origin[d], chunk.origin[d]);
+            box_shape[d] = std::min(origin[d] + shape[d], chunk.origin[d] + chunk.shape[d]) - box_origin[d];
+        }
+
+        CopyBox(src, origin, shape, chunk.data.data(), chunk.origin, chunk.shape, box_origin, box_shape, _element_size);
+        chunk.written_origins.push_back(box_origin);
+        chunk.written_shapes.push_back(box_shape);
+        chunk.written_elements += GetVolume(box_shape);
+
+        if (chunk.IsFullyWritten()) {
+            // chunk is at the back after GetChunk
+            auto [key, complete_chunk] = std::move(_chunks.back());
+            _chunks.pop_back();
+            _chunk_lookup.erase(key);
+            _staged_bytes -= complete_chunk.data.size();
+            _commit(std::move(complete_chunk), true);
+        }
+
+        auto d = static_cast<std::int64_t>(rank) - 1;
+        for (; d >= 0; --d) {
+            if (++offset[d] < num_chunks[d]) break;
+            offset[d] = 0;
+        }
+        if (d < 0) break;
+    }
+}
+
+void ChunkStagingBuffer::Flush(){
+    while (!_chunks.empty()) {
+        auto [key, chunk] = std::move(_chunks.front());
+        _chunks.pop_front();
+        _chunk_lookup.erase(key);
+        _staged_bytes -= chunk.data.size();
+        _commit(std::move(chunk), false);
+    }
+}
+
+} // ns bfiocpp
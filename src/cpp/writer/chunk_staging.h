@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace bfiocpp{
+
+// A chunk of the output image that is being assembled in memory.
+// All coordinates are in the index space of the output array.
+struct StagedChunk{
+    std::vector<std::int64_t> origin, shape;    // chunk box, clipped to the image bounds
+    std::vector<std::uint8_t> data;             // c_order buffer of the chunk box
+    std::vector<std::vector<std::int64_t>> written_origins, written_shapes; // regions written so far
+    std::int64_t written_elements = 0;          // sum over regions, may count overlaps twice
+
+    std::int64_t NumElements() const;
+    bool IsFullyWritten() const;
+};
+
+// Copies the box (box_origin, box_shape) from a c_order array (src_origin, src_shape)
+// into another c_order array (dst_origin, dst_shape). The box must lie within both.
+void CopyBox(const std::uint8_t* src, const std::vector<std::int64_t>& src_origin, const std::vector<std::int64_t>& src_shape,
+             std::uint8_t* dst, const std::vector<std::int64_t>& dst_origin, const std::vector<std::int64_t>& dst_shape,
+             const std::vector<std::int64_t>& box_origin, const std::vector<std::int64_t>& box_shape,
+             std::size_t element_size);
+
+// Assembles partial writes per chunk so that each chunk is handed to the commit
+// callback once, either when it is fully covered (complete = true) or when it has
+// to be evicted to stay under max_bytes (complete = false). For an incomplete
+// chunk only the regions listed in written_origins/written_shapes are valid.
+class ChunkStagingBuffer{
+public:
+    using CommitFn = std::function<void(StagedChunk&& chunk, bool complete)>;
+
+    ChunkStagingBuffer(const std::vector<std::int64_t>& image_shape,
+                       const std::vector<std::int64_t>& chunk_shape,
+                       std::size_t element_size,
+                       std::size_t max_bytes,
+                       CommitFn commit);
+
+    void Stage(const void* data, const std::vector<std::int64_t>& origin, const std::vector<std::int64_t>& shape);
+    // Hands every partially written chunk to the commit callback.
+    void Flush();
+    std::size_t StagedBytes() const {return _staged_bytes;}
+
+private:
+    std::vector<std::int64_t> _image_shape, _chunk_shape, _grid_shape;
+    std::size_t _element_size, _max_bytes, _staged_bytes;
+    CommitFn _commit;
+
+    // least recently written chunk is at the front
+    std::list<std::pair<std::int64_t, StagedChunk>> _chunks;
+    std::unordered_map<std::int64_t, std::list<std::pair<std::int64_t, StagedChunk>>::iterator> _chunk_lookup;
+
+    StagedChunk& GetChunk(const std::vector<std::int64_t>& grid_indices);
+    void Evict(std::size_t bytes_needed);
+};
+} // ns bfiocpp
@@ -0,0 +1,129 @@
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+#include "downsample.h"
+
+namespace bfiocpp {
+
+namespace {
+template <typename T>
+T Reduce(const T* values, int count, DownsampleMethod method){
+    switch (method) {
+        case DownsampleMethod::Mean: {
+            double sum = 0;
+            for (int i = 0; i < count; ++i) sum += static_cast<double>(values[i]);
+            if constexpr (std::is_integral_v<T>) {
+                return static_cast<T>(std::round(sum / count));
+            } else {
+                return static_cast<T>(sum / count);
+            }
+        }
+        case DownsampleMethod::Mode: {
+            // most frequent label, ties go to the first one in the block
+            T best = values[0];
+            int best_count = 0;
+            for (int i = 0; i < count; ++i) {
+                int value_count = 0;
+                for (int j = 0; j < count; ++j) {
+                    if (values[j] == values[i]) ++value_count;
+                }
+                if (value_count > best_count) {
+                    best = values[i];
+                    best_count = value_count;
+                }
+            }
+            return best;
+        }
+        default:
+            // nearest keeps the top left element of the block
+            return values[0];
+    }
+}
+
+template <typename T>
+void Downsample2xTyped(const T* src, const std::vector<std::int64_t>& src_shape, T* dst,
+                       int y_axis, int x_axis, DownsampleMethod method){
+
+    const auto rank = static_cast<int>(src_shape.size());
+    const auto dst_shape = GetDownsampledShape(src_shape, y_axis, x_axis);
+
+    std::vector<std::int64_t> src_strides(rank, 1);
+    for (int d = rank - 2; d >= 0; --d) {
+        src_strides[d] = src_strides[d+1] * src_shape[d+1];
+    }
+    std::int64_t num_elements = 1;
+    for (auto extent : dst_shape) {
+        if (extent <= 0) return;
+        num_elements *= extent;
+    }
+
+    std::vector<std::int64_t> index(rank, 0);
+    for (std::int64_t i = 0; i < num_elements; ++i) {
+        std::int64_t offset = 0;
+        for (int d = 0; d < rank; ++d) {
+            const auto position = (d == y_axis || d == x_axis) ? 2*index[d] : index[d];
+            offset += position * src_strides[d];
+        }
+        const int block_height = (2*index[y_axis] + 1 < src_shape[y_axis]) ? 2 : 1;
+        const int block_width = (2*index[x_axis] + 1 < src_shape[x_axis]) ? 2 : 1;
+
+        T values[4];
+        int count = 0;
+        for (int dy = 0; dy < block_height; ++dy) {
+            for (int dx = 0; dx < block_width; ++dx) {
+                values[count++] = src[offset + dy*src_strides[y_axis] + dx*src_strides[x_axis]];
+            }
+        }
+        dst[i] = Reduce(values, count, method);
+
+        for (int d = rank - 1; d >= 0; --d) {
+            if (++index[d] < dst_shape[d]) break;
+            index[d] = 0;
+        }
+    }
+}
+
+template <typename T>
+void Downsample2xAs(const std::uint8_t* src, const std::vector<std::int64_t>& src_shape, std::uint8_t* dst,
+                    int y_axis, int x_axis, DownsampleMethod method){
+    Downsample2xTyped(reinterpret_cast<const T*>(src), src_shape, reinterpret_cast<T*>(dst), y_axis, x_axis, method);
+}
+} // namespace
+
+DownsampleMethod GetDownsampleMethod(const std::string& method){
+    if (method == "mean") return DownsampleMethod::Mean;
+    if (method == "mode") return DownsampleMethod::Mode;
+    if (method == "nearest") return DownsampleMethod::Nearest;
+    throw std::invalid_argument("Invalid downsample method \"" + method + "\". Supported methods are mean, mode and nearest.");
+}
+
+std::vector<std::int64_t> GetDownsampledShape(const std::vector<std::int64_t>& shape, int y_axis, int x_axis){
+    auto downsampled_shape = shape;
+    downsampled_shape[y_axis] = (shape[y_axis] + 1) / 2;
+    downsampled_shape[x_axis] = (shape[x_axis] + 1) / 2;
+    return downsampled_shape;
+}
+
+void Downsample2x(const std::uint8_t* src, const std::vector<std::int64_t>& src_shape, std::uint8_t* dst,
+                  int y_axis, int x_axis, std::uint16_t dtype_code, DownsampleMethod method){
+
+    // use switch instead of template to match the dtype codes used by the reader and writer
+    switch(dtype_code)
+    {
+        case (1): Downsample2xAs<std::uint8_t>(src, src_shape, dst, y_axis, x_axis, method); break;
+        case (2): Downsample2xAs<std::uint16_t>(src, src_shape, dst, y_axis, x_axis, method); break;
+        case (4): Downsample2xAs<std::uint32_t>(src, src_shape, dst, y_axis, x_axis, method); break;
+        case (8): Downsample2xAs<std::uint64_t>(src, src_shape, dst, y_axis, x_axis, method); break;
+        case (16): Downsample2xAs<std::int8_t>(src, src_shape, dst, y_axis, x_axis, method); break;
+        case (32): Downsample2xAs<std::int16_t>(src, src_shape, dst, y_axis, x_axis, method); break;
+        case (64): Downsample2xAs<std::int32_t>(src, src_shape, dst, y_axis, x_axis, method); break;
+        case (128): Downsample2xAs<std::int64_t>(src, src_shape, dst, y_axis, x_axis, method); break;
+        case (256): Downsample2xAs<float>(src, src_shape, dst, y_axis, x_axis, method); break;
+        case (512): Downsample2xAs<double>(src, src_shape, dst, y_axis, x_axis, method); break;
+        default:
+            throw std::invalid_argument("Error downsampling image: unsupported data type");
+    }
+}
+
+} // ns bfiocpp
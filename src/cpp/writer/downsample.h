@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bfiocpp{
+
+enum class DownsampleMethod {Mean, Mode, Nearest};
+
+// Parses "mean", "mode" or "nearest", throws std::invalid_argument otherwise.
+DownsampleMethod GetDownsampleMethod(const std::string& method);
+
+// Shape of a box after downsampling by 2 along y_axis and x_axis.
+std::vector<std::int64_t> GetDownsampledShape(const std::vector<std::int64_t>& shape, int y_axis, int x_axis);
+
+// Downsamples a c_order buffer by 2 along y_axis and x_axis into dst, which must hold
+// GetDownsampledShape(src_shape) elements. Each output element is reduced from the
+// 2x2 block it covers; blocks on an odd edge use the remaining row/column only.
+// dtype_code follows GetDataTypeCode.
+void Downsample2x(const std::uint8_t* src, const std::vector<std::int64_t>& src_shape, std::uint8_t* dst,
+                  int y_axis, int x_axis, std::uint16_t dtype_code, DownsampleMethod method);
+} // ns bfiocpp
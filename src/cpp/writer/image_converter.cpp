@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+#include "tensorstore/array.h"
+#include "tensorstore/open.h"
+#include "tensorstore/index_space/dim_expression.h"
+#include "image_converter.h"
+#include "../reader/tsreader.h"
+
+namespace bfiocpp {
+
+namespace {
+constexpr const char* kJournalName = ".bfiocpp_convert_journal";
+
+// first line of the journal, a journal is only resumed if the plan is unchanged
+std::string GetJournalHeader(const std::vector<std::int64_t>& shape, const std::vector<std::int64_t>& chunk_shape,
+                             const std::vector<std::int64_t>& block_shape, const std::string& dtype, FileType file_type){
+    std::ostringstream header;
+    header << "bfiocpp-convert 2 " << static_cast<int>(file_type) << " " << dtype;
+    for (const auto* sizes : {&shape, &chunk_shape, &block_shape}) {
+        for (auto size : *sizes) header << " " << size;
+    }
+    return header.str();
+}
+
+// a block of whole destination chunks in flight
+struct BlockInFlight {
+    std::int64_t index, num_chunks;
+    std::size_t bytes;
+    tensorstore::SharedArray<void> data;
+    tensorstore::Future<void> future;   // read, then commit
+};
+} // namespace
+
+double ConversionReport::MegabytesPerSecond() const {
+    return seconds > 0 ? bytes_written / 1e6 / seconds : 0.0;
+}
+
+ConversionReport ConvertImage(TsReaderCPP& source, const std::string& output, const ConversionOptions& options,
+                              const std::function<void(const ConversionReport&)>& progress){
+    if (options.file_type == FileType::OmeTiff) {
+        throw std::invalid_argument("Error converting image: the output must be OME-Zarr");
+    }
+    const auto start_time = std::chrono::steady_clock::now();
+
+    const auto view = source.GetTensorStore();
+    const auto domain_shape = view.domain().shape();
+    const std::vector<std::int64_t> shape(domain_shape.begin(), domain_shape.end());
+    auto chunk_shape = options.chunk_shape.empty() ? std::vector<std::int64_t>{1, 1, 1, 1024, 1024} : options.chunk_shape;
+    if (chunk_shape.size() != 5 || std::any_of(chunk_shape.begin(), chunk_shape.end(), [](std::int64_t size) {return size <= 0;})) {
+        throw std::invalid_argument("Error converting image: chunk_shape must have 5 positive sizes (TCZYX)");
+    }
+    for (std::size_t d = 0; d < 5; ++d) chunk_shape[d] = std::min(chunk_shape[d], std::max<std::int64_t>(shape[d], 1));
+    auto block_shape = options.block_shape.empty() ? chunk_shape : options.block_shape;
+    if (block_shape.size() != 5) {
+        throw std::invalid_argument("Error converting image: block_shape must have 5 sizes (TCZYX)");
+    }
+    for (std::size_t d = 0; d < 5; ++d) {
+        block_shape[d] = std::min(block_shape[d], std::max<std::int64_t>(shape[d], 1));
+        // blocks cover whole chunks, so no chunk is written twice
+        if (block_shape[d] <= 0 || (block_shape[d] % chunk_shape[d] != 0 && block_shape[d] < shape[d])) {
+            throw std::invalid_argument("Error converting image: block_shape must be a multiple of chunk_shape");
+        }
+    }
+
+    const std::string dtype = view.dtype().name();
+    const auto dtype_code = GetDataTypeCode(dtype);
+    const auto encoded_dtype = (options.file_type == FileType::OmeZarrV3) ? GetZarrV3DataType(dtype_code) : GetEncodedType(dtype_code);
+
+    // the block grid in TCZYX order
+    std::vector<std::int64_t> grid_shape(5);
+    std::int64_t num_blocks = 1, num_chunks = 1;
+    for (std::size_t d = 0; d < 5; ++d) {
+        grid_shape[d] = (shape[d] + block_shape[d] - 1) / block_shape[d];
+        num_blocks *= grid_shape[d];
+        num_chunks *= (shape[d] + chunk_shape[d] - 1) / chunk_shape[d];
+    }
+    auto get_block_region = [&](std::int64_t index, std::vector<std::int64_t>& origin, std::vector<std::int64_t>& region_shape) {
+        std::int64_t chunks = 1;
+        origin.resize(5);
+        region_shape.resize(5);
+        for (int d = 4; d >= 0; --d) {
+            origin[d] = (index % grid_shape[d]) * block_shape[d];
+            region_shape[d] = std::min(block_shape[d], shape[d] - origin[d]);
+            chunks *= (region_shape[d] + chunk_shape[d] - 1) / chunk_shape[d];
+            index /= grid_shape[d];
+        }
+        return chunks;
+    };
+
+    // resume from the journal if it belongs to the same plan, otherwise start over
+    const auto journal_path = std::filesystem::path(output) / kJournalName;
+    const auto journal_header = GetJournalHeader(shape, chunk_shape, block_shape, dtype, options.file_type);
+    std::unordered_set<std::int64_t> completed;
+    bool resuming = false;
+    if (options.resume) {
+        std::ifstream journal(journal_path);
+        std::string header;
+        if (journal && std::getline(journal, header) && header == journal_header) {
+            resuming = true;
+            for (std::int64_t index; journal >> index;) completed.insert(index);
+        }
+    }
+
+    // opened directly rather than through TsWriterCPP, the journal needs the commit of every block
+    // and a resumed conversion opens the existing array instead of creating it
+    auto spec = GetZarrSpecToWrite(output, shape, chunk_shape, encoded_dtype, options.file_type, options.compression);
+    auto open_mode = resuming ? tensorstore::OpenMode::open : tensorstore::OpenMode::create | tensorstore::OpenMode::delete_existing;
+    auto destination_result = tensorstore::Open(spec, open_mode, tensorstore::ReadWriteMode::write).result();
+    if (!destination_result.ok()) {
+        throw std::runtime_error("Error opening " + output + " for writing: " + destination_result.status().ToString());
+    }
+    auto destination = std::move(destination_result).value();
+
+    std::ofstream journal(journal_path, resuming ? std::ios::app : std::ios::trunc);
+    if (!journal) {
+        throw std::runtime_error("Error writing the conversion journal " + journal_path.string());
+    }
+    if (!resuming) journal << journal_header << "\n" << std::flush;
+
+    ConversionReport report;
+    report.num_chunks = num_chunks;
+    std::vector<std::int64_t> origin, region_shape;
+    for (auto index : completed) report.chunks_skipped += get_block_region(index, origin, region_shape);
+
+    const std::size_t max_reads = std::max(1u, options.read_threads > 0 ? options.read_threads : std::thread::hardware_concurrency());
+    std::deque<BlockInFlight> reading, committing;
+    std::size_t bytes_in_flight = 0;
+    std::vector<std::string> errors;
+
+    // a read block goes on to be encoded and written, its buffer is held until the commit
+    auto start_write = [&]() {
+        auto block = std::move(reading.front());
+        reading.pop_front();
+        auto status = block.future.status();
+        if (!status.ok()) {
+            bytes_in_flight -= block.bytes;
+            errors.emplace_back("reading block " + std::to_string(block.index) + ": " + status.ToString());
+            return;
+        }
+        std::vector<std::int64_t> block_origin, block_region;
+        get_block_region(block.index, block_origin, block_region);
+        auto block_transform = (tensorstore::IdentityTransform(destination.domain()) |
+                                tensorstore::Dims(0, 1, 2, 3, 4).SizedInterval(block_origin, block_region)).value();
+        block.future = tensorstore::Write(block.data, destination | block_transform).commit_future;
+        committing.push_back(std::move(block));
+    };
+    auto finish_commit = [&]() {
+        auto block = std::move(committing.front());
+        committing.pop_front();
+        bytes_in_flight -= block.bytes;
+        auto status = block.future.status();
+        if (!status.ok()) {
+            errors.emplace_back("writing block " + std::to_string(block.index) + ": " + status.ToString());
+            return;
+        }
+        journal << block.index << "\n" << std::flush;
+        report.chunks_written += block.num_chunks;
+        report.bytes_written += static_cast<std::int64_t>(block.bytes);
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        if (progress) progress(report);
+    };
+    // frees the oldest buffer, returns false if nothing is in flight
+    auto drain_one = [&]() {
+        if (!committing.empty() && (reading.empty() || committing.front().future.ready())) {
+            finish_commit();
+        } else if (!reading.empty()) {
+            start_write();
+        } else {
+            return false;
+        }
+        return true;
+    };
+
+    for (std::int64_t index = 0; index < num_blocks && errors.empty(); ++index) {
+        if (completed.count(index)) continue;
+
+        const auto block_chunks = get_block_region(index, origin, region_shape);
+        std::size_t bytes = view.dtype().size();
+        for (auto size : region_shape) bytes *= size;
+
+        // hard memory cap, a block larger than the cap waits until nothing else is in flight
+        while (bytes_in_flight > 0 && bytes_in_flight + bytes > options.memory_limit && drain_one()) {}
+        // hand reads on to the writers as they finish, keeping at most max_reads in flight
+        while (!reading.empty() && (reading.size() >= max_reads || reading.front().future.ready())) start_write();
+        while (!committing.empty() && committing.front().future.ready()) finish_commit();
+
+        auto block_transform = (tensorstore::IdentityTransform(view.domain()) |
+                                tensorstore::Dims(0, 1, 2, 3, 4).SizedInterval(origin, region_shape)).value();
+        auto data = tensorstore::AllocateArray(region_shape, tensorstore::c_order, tensorstore::default_init, view.dtype());
+        auto read_future = tensorstore::Read(view | block_transform, data);
+        bytes_in_flight += bytes;
+        reading.push_back({index, block_chunks, bytes, std::move(data), std::move(read_future)});
+    }
+    while (drain_one()) {}
+    journal.close();
+
+    if (!errors.empty()) {
+        throw std::runtime_error("Error converting image, rerun with resume to continue: " + errors.front());
+    }
+    std::filesystem::remove(journal_path);
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    return report;
+}
+
+std::vector<std::int64_t> GetRechunkBlockShape(const std::vector<std::int64_t>& shape, const std::vector<std::int64_t>& source_chunk_shape,
+                                               const std::vector<std::int64_t>& target_chunk_shape, std::size_t element_size,
+                                               std::size_t max_block_bytes){
+    if (shape.size() != 5 || source_chunk_shape.size() != 5 || target_chunk_shape.size() != 5) {
+        throw std::invalid_argument("Error planning rechunk: shapes must have 5 sizes (TCZYX)");
+    }
+    // the smallest block aligned to both grids reads every source chunk once
+    std::vector<std::int64_t> block_shape(5);
+    for (std::size_t d = 0; d < 5; ++d) {
+        const auto source = std::max<std::int64_t>(source_chunk_shape[d], 1), target = std::max<std::int64_t>(target_chunk_shape[d], 1);
+        block_shape[d] = std::min(std::lcm(source, target), std::max<std::int64_t>(shape[d], 1));
+    }
+    auto block_bytes = [&]() {
+        std::size_t bytes = element_size;
+        for (auto size : block_shape) bytes *= static_cast<std::size_t>(size);
+        return bytes;
+    };
+    // otherwise shrink the dimension spanning the most target chunks, whole target chunks are
+    // kept so nothing is written twice, but source chunks straddling two blocks are read twice
+    while (block_bytes() > max_block_bytes) {
+        std::size_t widest = 5;
+        std::int64_t most_chunks = 1;
+        for (std::size_t d = 0; d < 5; ++d) {
+            const auto target = std::min(std::max<std::int64_t>(target_chunk_shape[d], 1), std::max<std::int64_t>(shape[d], 1));
+            const auto chunks = (block_shape[d] + target - 1) / target;
+            if (chunks > most_chunks) {
+                most_chunks = chunks;
+                widest = d;
+            }
+        }
+        if (widest == 5) break;
+        const auto target = std::max<std::int64_t>(target_chunk_shape[widest], 1);
+        block_shape[widest] = (most_chunks / 2) * target;
+    }
+    return block_shape;
+}
+
+ConversionReport RechunkImage(const std::string& input, FileType input_type, const std::string& axes_list,
+                              const std::string& output, const ConversionOptions& options,
+                              const std::function<void(const ConversionReport&)>& progress){
+    if (options.chunk_shape.size() != 5) {
+        throw std::invalid_argument("Error rechunking image: chunk_shape must have 5 sizes (TCZYX)");
+    }
+    // source chunks straddling a shrunken block are read again by the next block along the
+    // shrunken dimension, a cache as large as the block buffers keeps them decoded in between
+    const auto context = tensorstore::Context(tensorstore::Context::Spec::FromJson({
+                             {"cache_pool", {{"total_bytes_limit", options.memory_limit}}},
+                         }).value());
+    TsReaderCPP source(input, input_type, axes_list, {}, context);
+    const auto view = source.GetTensorStore();
+    const auto domain_shape = view.domain().shape();
+    const std::vector<std::int64_t> shape(domain_shape.begin(), domain_shape.end());
+    auto read_chunk_shape = view.chunk_layout().value().read_chunk_shape();
+    // dimensions the source does not have (length 1) have no chunk size
+    std::vector<std::int64_t> source_chunk_shape(5, 1);
+    for (std::size_t d = 0; d < 5; ++d) {
+        if (read_chunk_shape[d] > 0) source_chunk_shape[d] = read_chunk_shape[d];
+    }
+
+    auto rechunk_options = options;
+    // at least two blocks fit under the cap, so reads overlap writes
+    rechunk_options.block_shape = GetRechunkBlockShape(shape, source_chunk_shape, options.chunk_shape, view.dtype().size(),
+                                                       std::max<std::size_t>(options.memory_limit / 2, 1));
+    return ConvertImage(source, output, rechunk_options, progress);
+}
+
+} // ns bfiocpp
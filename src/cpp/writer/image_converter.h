@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../utilities/utilities.h"
+
+namespace bfiocpp{
+
+class TsReaderCPP;
+
+struct ConversionOptions {
+    FileType file_type = FileType::OmeZarrV2;           // OmeZarrV2 or OmeZarrV3
+    std::vector<std::int64_t> chunk_shape;              // TCZYX, empty for [1, 1, 1, 1024, 1024]
+    // TCZYX region read and written at once, a multiple of chunk_shape, empty for chunk_shape
+    std::vector<std::int64_t> block_shape;
+    CompressionOptions compression;                     // num_threads is the encoding pool
+    unsigned int read_threads = 0;                      // reads in flight, 0 for hardware concurrency
+    std::size_t memory_limit = std::size_t{1} << 30;    // bytes of block buffers in flight
+    // continue a conversion that was interrupted, blocks recorded in the journal are skipped
+    bool resume = false;
+};
+
+struct ConversionReport {
+    std::int64_t num_chunks = 0, chunks_written = 0, chunks_skipped = 0;
+    std::int64_t bytes_written = 0;     // uncompressed bytes of the chunks written
+    double seconds = 0;
+
+    double MegabytesPerSecond() const;
+};
+
+// Converts the current level of source to a TCZYX zarr array at output. Work is planned on the
+// destination chunk grid: every block of chunks is read from the source (which assembles it from the source
+// tiles on the reader's thread pool), then encoded and written on the pool of compression.num_threads.
+// Block buffers from the start of their read to the end of their commit never exceed memory_limit
+// (a single block larger than the limit is converted alone). Committed blocks are recorded in a
+// journal in the output directory, which is removed once the conversion is complete. progress is
+// called from the calling thread after every committed block.
+ConversionReport ConvertImage(TsReaderCPP& source, const std::string& output, const ConversionOptions& options = ConversionOptions(),
+                              const std::function<void(const ConversionReport&)>& progress = nullptr);
+
+// Block shape of a rechunk from source_chunk_shape to target_chunk_shape (TCZYX). Blocks are
+// aligned to both chunk grids if that fits max_block_bytes, so every source chunk is read once
+// and no intermediate copy is stored. Otherwise they are shrunk to fewer whole target chunks
+// along the dimensions spanning the most of them, and source chunks straddling two blocks are
+// read twice.
+std::vector<std::int64_t> GetRechunkBlockShape(const std::vector<std::int64_t>& shape, const std::vector<std::int64_t>& source_chunk_shape,
+                                               const std::vector<std::int64_t>& target_chunk_shape, std::size_t element_size,
+                                               std::size_t max_block_bytes);
+
+// ConvertImage of a zarr input to options.chunk_shape, with blocks from GetRechunkBlockShape
+// (options.block_shape is ignored). The format and codec of the output may differ from the input.
+// The input is opened with a chunk cache of options.memory_limit bytes, so source chunks that are
+// read twice are usually decoded once.
+ConversionReport RechunkImage(const std::string& input, FileType input_type, const std::string& axes_list,
+                              const std::string& output, const ConversionOptions& options,
+                              const std::function<void(const ConversionReport&)>& progress = nullptr);
+} // ns bfiocpp
@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include <zlib.h>
+#include <zstd.h>
+#include <nlohmann/json.hpp>
+
+#include "ometiff_writer.h"
+
+namespace bfiocpp {
+
+namespace {
+constexpr std::uint16_t kTiffShort = 3, kTiffLong = 4, kTiffAscii = 2, kTiffLong8 = 16;
+
+struct IfdEntry {
+    std::uint16_t tag, type;
+    std::uint64_t count;
+    std::uint64_t value;    // the value itself if it fits in 8 bytes, otherwise its file offset
+};
+
+void PutUint16(std::vector<std::uint8_t>& buffer, std::uint16_t value){
+    for (int i = 0; i < 2; ++i) buffer.push_back(static_cast<std::uint8_t>(value >> (8*i)));
+}
+
+void PutUint64(std::vector<std::uint8_t>& buffer, std::uint64_t value){
+    for (int i = 0; i < 8; ++i) buffer.push_back(static_cast<std::uint8_t>(value >> (8*i)));
+}
+
+// TIFF flavour of LZW: MSB first codes of 9 to 12 bits, widened one code early.
+std::vector<std::uint8_t> EncodeLzw(const std::uint8_t* data, std::size_t size){
+    constexpr std::uint32_t kClearCode = 256, kEndOfInformation = 257, kFirstCode = 258, kTableFull = 4094;
+
+    std::vector<std::uint8_t> output;
+    output.reserve(size / 2 + 16);
+    std::uint32_t bit_buffer = 0;
+    int bit_count = 0, code_width = 9;
+    auto put_code = [&](std::uint32_t code) {
+        bit_buffer = (bit_buffer << code_width) | code;
+        bit_count += code_width;
+        while (bit_count >= 8) {
+            output.push_back(static_cast<std::uint8_t>(bit_buffer >> (bit_count - 8)));
+            bit_count -= 8;
+        }
+    };
+
+    std::unordered_map<std::uint32_t, std::uint32_t> table;
+    table.reserve(kTableFull);
+    std::uint32_t next_code = kFirstCode;
+    // the decoder adds an entry for every code, widens once the next entry needs more
+    // bits and restarts when the table is full
+    auto add_entry = [&]() {
+        if (++next_code == kTableFull) {
+            put_code(kClearCode);
+            table.clear();
+            next_code = kFirstCode;
+            code_width = 9;
+        } else if (next_code > (1u << code_width) - 1) {
+            ++code_width;
+        }
+    };
+
+    put_code(kClearCode);
+    if (size > 0) {
+        std::uint32_t prefix = data[0];
+        for (std::size_t i = 1; i < size; ++i) {
+            const std::uint32_t key = (prefix << 8) | data[i];
+            auto it = table.find(key);
+            if (it != table.end()) {
+                prefix = it->second;
+                continue;
+            }
+            put_code(prefix);
+            table.emplace(key, next_code);
+            add_entry();
+            prefix = data[i];
+        }
+        put_code(prefix);
+        add_entry();
+    }
+    put_code(kEndOfInformation);
+    if (bit_count > 0) {
+        output.push_back(static_cast<std::uint8_t>(bit_buffer << (8 - bit_count)));
+    }
+    return output;
+}
+
+std::string EscapeXml(const std::string& text){
+    std::string escaped;
+    for (char ch : text) {
+        switch (ch) {
+            case '&': escaped += "&amp;"; break;
+            case '<': escaped += "&lt;"; break;
+            case '>': escaped += "&gt;"; break;
+            case '"': escaped += "&quot;"; break;
+            default: escaped += ch;
+        }
+    }
+    return escaped;
+}
+
+// (bits per sample, TIFF SampleFormat, OME pixel type)
+std::tuple<std::uint16_t, std::uint16_t, std::string> GetTiffSampleType(std::uint16_t dtype_code){
+    switch (dtype_code)
+    {
+        case (1): return {8, 1, "uint8"};
+        case (2): return {16, 1, "uint16"};
+        case (4): return {32, 1, "uint32"};
+        case (16): return {8, 2, "int8"};
+        case (32): return {16, 2, "int16"};
+        case (64): return {32, 2, "int32"};
+        case (256): return {32, 3, "float"};
+        case (512): return {64, 3, "double"};
+        default:
+            throw std::invalid_argument("OME-TIFF does not support 64 bit integer pixels");
+    }
+}
+} // namespace
+
+OmeTiffWriter::OmeTiffWriter(const std::string& fname,
+                             const std::vector<std::int64_t>& image_shape,
+                             std::int64_t tile_height,
+                             std::int64_t tile_width,
+                             std::uint16_t dtype_code,
+                             const CompressionOptions& compression,
+                             std::size_t max_pending_tiles):
+    _filename(fname),
+    _tile_height(tile_height),
+    _tile_width(tile_width),
+    _dtype_code(dtype_code),
+    _codec(compression.codec.empty() ? "deflate" : compression.codec),
+    _max_pending_tiles(std::max<std::size_t>(max_pending_tiles, 1)),
+    _file_size(0),
+    _pending_tiles(0),
+    _finalized(false) {
+
+    if (image_shape.size() != 5) {
+        throw std::invalid_argument("OME-TIFF images must have 5 dimensions (T, C, Z, Y, X)");
+    }
+    if (_tile_height <= 0 || _tile_width <= 0 || _tile_height % 16 != 0 || _tile_width % 16 != 0) {
+        throw std::invalid_argument("OME-TIFF tile sizes must be positive multiples of 16");
+    }
+    _num_tsteps = image_shape[0];
+    _num_channels = image_shape[1];
+    _num_layers = image_shape[2];
+    _image_height = image_shape[3];
+    _image_width = image_shape[4];
+    _tiles_down = (_image_height + _tile_height - 1) / _tile_height;
+    _tiles_across = (_image_width + _tile_width - 1) / _tile_width;
+
+    _element_size = std::get<0>(GetTiffSampleType(_dtype_code)) / 8;
+
+    if (_codec == "none") {
+        _tiff_compression = 1;
+        _level = 0;
+    } else if (_codec == "lzw") {
+        _tiff_compression = 5;
+        _level = 0;
+    } else if (_codec == "deflate") {
+        _tiff_compression = 8;
+        _level = (compression.level < 0) ? 6 : compression.level;
+    } else if (_codec == "zstd") {
+        _tiff_compression = 50000;
+        _level = (compression.level < 0) ? 3 : compression.level;
+    } else {
+        throw std::invalid_argument("Invalid OME-TIFF compression \"" + _codec + "\". Supported codecs are none, lzw, deflate and zstd.");
+    }
+    if (_level > (_codec == "zstd" ? 22 : 9)) {
+        throw std::invalid_argument("Invalid " + _codec + " compression level " + std::to_string(_level)
+                                    + ". Supported levels are 0 to " + std::string(_codec == "zstd" ? "22" : "9") + ".");
+    }
+
+    const unsigned int num_threads = (compression.num_threads > 0) ? compression.num_threads : std::thread::hardware_concurrency();
+    TENSORSTORE_CHECK_OK_AND_ASSIGN(_copy_concurrency,
+        tensorstore::Context::Default().GetResource<tensorstore::internal::DataCopyConcurrencyResource>(
+            ::nlohmann::json{{"limit", num_threads}}));
+
+    const auto num_tiles = static_cast<std::size_t>(_num_tsteps * _num_channels * _num_layers * _tiles_down * _tiles_across);
+    _tile_offsets.assign(num_tiles, 0);
+    _tile_byte_counts.assign(num_tiles, 0);
+    _tile_queued.assign(num_tiles, false);
+
+    _file.open(_filename, std::ios::binary | std::ios::trunc);
+    if (!_file) {
+        throw std::runtime_error("Error opening " + _filename + " for writing");
+    }
+
+    // BigTIFF header, the first IFD offset is filled in by Finalize()
+    std::vector<std::uint8_t> header{'I', 'I'};
+    PutUint16(header, 43);
+    PutUint16(header, 8);
+    PutUint16(header, 0);
+    PutUint64(header, 0);
+    AppendToFile(header.data(), header.size());
+}
+
+OmeTiffWriter::~OmeTiffWriter() {
+    // queued tasks reference this writer
+    std::unique_lock<std::mutex> lock(_mutex);
+    WaitForPendingTiles(0, lock);
+}
+
+std::vector<std::uint8_t> OmeTiffWriter::EncodeTile(const std::vector<std::uint8_t>& tile) const {
+    switch (_tiff_compression) {
+        case 5:
+            return EncodeLzw(tile.data(), tile.size());
+        case 8: {
+            uLongf encoded_size = compressBound(tile.size());
+            std::vector<std::uint8_t> encoded(encoded_size);
+            if (compress2(encoded.data(), &encoded_size, tile.data(), tile.size(), _level) != Z_OK) {
+                throw std::runtime_error("Error compressing tile with deflate");
+            }
+            encoded.resize(encoded_size);
+            return encoded;
+        }
+        case 50000: {
+            std::vector<std::uint8_t> encoded(ZSTD_compressBound(tile.size()));
+            const auto encoded_size = ZSTD_compress(encoded.data(), encoded.size(), tile.data(), tile.size(), _level);
+            if (ZSTD_isError(encoded_size)) {
+                throw std::runtime_error(std::string("Error compressing tile with zstd: ") + ZSTD_getErrorName(encoded_size));
+            }
+            encoded.resize(encoded_size);
+            return encoded;
+        }
+        default:
+            return tile;
+    }
+}
+
+std::uint64_t OmeTiffWriter::AppendToFile(const std::uint8_t* data, std::size_t size) {
+    const auto offset = _file_size;
+    _file.write(reinterpret_cast<const char*>(data), size);
+    if (!_file) {
+        _errors.emplace_back("Error writing to " + _filename);
+    }
+    _file_size += size;
+    return offset;
+}
+
+void OmeTiffWriter::WaitForPendingTiles(std::size_t max_remaining, std::unique_lock<std::mutex>& lock) {
+    _tile_done.wait(lock, [&]() {return _pending_tiles <= max_remaining;});
+}
+
+void OmeTiffWriter::WriteTile(std::int64_t t, std::int64_t c, std::int64_t z,
+                              std::int64_t tile_row, std::int64_t tile_col,
+                              const std::uint8_t* data, std::int64_t rows, std::int64_t cols) {
+
+    if (t < 0 || t >= _num_tsteps || c < 0 || c >= _num_channels || z < 0 || z >= _num_layers ||
+        tile_row < 0 || tile_row >= _tiles_down || tile_col < 0 || tile_col >= _tiles_across) {
+        throw std::out_of_range("Tile is outside of the image");
+    }
+    if (rows > _tile_height || cols > _tile_width) {
+        throw std::invalid_argument("Tile data is larger than the tile size");
+    }
+
+    // pad to a full tile, TIFF stores edge tiles at full size
+    auto tile = std::make_shared<std::vector<std::uint8_t>>(_tile_height * _tile_width * _element_size, 0);
+    for (std::int64_t row = 0; row < rows; ++row) {
+        std::memcpy(tile->data() + row*_tile_width*_element_size, data + row*cols*_element_size, cols*_element_size);
+    }
+
+    const auto plane = (t*_num_channels + c)*_num_layers + z;
+    const auto index = static_cast<std::size_t>((plane*_tiles_down + tile_row)*_tiles_across + tile_col);
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_finalized) {
+            throw std::runtime_error("Error writing tile: " + _filename + " is already finalized");
+        }
+        if (_tile_queued[index]) {
+            throw std::runtime_error("Error writing tile: tile (" + std::to_string(tile_row) + ", " + std::to_string(tile_col)
+                                     + ") of plane (t=" + std::to_string(t) + ", c=" + std::to_string(c) + ", z=" + std::to_string(z)
+                                     + ") was already written. OME-TIFF tiles can only be written once, write whole tiles or increase staging_bytes.");
+        }
+        _tile_queued[index] = true;
+        // backpressure: bound the memory held by uncompressed tiles
+        WaitForPendingTiles(_max_pending_tiles - 1, lock);
+        ++_pending_tiles;
+    }
+
+    _copy_concurrency->executor([this, index, tile]() {
+        std::vector<std::uint8_t> encoded;
+        std::string error;
+        try {
+            encoded = EncodeTile(*tile);
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (error.empty()) {
+            _tile_offsets[index] = AppendToFile(encoded.data(), encoded.size());
+            _tile_byte_counts[index] = encoded.size();
+        } else {
+            _errors.push_back(std::move(error));
+        }
+        --_pending_tiles;
+        _tile_done.notify_all();
+    });
+}
+
+void OmeTiffWriter::Wait() {
+    std::vector<std::string> errors;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        WaitForPendingTiles(0, lock);
+        errors.swap(_errors);
+    }
+    if (!errors.empty()) {
+        std::string message = "Error writing image: " + std::to_string(errors.size()) + " tile(s) failed";
+        for (const auto& error : errors) {
+            message += "\n  " + error;
+        }
+        throw std::runtime_error(message);
+    }
+}
+
+std::string OmeTiffWriter::GetOmeXml() const {
+    std::ostringstream xml;
+    xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        << "<OME xmlns=\"http://www.openmicroscopy.org/Schemas/OME/2016-06\""
+        << " xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\""
+        << " xsi:schemaLocation=\"http://www.openmicroscopy.org/Schemas/OME/2016-06 http://www.openmicroscopy.org/Schemas/OME/2016-06/ome.xsd\">"
+        << "<Image ID=\"Image:0\" Name=\"" << EscapeXml(std::filesystem::path(_filename).filename().string()) << "\">"
+        << "<Pixels ID=\"Pixels:0\" DimensionOrder=\"XYZCT\" Type=\"" << std::get<2>(GetTiffSampleType(_dtype_code)) << "\""
+        << " SizeX=\"" << _image_width << "\" SizeY=\"" << _image_height << "\" SizeZ=\"" << _num_layers << "\""
+        << " SizeC=\"" << _num_channels << "\" SizeT=\"" << _num_tsteps << "\" BigEndian=\"false\">";
+    for (std::int64_t c = 0; c < _num_channels; ++c) {
+        xml << "<Channel ID=\"Channel:0:" << c << "\" SamplesPerPixel=\"1\"><LightPath/></Channel>";
+    }
+    // one IFD per plane in XYZCT order
+    for (std::int64_t t = 0; t < _num_tsteps; ++t) {
+        for (std::int64_t c = 0; c < _num_channels; ++c) {
+            for (std::int64_t z = 0; z < _num_layers; ++z) {
+                xml << "<TiffData IFD=\"" << (t*_num_channels + c)*_num_layers + z << "\" FirstZ=\"" << z
+                    << "\" FirstC=\"" << c << "\" FirstT=\"" << t << "\" PlaneCount=\"1\"/>";
+            }
+        }
+    }
+    xml << "</Pixels></Image></OME>";
+    return xml.str();
+}
+
+void OmeTiffWriter::Finalize() {
+    Wait();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_finalized) return;
+    _finalized = true;
+
+    // tiles that were never written share a single zero tile
+    if (std::find(_tile_queued.begin(), _tile_queued.end(), false) != _tile_queued.end()) {
+        const auto encoded = EncodeTile(std::vector<std::uint8_t>(_tile_height * _tile_width * _element_size, 0));
+        const auto offset = AppendToFile(encoded.data(), encoded.size());
+        for (std::size_t i = 0; i < _tile_queued.size(); ++i) {
+            if (_tile_queued[i]) continue;
+            _tile_offsets[i] = offset;
+            _tile_byte_counts[i] = encoded.size();
+        }
+    }
+
+    const auto [bits_per_sample, sample_format, ome_type] = GetTiffSampleType(_dtype_code);
+    const auto ome_xml = GetOmeXml();
+    const auto tiles_per_plane = static_cast<std::size_t>(_tiles_down * _tiles_across);
+    const auto num_planes = static_cast<std::size_t>(_num_tsteps * _num_channels * _num_layers);
+
+    // offset of the pointer to the next IFD, the first one is in the header
+    std::uint64_t next_ifd_pointer = 8;
+    for (std::size_t plane = 0; plane < num_planes; ++plane) {
+        // values that do not fit in an entry are written before the IFD
+        auto append_values = [&](const std::uint64_t* values, std::size_t count) -> std::uint64_t {
+            if (count == 1) return values[0];
+            std::vector<std::uint8_t> buffer;
+            buffer.reserve(count * 8);
+            for (std::size_t i = 0; i < count; ++i) PutUint64(buffer, values[i]);
+            return AppendToFile(buffer.data(), buffer.size());
+        };
+        const auto tile_offsets = append_values(_tile_offsets.data() + plane*tiles_per_plane, tiles_per_plane);
+        const auto tile_byte_counts = append_values(_tile_byte_counts.data() + plane*tiles_per_plane, tiles_per_plane);
+
+        std::vector<IfdEntry> entries{
+            {256, kTiffLong, 1, static_cast<std::uint64_t>(_image_width)},
+            {257, kTiffLong, 1, static_cast<std::uint64_t>(_image_height)},
+            {258, kTiffShort, 1, bits_per_sample},
+            {259, kTiffShort, 1, _tiff_compression},
+            {262, kTiffShort, 1, 1},    // BlackIsZero
+            {277, kTiffShort, 1, 1},    // SamplesPerPixel
+            {284, kTiffShort, 1, 1},    // PlanarConfiguration, chunky
+            {322, kTiffLong, 1, static_cast<std::uint64_t>(_tile_width)},
+            {323, kTiffLong, 1, static_cast<std::uint64_t>(_tile_height)},
+            {324, kTiffLong8, tiles_per_plane, tile_offsets},
+            {325, kTiffLong8, tiles_per_plane, tile_byte_counts},
+            {339, kTiffShort, 1, sample_format},
+        };
+        if (plane == 0) {
+            // entries are sorted by tag
+            const auto description = AppendToFile(reinterpret_cast<const std::uint8_t*>(ome_xml.c_str()), ome_xml.size() + 1);
+            entries.insert(entries.begin() + 5, IfdEntry{270, kTiffAscii, ome_xml.size() + 1, description});
+        }
+
+        std::vector<std::uint8_t> ifd;
+        // IFDs start on a word boundary
+        if (_file_size % 2 != 0) ifd.push_back(0);
+        const auto ifd_offset = _file_size + ifd.size();
+        PutUint64(ifd, entries.size());
+        for (const auto& entry : entries) {
+            PutUint16(ifd, entry.tag);
+            PutUint16(ifd, entry.type);
+            PutUint64(ifd, entry.count);
+            PutUint64(ifd, entry.value);
+        }
+        PutUint64(ifd, 0);
+        AppendToFile(ifd.data(), ifd.size());
+
+        // link the IFD from the header or the previous IFD
+        std::vector<std::uint8_t> pointer;
+        PutUint64(pointer, ifd_offset);
+        _file.seekp(next_ifd_pointer);
+        _file.write(reinterpret_cast<const char*>(pointer.data()), pointer.size());
+        _file.seekp(_file_size);
+        next_ifd_pointer = ifd_offset + 8 + entries.size()*20;
+    }
+
+    _file.close();
+    if (!_file) {
+        _errors.emplace_back("Error writing to " + _filename);
+    }
+    if (!_errors.empty()) {
+        throw std::runtime_error("Error writing image: " + _errors.front());
+    }
+}
+
+} // ns bfiocpp
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "tensorstore/context.h"
+#include "tensorstore/internal/data_copy_concurrency_resource.h"
+#include "../utilities/utilities.h"
+
+namespace bfiocpp{
+
+// Writes a tiled BigTIFF with OME-XML metadata. Tiles are compressed in parallel on the
+// data copy concurrency pool and appended to the file in the order they finish, the
+// IFDs (one per plane, XYZCT order) and the OME-XML are written by Finalize().
+class OmeTiffWriter{
+public:
+    // image_shape is (T, C, Z, Y, X), tile sizes must be multiples of 16.
+    // compression.codec is "" or deflate (default), none, lzw or zstd.
+    OmeTiffWriter(const std::string& fname,
+                  const std::vector<std::int64_t>& image_shape,
+                  std::int64_t tile_height,
+                  std::int64_t tile_width,
+                  std::uint16_t dtype_code,
+                  const CompressionOptions& compression,
+                  std::size_t max_pending_tiles);
+    ~OmeTiffWriter();
+
+    std::size_t ElementSize() const {return _element_size;}
+
+    // Queues a tile for compression. data is a rows x cols c_order buffer with
+    // rows <= tile_height and cols <= tile_width, tiles on the image edge are padded
+    // with zeros. Every tile can only be written once.
+    void WriteTile(std::int64_t t, std::int64_t c, std::int64_t z,
+                   std::int64_t tile_row, std::int64_t tile_col,
+                   const std::uint8_t* data, std::int64_t rows, std::int64_t cols);
+    // Waits for all queued tiles and throws std::runtime_error if any of them failed.
+    void Wait();
+    // Writes tiles that were never written as zeros, the IFDs and the OME-XML.
+    void Finalize();
+
+private:
+    std::string _filename;
+    std::int64_t _num_tsteps, _num_channels, _num_layers, _image_height, _image_width;
+    std::int64_t _tile_height, _tile_width, _tiles_across, _tiles_down;
+    std::uint16_t _dtype_code;
+    std::size_t _element_size;
+    std::uint16_t _tiff_compression;
+    std::string _codec;
+    int _level;
+    std::size_t _max_pending_tiles;
+
+    tensorstore::Context::Resource<tensorstore::internal::DataCopyConcurrencyResource> _copy_concurrency;
+
+    // guards the output stream and everything below
+    std::mutex _mutex;
+    std::condition_variable _tile_done;
+    std::ofstream _file;
+    std::uint64_t _file_size;
+    std::vector<std::uint64_t> _tile_offsets, _tile_byte_counts;
+    std::vector<bool> _tile_queued;
+    std::size_t _pending_tiles;
+    std::vector<std::string> _errors;
+    bool _finalized;
+
+    std::vector<std::uint8_t> EncodeTile(const std::vector<std::uint8_t>& tile) const;
+    std::uint64_t AppendToFile(const std::uint8_t* data, std::size_t size);
+    void WaitForPendingTiles(std::size_t max_remaining, std::unique_lock<std::mutex>& lock);
+    std::string GetOmeXml() const;
+};
+} // ns bfiocpp
@@ -1,8 +1,16 @@
 #include <string>
+#include <stdexcept>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <numeric>
 
 #include "tensorstore/array.h"
 #include "tensorstore/open.h"
 #include "tensorstore/index_space/dim_expression.h"
+#include <nlohmann/json.hpp>
 
 #include "tswriter.h"
 #include "../utilities/utilities.h"
@@ -16,23 +24,47 @@ TsWriterCPP::TsWriterCPP(
     const std::vector<std::int64_t>& chunk_shape,
     const std::string& dtype_str,
     const std::string& dimension_order,
-    FileType file_type
+    FileType file_type,
+    std::size_t max_pending_writes,
+    std::size_t staging_bytes,
+    const CompressionOptions& compression,
+    const ShardingOptions& sharding,
+    const PyramidOptions& pyramid
   ): _filename(fname),
+     _dimension_order(dimension_order),
+     _file_type(file_type),
      _image_shape(image_shape),
      _chunk_shape(chunk_shape),
-     _dtype_code(GetDataTypeCode(dtype_str)) {
+     _dtype_code(GetDataTypeCode(dtype_str)),
+     _max_pending_writes(max_pending_writes),
+     _pyramid(pyramid),
+     _downsample_method(GetDownsampleMethod(pyramid.method)) {
+
+    if (_pyramid.num_levels < 1) {
+        throw std::invalid_argument("Number of pyramid levels must be at least 1");
+    }
 
     // Use appropriate dtype encoding based on file type
     std::string encoded_dtype = (file_type == FileType::OmeZarrV3)
         ? GetZarrV3DataType(_dtype_code)
         : GetEncodedType(_dtype_code);
 
-    TENSORSTORE_CHECK_OK_AND_ASSIGN(_source, tensorstore::Open(
-        GetZarrSpecToWrite(_filename, _image_shape, _chunk_shape, encoded_dtype, file_type),
-        tensorstore::OpenMode::create |
-        tensorstore::OpenMode::delete_existing,
-        tensorstore::ReadWriteMode::write).result()
-    );
+    // a pyramid is a multiscale group with level 0 at fname/0, incomplete chunks are read back on Close()
+    const bool is_pyramid = _pyramid.num_levels > 1;
+    const auto read_write_mode = is_pyramid ? tensorstore::ReadWriteMode::read_write : tensorstore::ReadWriteMode::write;
+
+    if (file_type != FileType::OmeTiff) {
+        auto source = tensorstore::Open(
+            GetZarrSpecToWrite(is_pyramid ? _filename + "/0" : _filename, _image_shape, _chunk_shape, encoded_dtype, file_type, compression, sharding),
+            tensorstore::OpenMode::create |
+            tensorstore::OpenMode::delete_existing,
+            read_write_mode).result();
+        if (!source.ok()) {
+            throw std::runtime_error("Error creating " + _filename + ": " + source.status().ToString());
+        }
+        _source = *std::move(source);
+        _levels.push_back(_source);
+    }
 
     if (dimension_order.size() < 2 || dimension_order.size() > 5) {
         throw std::invalid_argument("Invalid dimension_order \"" + dimension_order 
@@ -72,145 +104,532 @@ TsWriterCPP::TsWriterCPP(
 
     position = dimension_order.find("Z");
     if (position != std::string::npos) _z_index.emplace(position);
-}
 
-void TsWriterCPP::WriteImageData(
-    const py::array& py_image,
-    const Seq& rows,
-    const Seq& cols,
-    const std::optional<Seq>& layers,
-    const std::optional<Seq>& channels,
-    const std::optional<Seq>& tsteps) {
+    if (file_type == FileType::OmeTiff) {
+        if (is_pyramid || !sharding.shard_shape.empty()) {
+            throw std::invalid_argument("Pyramids and sharding are only supported for OME-Zarr");
+        }
+        if (_y_index > _x_index) {
+            throw std::invalid_argument("OME-TIFF writing requires Y before X in dimension_order");
+        }
 
-    std::vector<std::int64_t> shape;
+        auto get_size = [this](const std::optional<int>& index) {return index.has_value() ? _image_shape[index.value()] : std::int64_t{1};};
+        _tiff_writer = std::make_unique<OmeTiffWriter>(
+            _filename,
+            std::vector<std::int64_t>{get_size(_t_index), get_size(_c_index), get_size(_z_index), _image_shape[_y_index], _image_shape[_x_index]},
+            _chunk_shape[_y_index], _chunk_shape[_x_index], _dtype_code, compression, max_pending_writes);
+
+        // a tile is compressed once, so every write goes through staging and only whole
+        // tiles are committed before Close()
+        std::vector<std::int64_t> tile_shape(_image_shape.size(), 1);
+        tile_shape[_y_index] = _chunk_shape[_y_index];
+        tile_shape[_x_index] = _chunk_shape[_x_index];
+        _staging.push_back(std::make_unique<ChunkStagingBuffer>(
+            _image_shape, tile_shape, _tiff_writer->ElementSize(),
+            staging_bytes > 0 ? staging_bytes : std::numeric_limits<std::size_t>::max(),
+            [this](StagedChunk&& chunk, bool complete) {
+                auto get_origin = [&chunk](const std::optional<int>& index) {return index.has_value() ? chunk.origin[index.value()] : std::int64_t{0};};
+                _tiff_writer->WriteTile(get_origin(_t_index), get_origin(_c_index), get_origin(_z_index),
+                                        chunk.origin[_y_index] / _chunk_shape[_y_index], chunk.origin[_x_index] / _chunk_shape[_x_index],
+                                        chunk.data.data(), chunk.shape[_y_index], chunk.shape[_x_index]);
+            }));
+        return;
+    }
+
+    // a shard is stored as a single object, so assemble whole shards
+    const auto& staging_chunk_shape = sharding.shard_shape.empty() ? _chunk_shape : sharding.shard_shape;
 
-    auto output_transform = tensorstore::IdentityTransform(_source.domain());
+    if (is_pyramid) {
+        // levels are built from complete staged chunks, so staging is always on
+        if (staging_bytes == 0) staging_bytes = std::size_t{256} << 20;
 
-    if (_t_index.has_value() && tsteps.has_value()) {
-        output_transform = (std::move(output_transform) | tensorstore::Dims(_t_index.value()).ClosedInterval(tsteps.value().Start(), tsteps.value().Stop())).value();
-        shape.emplace_back(tsteps.value().Stop() - tsteps.value().Start()+1);
+        // 2x2 blocks must not straddle chunks
+        for (auto index : {_y_index, _x_index}) {
+            if (staging_chunk_shape[index] % 2 != 0 && staging_chunk_shape[index] < _image_shape[index]) {
+                throw std::invalid_argument("Pyramid generation requires even chunk sizes in Y and X");
+            }
+        }
+
+        auto level_shape = _image_shape;
+        for (int level = 1; level < _pyramid.num_levels; ++level) {
+            level_shape = GetDownsampledShape(level_shape, _y_index, _x_index);
+            auto level_source = tensorstore::Open(
+                GetZarrSpecToWrite(_filename + "/" + std::to_string(level), level_shape, _chunk_shape, encoded_dtype, file_type, compression, sharding),
+                tensorstore::OpenMode::create |
+                tensorstore::OpenMode::delete_existing,
+                read_write_mode).result();
+            if (!level_source.ok()) {
+                throw std::runtime_error("Error creating level " + std::to_string(level) + " of " + _filename + ": " + level_source.status().ToString());
+            }
+            _levels.push_back(*std::move(level_source));
+        }
+        _incomplete_chunks.resize(_levels.size());
     }
 
-    if (_c_index.has_value() && channels.has_value()) {
-        output_transform = (std::move(output_transform) | tensorstore::Dims(_c_index.value()).ClosedInterval(channels.value().Start(), channels.value().Stop())).value();
-        shape.emplace_back(channels.value().Stop() - channels.value().Start()+1);
+    if (staging_bytes > 0) {
+        for (std::size_t level = 0; level < _levels.size(); ++level) {
+            std::vector<std::int64_t> level_shape(_levels[level].domain().shape().begin(), _levels[level].domain().shape().end());
+            _staging.push_back(std::make_unique<ChunkStagingBuffer>(
+                level_shape, staging_chunk_shape, _source.dtype().size(), staging_bytes,
+                [this, level](StagedChunk&& chunk, bool complete) {CommitStagedChunk(level, std::move(chunk), complete);}));
+        }
     }
+}
+
+WriteFuture::WriteFuture(tensorstore::Future<void> commit_future): _commit_future(std::move(commit_future)) {}
+
+bool WriteFuture::Ready() const {return _commit_future.null() || _commit_future.ready();}
 
-    if (_z_index.has_value() && layers.has_value()) {
-        output_transform = (std::move(output_transform) | tensorstore::Dims(_z_index.value()).ClosedInterval(layers.value().Start(), layers.value().Stop())).value();
-        shape.emplace_back(layers.value().Stop() - layers.value().Start()+1);
+void WriteFuture::Wait() const {
+    if (_commit_future.null()) return;
+    auto status = _commit_future.status();
+    if (!status.ok()) {
+        throw std::runtime_error("Error writing image: " + status.ToString());
     }
+}
 
-    output_transform = (std::move(output_transform) | tensorstore::Dims(_y_index).ClosedInterval(rows.Start(), rows.Stop()) |
-                                                      tensorstore::Dims(_x_index).ClosedInterval(cols.Start(), cols.Stop())).value();
+tensorstore::IndexTransform<> TsWriterCPP::GetWriteRegion(
+    const Seq& rows,
+    const Seq& cols,
+    const std::optional<Seq>& layers,
+    const std::optional<Seq>& channels,
+    const std::optional<Seq>& tsteps,
+    std::vector<std::int64_t>& shape) const {
+
+    shape.clear();
+    // _source is not opened for OME-TIFF, its domain is the image shape either way
+    const std::vector<tensorstore::Index> image_shape(_image_shape.begin(), _image_shape.end());
+    tensorstore::IndexTransform<> output_transform = _tiff_writer
+        ? tensorstore::IdentityTransform(tensorstore::span<const tensorstore::Index>(image_shape))
+        : tensorstore::IdentityTransform(_source.domain());
+
+    auto restrict_to = [&](tensorstore::DimensionIndex index, const Seq& range) {
+        auto restricted = std::move(output_transform) | tensorstore::Dims(index).ClosedInterval(range.Start(), range.Stop());
+        if (!restricted.ok()) {
+            throw std::out_of_range("Error writing image: region is outside the image: " + restricted.status().ToString());
+        }
+        output_transform = *std::move(restricted);
+        shape.emplace_back(range.Stop() - range.Start()+1);
+    };
 
+    if (_t_index.has_value() && tsteps.has_value()) restrict_to(_t_index.value(), tsteps.value());
+    if (_c_index.has_value() && channels.has_value()) restrict_to(_c_index.value(), channels.value());
+    if (_z_index.has_value() && layers.has_value()) restrict_to(_z_index.value(), layers.value());
+    restrict_to(_y_index, rows);
+    restrict_to(_x_index, cols);
+    return output_transform;
+}
 
+void TsWriterCPP::CheckImageData(const py::array& py_image, const std::vector<std::int64_t>& shape) const {
+    // staging and IssueWrite read py_image as a flat buffer of the writer dtype
+    const auto dtype_name = py::str(py_image.dtype()).cast<std::string>();
+    if (bfiocpp::GetDataTypeCode(dtype_name) != _dtype_code ||
+        static_cast<std::size_t>(py_image.itemsize()) != GetTensorStoreDataType(_dtype_code).size()) {
+        throw std::invalid_argument("Error writing image: array dtype " + dtype_name + " does not match the writer");
+    }
+    if (py_image.size() != std::accumulate(shape.begin(), shape.end(), std::int64_t{1}, std::multiplies<std::int64_t>())) {
+        throw std::invalid_argument("Error writing image: array size does not match the region");
+    }
+    if (!(py_image.flags() & py::array::c_style)) {
+        throw std::invalid_argument("Error writing image: array must be c contiguous");
+    }
+}
 
-    shape.emplace_back(rows.Stop() - rows.Start()+1);
-    shape.emplace_back(cols.Stop() - cols.Start()+1);
+tensorstore::WriteFutures TsWriterCPP::IssueWrite(
+    const py::array& py_image,
+    const tensorstore::IndexTransform<>& output_transform,
+    const std::vector<std::int64_t>& shape) {
 
     // use switch instead of template to avoid creating functions for each datatype
     switch(_dtype_code)
     {
         case (1): {
             auto data_array = tensorstore::Array(py_image.unchecked<std::uint8_t, 1>().data(0), shape, tensorstore::c_order);
-
-            // Write data array to TensorStore
-            auto write_result = tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform).result();
-
-            if (!write_result.ok()) {
-                std::cerr << "Error writing image: " << write_result.status() << std::endl;
-            }
-
-            break;
+            return tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform);
         }
         case (2): {
             auto data_array = tensorstore::Array(py_image.unchecked<std::uint16_t, 1>().data(0), shape, tensorstore::c_order);
-
-            auto write_result = tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform).result();
-            if (!write_result.ok()) {
-                std::cerr << "Error writing image: " << write_result.status() << std::endl;
-            }
-            break;
+            return tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform);
         }
         case (4): {
             auto data_array = tensorstore::Array(py_image.unchecked<std::uint32_t, 1>().data(0), shape, tensorstore::c_order);
-
-            auto write_result = tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform).result();
-            if (!write_result.ok()) {
-                std::cerr << "Error writing image: " << write_result.status() << std::endl;
-            }
-            break;
+            return tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform);
         }
         case (8): {
             auto data_array = tensorstore::Array(py_image.unchecked<std::uint64_t, 1>().data(0), shape, tensorstore::c_order);
-
-            auto write_result = tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform).result();
-            if (!write_result.ok()) {
-                std::cerr << "Error writing image: " << write_result.status() << std::endl;
-            }
-            break;
+            return tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform);
         }
         case (16): {
             auto data_array = tensorstore::Array(py_image.unchecked<std::int8_t, 1>().data(0), shape, tensorstore::c_order);
-
-            auto write_result = tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform).result();
-            if (!write_result.ok()) {
-                std::cerr << "Error writing image: " << write_result.status() << std::endl;
-            }
-            break;
+            return tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform);
         }
         case (32): {
             auto data_array = tensorstore::Array(py_image.unchecked<std::int16_t, 1>().data(0), shape, tensorstore::c_order);
-
-            auto write_result = tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform).result();
-            if (!write_result.ok()) {
-                std::cerr << "Error writing image: " << write_result.status() << std::endl;
-            }
-            break;
+            return tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform);
         }
         case (64): {
             auto data_array = tensorstore::Array(py_image.unchecked<std::int32_t, 1>().data(0), shape, tensorstore::c_order);
-
-            auto write_result = tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform).result();
-            if (!write_result.ok()) {
-                std::cerr << "Error writing image: " << write_result.status() << std::endl;
-            }
-            break;
+            return tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform);
         }
         case (128): {
             auto data_array = tensorstore::Array(py_image.unchecked<std::int64_t, 1>().data(0), shape, tensorstore::c_order);
-
-            // Write data array to TensorStore
-            auto write_result = tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform).result();
-            if (!write_result.ok()) {
-                std::cerr << "Error writing image: " << write_result.status() << std::endl;
-            }
-            break;
+            return tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform);
         }
         case (256): {
             auto data_array = tensorstore::Array(py_image.unchecked<float, 1>().data(0), shape, tensorstore::c_order);
-
-            auto write_result = tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform).result();
-            if (!write_result.ok()) {
-                std::cerr << "Error writing image: " << write_result.status() << std::endl;
-            }
-            break;
+            return tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform);
         }
         case (512): {
             auto data_array = tensorstore::Array(py_image.unchecked<double, 1>().data(0), shape, tensorstore::c_order);
-
-            auto write_result = tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform).result();
-            if (!write_result.ok()) {
-                std::cerr << "Error writing image: " << write_result.status() << std::endl;
-            }
-            break;
+            return tensorstore::Write(tensorstore::UnownedToShared(data_array), _source | output_transform);
         }
         default: {
             // should not be reached
-            std::cerr << "Error writing image: unsupported data type" << std::endl;
+            throw std::invalid_argument("Error writing image: unsupported data type");
+        }
+    }
+}
+
+bool TsWriterCPP::GetStagingRegion(
+    const Seq& rows,
+    const Seq& cols,
+    const std::optional<Seq>& layers,
+    const std::optional<Seq>& channels,
+    const std::optional<Seq>& tsteps,
+    std::vector<std::int64_t>& origin,
+    std::vector<std::int64_t>& shape) const {
+
+    const auto rank = _image_shape.size();
+    origin.assign(rank, 0);
+    shape.assign(_image_shape.begin(), _image_shape.end());
+    std::vector<bool> has_range(rank, false);
+
+    auto set_range = [&](int index, const Seq& seq) {
+        origin[index] = seq.Start();
+        shape[index] = seq.Stop() - seq.Start() + 1;
+        has_range[index] = true;
+    };
+    if (_t_index.has_value() && tsteps.has_value()) set_range(_t_index.value(), tsteps.value());
+    if (_c_index.has_value() && channels.has_value()) set_range(_c_index.value(), channels.value());
+    if (_z_index.has_value() && layers.has_value()) set_range(_z_index.value(), layers.value());
+    set_range(_y_index, rows);
+    set_range(_x_index, cols);
+
+    // dimensions without a range are broadcast by tensorstore, staging only handles singleton ones
+    for (std::size_t d = 0; d < rank; ++d) {
+        if (!has_range[d] && _image_shape[d] != 1) return false;
+    }
+    return true;
+}
+
+void TsWriterCPP::WriteBuffer(std::size_t level, std::shared_ptr<std::vector<std::uint8_t>> buffer, const std::vector<std::int64_t>& origin, const std::vector<std::int64_t>& shape) {
+    const auto& store = _levels[level];
+    auto output_transform = tensorstore::IdentityTransform(store.domain());
+    for (std::size_t d = 0; d < origin.size(); ++d) {
+        output_transform = (std::move(output_transform) | tensorstore::Dims(static_cast<tensorstore::DimensionIndex>(d)).SizedInterval(origin[d], shape[d])).value();
+    }
+
+    // the array shares ownership of the buffer, so there is no need to wait for the copy
+    auto data_pointer = std::shared_ptr<const void>(buffer, buffer->data());
+    auto data_array = tensorstore::Array(tensorstore::SharedElementPointer<const void>(std::move(data_pointer), _source.dtype()), shape, tensorstore::c_order);
+    auto write_futures = tensorstore::Write(std::move(data_array), store | output_transform);
+    TrackPendingWrite(std::move(write_futures.commit_future));
+}
+
+void TsWriterCPP::CommitStagedChunk(std::size_t level, StagedChunk&& chunk, bool complete) {
+    if (level + 1 < _levels.size()) {
+        if (complete) {
+            DownsampleToNextLevel(level, chunk.data.data(), chunk.origin, chunk.shape);
+        } else {
+            _incomplete_chunks[level].emplace(chunk.origin, chunk.shape);
+        }
+    }
+
+    if (complete) {
+        auto buffer = std::make_shared<std::vector<std::uint8_t>>(std::move(chunk.data));
+        WriteBuffer(level, std::move(buffer), chunk.origin, chunk.shape);
+        return;
+    }
+
+    // evicted before it was fully covered, only write back the regions that hold data
+    const auto element_size = _source.dtype().size();
+    for (std::size_t i = 0; i < chunk.written_origins.size(); ++i) {
+        const auto& box_origin = chunk.written_origins[i];
+        const auto& box_shape = chunk.written_shapes[i];
+        std::int64_t num_elements = 1;
+        for (auto extent : box_shape) num_elements *= extent;
+
+        auto buffer = std::make_shared<std::vector<std::uint8_t>>(num_elements * element_size);
+        CopyBox(chunk.data.data(), chunk.origin, chunk.shape, buffer->data(), box_origin, box_shape,
+                box_origin, box_shape, element_size);
+        WriteBuffer(level, std::move(buffer), box_origin, box_shape);
+    }
+}
+
+void TsWriterCPP::DownsampleToNextLevel(std::size_t level, const std::uint8_t* data, const std::vector<std::int64_t>& origin, const std::vector<std::int64_t>& shape) {
+    auto downsampled_origin = origin;
+    downsampled_origin[_y_index] /= 2;
+    downsampled_origin[_x_index] /= 2;
+    const auto downsampled_shape = GetDownsampledShape(shape, _y_index, _x_index);
+
+    std::int64_t num_elements = 1;
+    for (auto extent : downsampled_shape) num_elements *= extent;
+    std::vector<std::uint8_t> buffer(num_elements * _source.dtype().size());
+    Downsample2x(data, shape, buffer.data(), _y_index, _x_index, _dtype_code, _downsample_method);
+
+    // completes the next level chunk by chunk, which cascades further down
+    _staging[level+1]->Stage(buffer.data(), downsampled_origin, downsampled_shape);
+}
+
+void TsWriterCPP::DownsampleIncompleteChunks() {
+    std::lock_guard<std::mutex> lock(_staging_mutex);
+    for (std::size_t level = 0; level + 1 < _levels.size(); ++level) {
+        _staging[level]->Flush();
+        // incomplete chunks are read back, so everything written to this level must be committed
+        WaitForPendingWrites(0);
+
+        for (const auto& [origin, shape] : _incomplete_chunks[level]) {
+            auto input_transform = tensorstore::IdentityTransform(_levels[level].domain());
+            for (std::size_t d = 0; d < origin.size(); ++d) {
+                input_transform = (std::move(input_transform) | tensorstore::Dims(static_cast<tensorstore::DimensionIndex>(d)).SizedInterval(origin[d], shape[d])).value();
+            }
+            auto chunk_data = tensorstore::Read<tensorstore::zero_origin>(_levels[level] | input_transform).result();
+            if (!chunk_data.ok()) {
+                throw std::runtime_error("Error building pyramid level " + std::to_string(level+1) + ": " + chunk_data.status().ToString());
+            }
+            DownsampleToNextLevel(level, static_cast<const std::uint8_t*>(chunk_data->data()), origin, shape);
+        }
+        _incomplete_chunks[level].clear();
+    }
+}
+
+void TsWriterCPP::WriteMultiscalesMetadata() const {
+    ::nlohmann::json::array_t axes;
+    for (char dimension : _dimension_order) {
+        const auto type = (dimension == 'T') ? "time" : (dimension == 'C') ? "channel" : "space";
+        axes.push_back({{"name", std::string(1, static_cast<char>(std::tolower(dimension)))}, {"type", type}});
+    }
+
+    ::nlohmann::json::array_t datasets;
+    for (std::size_t level = 0; level < _levels.size(); ++level) {
+        std::vector<double> scale(_image_shape.size(), 1.0);
+        scale[_y_index] = scale[_x_index] = static_cast<double>(std::int64_t{1} << level);
+        datasets.push_back({{"path", std::to_string(level)},
+                            {"coordinateTransformations", ::nlohmann::json::array({{{"type", "scale"}, {"scale", scale}}})}});
+    }
+
+    ::nlohmann::json multiscale{{"name", std::filesystem::path(_filename).filename().string()},
+                                {"axes", axes},
+                                {"datasets", datasets},
+                                {"type", _pyramid.method}};
+
+    auto write_json = [this](const std::string& name, const ::nlohmann::json& content) {
+        std::ofstream file(std::filesystem::path(_filename) / name);
+        file << content.dump(4);
+        if (!file) {
+            throw std::runtime_error("Error writing multiscales metadata to " + _filename + "/" + name);
+        }
+    };
+
+    std::filesystem::create_directories(_filename);
+    if (_file_type == FileType::OmeZarrV3) {
+        // NGFF 0.5
+        write_json("zarr.json", {{"zarr_format", 3},
+                                 {"node_type", "group"},
+                                 {"attributes", {{"ome", {{"version", "0.5"}, {"multiscales", ::nlohmann::json::array({multiscale})}}}}}});
+    } else {
+        // NGFF 0.4
+        multiscale["version"] = "0.4";
+        write_json(".zgroup", {{"zarr_format", 2}});
+        write_json(".zattrs", {{"multiscales", ::nlohmann::json::array({multiscale})}});
+    }
+}
+
+void TsWriterCPP::TrackPendingWrite(tensorstore::Future<void> commit_future) {
+    // backpressure: make room before adding a new write
+    WaitForPendingWrites(_max_pending_writes > 0 ? _max_pending_writes - 1 : 0);
+    std::lock_guard<std::mutex> lock(_pending_writes_mutex);
+    _pending_writes.push_back(std::move(commit_future));
+}
+
+void TsWriterCPP::RecordWriteError(const absl::Status& status) {
+    std::lock_guard<std::mutex> lock(_pending_writes_mutex);
+    _write_errors.emplace_back(status.ToString());
+}
+
+void TsWriterCPP::WaitForPendingWrites(std::size_t max_remaining) {
+    while (true) {
+        tensorstore::Future<void> oldest;
+        {
+            std::lock_guard<std::mutex> lock(_pending_writes_mutex);
+            if (_pending_writes.size() <= max_remaining) return;
+            oldest = std::move(_pending_writes.front());
+            _pending_writes.pop_front();
+        }
+        auto status = oldest.status();
+        if (!status.ok()) RecordWriteError(status);
+    }
+}
+
+void TsWriterCPP::WriteImageData(
+    const py::array& py_image,
+    const Seq& rows,
+    const Seq& cols,
+    const std::optional<Seq>& layers,
+    const std::optional<Seq>& channels,
+    const std::optional<Seq>& tsteps) {
+
+    // also checks the region before anything is staged
+    std::vector<std::int64_t> shape;
+    auto output_transform = GetWriteRegion(rows, cols, layers, channels, tsteps, shape);
+    CheckImageData(py_image, shape);
+
+    std::vector<std::int64_t> staging_origin, staging_shape;
+    if (!_staging.empty() && GetStagingRegion(rows, cols, layers, channels, tsteps, staging_origin, staging_shape)) {
+        std::lock_guard<std::mutex> lock(_staging_mutex);
+        _staging[0]->Stage(py_image.data(), staging_origin, staging_shape);
+        return;
+    }
+    if (_levels.size() > 1 || _tiff_writer) {
+        throw std::invalid_argument("Pyramid generation and OME-TIFF writing require a range for every dimension with more than one element");
+    }
+
+    auto write_status = IssueWrite(py_image, output_transform, shape).commit_future.status();
+    if (!write_status.ok()) {
+        throw std::runtime_error("Error writing image: " + write_status.ToString());
+    }
+}
+
+std::shared_ptr<WriteFuture> TsWriterCPP::WriteImageDataAsync(
+    const py::array& py_image,
+    const Seq& rows,
+    const Seq& cols,
+    const std::optional<Seq>& layers,
+    const std::optional<Seq>& channels,
+    const std::optional<Seq>& tsteps) {
+
+    std::vector<std::int64_t> shape;
+    auto output_transform = GetWriteRegion(rows, cols, layers, channels, tsteps, shape);
+    CheckImageData(py_image, shape);
+
+    std::vector<std::int64_t> staging_origin, staging_shape;
+    if (!_staging.empty() && GetStagingRegion(rows, cols, layers, channels, tsteps, staging_origin, staging_shape)) {
+        // staged data is committed per chunk, so the returned future is already done and
+        // errors are reported by Flush()
+        std::lock_guard<std::mutex> lock(_staging_mutex);
+        _staging[0]->Stage(py_image.data(), staging_origin, staging_shape);
+        return std::make_shared<WriteFuture>(tensorstore::Future<void>{});
+    }
+    if (_levels.size() > 1 || _tiff_writer) {
+        throw std::invalid_argument("Pyramid generation and OME-TIFF writing require a range for every dimension with more than one element");
+    }
+
+    // backpressure: make room before issuing a new write
+    WaitForPendingWrites(_max_pending_writes > 0 ? _max_pending_writes - 1 : 0);
+
+    auto write_futures = IssueWrite(py_image, output_transform, shape);
+
+    // py_image is only borrowed, so it must be fully copied before returning
+    auto copy_status = write_futures.copy_future.status();
+    if (!copy_status.ok()) {
+        throw std::runtime_error("Error writing image: " + copy_status.ToString());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_pending_writes_mutex);
+        _pending_writes.push_back(write_futures.commit_future);
+    }
+    return std::make_shared<WriteFuture>(std::move(write_futures.commit_future));
+}
+
+void TsWriterCPP::WriteArray(
+    const tensorstore::SharedArray<const void>& data,
+    const Seq& rows,
+    const Seq& cols,
+    const std::optional<Seq>& layers,
+    const std::optional<Seq>& channels,
+    const std::optional<Seq>& tsteps) {
+
+    if (bfiocpp::GetDataTypeCode(data.dtype().name()) != _dtype_code) {
+        throw std::invalid_argument("Error writing image: array dtype " + std::string(data.dtype().name()) + " does not match the writer");
+    }
+    std::vector<std::int64_t> shape;
+    auto output_transform = GetWriteRegion(rows, cols, layers, channels, tsteps, shape);
+    if (data.num_elements() != std::accumulate(shape.begin(), shape.end(), std::int64_t{1}, std::multiplies<std::int64_t>())) {
+        throw std::invalid_argument("Error writing image: array size does not match the region");
+    }
+
+    std::vector<std::int64_t> staging_origin, staging_shape;
+    if (!_staging.empty() && GetStagingRegion(rows, cols, layers, channels, tsteps, staging_origin, staging_shape)) {
+        std::lock_guard<std::mutex> lock(_staging_mutex);
+        _staging[0]->Stage(data.data(), staging_origin, staging_shape);
+        return;
+    }
+    if (_levels.size() > 1 || _tiff_writer) {
+        throw std::invalid_argument("Pyramid generation and OME-TIFF writing require a range for every dimension with more than one element");
+    }
+
+    auto data_array = tensorstore::Array(data.element_pointer(), shape, tensorstore::c_order);
+    auto write_futures = tensorstore::Write(std::move(data_array), _source | output_transform);
+    TrackPendingWrite(std::move(write_futures.commit_future));
+}
+
+std::uint16_t TsWriterCPP::GetDataTypeCode() const {return _dtype_code;}
+
+std::pair<std::int64_t, std::int64_t> TsWriterCPP::GetChunkShapeYX() const {
+    return {_chunk_shape[_y_index], _chunk_shape[_x_index]};
+}
+
+void TsWriterCPP::Flush() {
+    if (_tiff_writer) {
+        // partial tiles cannot be rewritten, so they stay staged until Close()
+        _tiff_writer->Wait();
+        return;
+    }
+
+    {
+        // levels in order, so chunks downsampled from a flushed level are flushed too
+        std::lock_guard<std::mutex> lock(_staging_mutex);
+        for (auto& staging : _staging) staging->Flush();
+    }
+    WaitForPendingWrites(0);
+
+    std::vector<std::string> errors;
+    {
+        std::lock_guard<std::mutex> lock(_pending_writes_mutex);
+        errors.swap(_write_errors);
+    }
+    if (!errors.empty()) {
+        std::string message = "Error writing image: " + std::to_string(errors.size()) + " write(s) failed";
+        for (const auto& error : errors) {
+            message += "\n  " + error;
+        }
+        throw std::runtime_error(message);
+    }
+}
+
+void TsWriterCPP::Close() {
+    // a failed close cannot be redone, staged chunks and write errors are already consumed
+    if (_close_error) throw std::runtime_error(*_close_error);
+    if (_closed) return;
+
+    try {
+        if (_tiff_writer) {
+            {
+                std::lock_guard<std::mutex> lock(_staging_mutex);
+                _staging[0]->Flush();
+            }
+            _tiff_writer->Finalize();
+        } else {
+            if (_levels.size() > 1) DownsampleIncompleteChunks();
+            Flush();
+            if (_levels.size() > 1) WriteMultiscalesMetadata();
         }
+    } catch (const std::exception& e) {
+        _close_error = e.what();
+        throw;
     }
+    _closed = true;
 }
 
 } // end ns bfiocpp
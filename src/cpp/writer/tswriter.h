@@ -2,16 +2,42 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include "tensorstore/tensorstore.h"
 #include "../utilities/sequence.h"
 #include "../utilities/utilities.h"
+#include "chunk_staging.h"
+#include "downsample.h"
+#include "ometiff_writer.h"
 #include <pybind11/numpy.h>
 
 namespace py = pybind11;
 
 namespace bfiocpp{
 
+// Handle to the commit of a single asynchronous write.
+class WriteFuture{
+public:
+    explicit WriteFuture(tensorstore::Future<void> commit_future);
+    bool Ready() const;
+    // blocks until the write is committed, throws std::runtime_error on failure
+    void Wait() const;
+
+private:
+    tensorstore::Future<void> _commit_future;
+};
+
+// Downsampled levels maintained while writing. With num_levels > 1 the output is an
+// OME-Zarr multiscale group with one array per level, each level halving Y and X.
+struct PyramidOptions {
+    int num_levels = 1;
+    std::string method = "mean";    // mean, mode (labels) or nearest
+};
+
 class TsWriterCPP{
 public:
     TsWriterCPP (
@@ -20,23 +46,62 @@ public:
         const std::vector<std::int64_t>& chunk_shape,
         const std::string& dtype_str,
         const std::string& dimension_order,
-        FileType file_type = FileType::OmeZarrV2
+        FileType file_type = FileType::OmeZarrV2,
+        std::size_t max_pending_writes = 16,
+        std::size_t staging_bytes = 0,
+        const CompressionOptions& compression = CompressionOptions(),
+        const ShardingOptions& sharding = ShardingOptions(),
+        const PyramidOptions& pyramid = PyramidOptions()
     );
 
     void WriteImageData (
-        const py::array& py_image, 
-        const Seq& rows, 
-        const Seq& cols, 
-        const std::optional<Seq>& layers, 
-        const std::optional<Seq>& channels, 
+        const py::array& py_image,
+        const Seq& rows,
+        const Seq& cols,
+        const std::optional<Seq>& layers,
+        const std::optional<Seq>& channels,
         const std::optional<Seq>& tsteps
     );
 
+    // Returns once py_image has been copied out; the commit to storage continues
+    // in the background. At most _max_pending_writes commits are kept in flight.
+    // A staged write returns a future that is already done, its errors are thrown by Flush().
+    std::shared_ptr<WriteFuture> WriteImageDataAsync (
+        const py::array& py_image,
+        const Seq& rows,
+        const Seq& cols,
+        const std::optional<Seq>& layers,
+        const std::optional<Seq>& channels,
+        const std::optional<Seq>& tsteps
+    );
+
+    // Writes a c_order array of the writer dtype without Python objects, so it can be called
+    // from worker threads. The write is tracked like WriteImageDataAsync and data is kept
+    // alive until it is committed.
+    void WriteArray (
+        const tensorstore::SharedArray<const void>& data,
+        const Seq& rows,
+        const Seq& cols,
+        const std::optional<Seq>& layers,
+        const std::optional<Seq>& channels,
+        const std::optional<Seq>& tsteps
+    );
+    std::uint16_t GetDataTypeCode() const;
+    // (Y, X) chunk shape, the tile shape for OME-TIFF
+    std::pair<std::int64_t, std::int64_t> GetChunkShapeYX() const;
+
+    // Commits all staged chunks, waits for all pending commits and throws if any of them failed.
+    void Flush();
+    // Flushes and, for a pyramid, completes the downsampled levels and writes the multiscales metadata.
+    // If it throws, every later call throws the same error.
+    void Close();
+
 private:
-    std::string _filename;
+    std::string _filename, _dimension_order;
+    FileType _file_type;
 
     std::vector<std::int64_t> _image_shape, _chunk_shape;
-    
+
     uint16_t _dtype_code;
 
     tensorstore::TensorStore<void, -1, tensorstore::ReadWriteMode::dynamic> _source;
@@ -44,6 +109,62 @@ private:
     std::optional<int>_z_index, _c_index, _t_index;
     int _x_index, _y_index;
 
+    std::size_t _max_pending_writes;
+    std::deque<tensorstore::Future<void>> _pending_writes;
+    std::vector<std::string> _write_errors;
+    std::mutex _pending_writes_mutex;
+
+    // assembles unaligned writes per chunk for each level, empty when staging is disabled
+    std::vector<std::unique_ptr<ChunkStagingBuffer>> _staging;
+    std::mutex _staging_mutex;
+
+    // level 0 is _source, every further level is downsampled by 2 in Y and X
+    std::vector<tensorstore::TensorStore<void, -1, tensorstore::ReadWriteMode::dynamic>> _levels;
+    PyramidOptions _pyramid;
+    DownsampleMethod _downsample_method;
+    // chunks per level that were committed before being fully written (origin -> shape),
+    // they are downsampled from storage on Close()
+    std::vector<std::map<std::vector<std::int64_t>, std::vector<std::int64_t>>> _incomplete_chunks;
+    bool _closed = false;
+    std::optional<std::string> _close_error;
+
+    // set for FileType::OmeTiff, which bypasses tensorstore and _levels
+    std::unique_ptr<OmeTiffWriter> _tiff_writer;
+
+    // transform of a region of _source and the c_order shape of its data, throws
+    // std::out_of_range if the region is not inside the image
+    tensorstore::IndexTransform<> GetWriteRegion (
+        const Seq& rows,
+        const Seq& cols,
+        const std::optional<Seq>& layers,
+        const std::optional<Seq>& channels,
+        const std::optional<Seq>& tsteps,
+        std::vector<std::int64_t>& shape
+    ) const;
+    // throws std::invalid_argument unless py_image is a c_order array of the writer dtype
+    // with one element per element of shape
+    void CheckImageData(const py::array& py_image, const std::vector<std::int64_t>& shape) const;
+    tensorstore::WriteFutures IssueWrite (
+        const py::array& py_image,
+        const tensorstore::IndexTransform<>& output_transform,
+        const std::vector<std::int64_t>& shape
+    );
+    bool GetStagingRegion (
+        const Seq& rows,
+        const Seq& cols,
+        const std::optional<Seq>& layers,
+        const std::optional<Seq>& channels,
+        const std::optional<Seq>& tsteps,
+        std::vector<std::int64_t>& origin,
+        std::vector<std::int64_t>& shape
+    ) const;
+    void CommitStagedChunk(std::size_t level, StagedChunk&& chunk, bool complete);
+    void WriteBuffer(std::size_t level, std::shared_ptr<std::vector<std::uint8_t>> buffer, const std::vector<std::int64_t>& origin, const std::vector<std::int64_t>& shape);
+    void DownsampleToNextLevel(std::size_t level, const std::uint8_t* data, const std::vector<std::int64_t>& origin, const std::vector<std::int64_t>& shape);
+    void DownsampleIncompleteChunks();
+    void WriteMultiscalesMetadata() const;
+    void TrackPendingWrite(tensorstore::Future<void> commit_future);
+    void RecordWriteError(const absl::Status& status);
+    void WaitForPendingWrites(std::size_t max_remaining);
 };
 }
-
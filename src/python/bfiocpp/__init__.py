@@ -1,5 +1,18 @@
-from .tsreader import TSReader, Seq, FileType, get_ome_xml  # NOQA: F401
-from .tswriter import TSWriter  # NOQA: F401
+from .tsreader import (  # NOQA: F401
+    TSReader,
+    TSArray,
+    Seq,
+    FileType,
+    get_ome_xml,
+    get_tile_kernel_names,
+    get_thumbnails,
+    open_readers,
+    probe_image,
+    probe_images,
+)
+from .tswriter import TSWriter, WriteFuture  # NOQA: F401
+from .sampler import PatchSampler  # NOQA: F401
+from .convert import convert, rechunk  # NOQA: F401
 from . import _version
 
 __version__ = _version.get_versions()["version"]
@@ -0,0 +1,240 @@
+import argparse
+import sys
+from typing import Callable, List, Optional, Sequence
+from .libbfiocpp import (
+    CompressionOptions,
+    ConversionOptions,
+    ConversionReport,
+    FileType,
+    convert_image,
+    rechunk_image,
+)
+from .tsreader import TSReader
+
+
+def _get_input_type(file_name: str) -> FileType:
+    name = file_name.rstrip("/").lower()
+    if name.endswith(".tif") or name.endswith(".tiff"):
+        return FileType.OmeTiff
+    return FileType.OmeZarrV2
+
+
+def _get_options(
+    chunk_shape: Optional[Sequence[int]],
+    zarr_version: int,
+    compression: Optional[str],
+    compression_level: int,
+    write_threads: int,
+    read_threads: int,
+    memory_limit: int,
+    resume: bool,
+) -> ConversionOptions:
+    if zarr_version not in (2, 3):
+        raise ValueError("zarr_version must be 2 or 3")
+    compression_options = CompressionOptions()
+    compression_options.codec = compression or ""
+    compression_options.level = compression_level
+    compression_options.num_threads = write_threads
+
+    options = ConversionOptions()
+    options.file_type = FileType.OmeZarrV2 if zarr_version == 2 else FileType.OmeZarrV3
+    options.chunk_shape = list(chunk_shape) if chunk_shape else []
+    options.compression = compression_options
+    options.read_threads = read_threads
+    options.memory_limit = memory_limit
+    options.resume = resume
+    return options
+
+
+def convert(
+    input_file: str,
+    output_file: str,
+    input_type: Optional[FileType] = None,
+    axes_list: str = "",
+    chunk_shape: Optional[Sequence[int]] = None,
+    zarr_version: int = 2,
+    compression: Optional[str] = None,
+    compression_level: int = -1,
+    write_threads: int = 0,
+    read_threads: int = 0,
+    memory_limit: int = 1 << 30,
+    resume: bool = False,
+    progress: Optional[Callable[[ConversionReport], None]] = None,
+) -> ConversionReport:
+    """Convert an image to a TCZYX OME-Zarr array chunk by chunk
+
+    Every destination chunk is read from the source, then encoded and written while
+    the next chunks are read, so reads and writes overlap. Committed chunks are
+    recorded in a journal in the output, which lets an interrupted conversion continue
+    with resume=True. Returns the number of chunks and bytes written and the time it
+    took.
+
+    input_type: FileType of input_file, None (default) guesses it from the extension
+    axes_list: Axes of a zarr input, like TSReader
+    chunk_shape: Destination chunks [T, C, Z, Y, X], None (default) for
+        [1, 1, 1, 1024, 1024]
+    zarr_version: 2 (default) or 3
+    compression, compression_level: Chunk codec and level, like TSWriter
+    write_threads: Threads encoding chunks, 0 (default) uses all cores
+    read_threads: Chunks read at the same time, 0 (default) for the number of cores
+    memory_limit: Bytes of chunk buffers in flight
+    progress: Called with the report after every written chunk
+    """
+    options = _get_options(
+        chunk_shape,
+        zarr_version,
+        compression,
+        compression_level,
+        write_threads,
+        read_threads,
+        memory_limit,
+        resume,
+    )
+    if input_type is None:
+        input_type = _get_input_type(input_file)
+    reader = TSReader(input_file, input_type, axes_list)
+    return convert_image(reader._image_reader, output_file, options, progress)
+
+
+def rechunk(
+    input_file: str,
+    output_file: str,
+    chunk_shape: Sequence[int],
+    input_type: FileType = FileType.OmeZarrV2,
+    axes_list: str = "",
+    zarr_version: int = 2,
+    compression: Optional[str] = None,
+    compression_level: int = -1,
+    write_threads: int = 0,
+    read_threads: int = 0,
+    memory_limit: int = 1 << 30,
+    resume: bool = False,
+    progress: Optional[Callable[[ConversionReport], None]] = None,
+) -> ConversionReport:
+    """Copy a zarr array to a TCZYX array with new chunks, format and codec
+
+    Reads and writes go through blocks aligned to both the source and the target
+    chunks, so every source chunk is read once and nothing is stored in between. If
+    such a block does not fit in half of memory_limit, blocks are made of fewer
+    target chunks and source chunks straddling two blocks are read twice. The input
+    is opened with a chunk cache of memory_limit bytes, which usually keeps those
+    chunks decoded until the second read. Arguments are like convert(), chunk_shape
+    [T, C, Z, Y, X] is required.
+    """
+    options = _get_options(
+        chunk_shape,
+        zarr_version,
+        compression,
+        compression_level,
+        write_threads,
+        read_threads,
+        memory_limit,
+        resume,
+    )
+    return rechunk_image(
+        input_file, input_type, axes_list, output_file, options, progress
+    )
+
+
+def _run(
+    argv: Optional[List[str]],
+    function: Callable[..., ConversionReport],
+    prog: str,
+    description: str,
+    chunks_required: bool,
+) -> int:
+    parser = argparse.ArgumentParser(prog=prog, description=description)
+    parser.add_argument("input", help="input image")
+    parser.add_argument("output", help="output zarr directory")
+    parser.add_argument("--axes", default="", help="axes of a zarr input, e.g. TCZYX")
+    parser.add_argument(
+        "--zarr-input-version",
+        type=int,
+        choices=[2, 3],
+        help="zarr version of the input, by default guessed from the extension",
+    )
+    parser.add_argument(
+        "--chunks",
+        type=int,
+        nargs=5,
+        required=chunks_required,
+        metavar=("T", "C", "Z", "Y", "X"),
+        help="destination chunk shape"
+        + ("" if chunks_required else " (default 1 1 1 1024 1024)"),
+    )
+    parser.add_argument("--zarr-version", type=int, choices=[2, 3], default=2)
+    parser.add_argument("--compression", help="none, blosc, zstd or gzip")
+    parser.add_argument("--compression-level", type=int, default=-1)
+    parser.add_argument("--write-threads", type=int, default=0)
+    parser.add_argument("--read-threads", type=int, default=0)
+    parser.add_argument(
+        "--memory-limit", type=int, default=1024, help="MiB of chunk buffers in flight"
+    )
+    parser.add_argument(
+        "--resume", action="store_true", help="continue an interrupted conversion"
+    )
+    parser.add_argument("--quiet", action="store_true", help="no progress output")
+    args = parser.parse_args(argv)
+
+    def report_progress(report: ConversionReport) -> None:
+        done = report.chunks_written + report.chunks_skipped
+        print(
+            f"\r{done}/{report.num_chunks} chunks, "
+            f"{report.megabytes_per_second:.1f} MB/s",
+            end="",
+            file=sys.stderr,
+        )
+
+    input_type = _get_input_type(args.input)
+    if args.zarr_input_version is not None:
+        input_type = (
+            FileType.OmeZarrV2 if args.zarr_input_version == 2 else FileType.OmeZarrV3
+        )
+
+    report = function(
+        args.input,
+        args.output,
+        input_type=input_type,
+        axes_list=args.axes,
+        chunk_shape=args.chunks,
+        zarr_version=args.zarr_version,
+        compression=args.compression,
+        compression_level=args.compression_level,
+        write_threads=args.write_threads,
+        read_threads=args.read_threads,
+        memory_limit=args.memory_limit << 20,
+        resume=args.resume,
+        progress=None if args.quiet else report_progress,
+    )
+    if not args.quiet:
+        print(file=sys.stderr)
+    print(
+        f"{report.chunks_written} chunks written ({report.chunks_skipped} skipped), "
+        f"{report.bytes_written / 1e6:.1f} MB in {report.seconds:.1f} s, "
+        f"{report.megabytes_per_second:.1f} MB/s"
+    )
+    return 0
+
+
+def main(argv: Optional[List[str]] = None) -> int:
+    return _run(
+        argv,
+        convert,
+        "bfiocpp-convert",
+        "Convert an OME-TIFF (or zarr) image to OME-Zarr",
+        chunks_required=False,
+    )
+
+
+def rechunk_main(argv: Optional[List[str]] = None) -> int:
+    return _run(
+        argv,
+        rechunk,
+        "bfiocpp-rechunk",
+        "Rechunk a zarr array, optionally changing the zarr version and codec",
+        chunks_required=True,
+    )
+
+
+if __name__ == "__main__":
+    sys.exit(main())
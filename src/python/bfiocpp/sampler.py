@@ -0,0 +1,75 @@
+import numpy as np
+from typing import Iterator, List, Optional, Sequence, Tuple
+from .libbfiocpp import PatchSamplerCPP, SamplerOptions, SamplingMask
+from .tsreader import TSReader
+
+
+class PatchSampler:
+    """Random patches from a set of images for training loops
+
+    Patches hold all channels of one Z and T. Reads run ahead on background threads
+    and batches are drawn at random from a shuffle buffer of read patches. A share of
+    the patches is drawn at chunks that were read recently, which are likely still in
+    the chunk cache.
+    """
+
+    def __init__(
+        self,
+        readers: Sequence[TSReader],
+        patch_size: Tuple[int, int] = (256, 256),
+        batch_size: int = 32,
+        masks: Optional[Sequence[Optional[np.ndarray]]] = None,
+        shuffle_buffer_size: int = 256,
+        prefetch: int = 64,
+        cache_affinity: float = 0.5,
+        seed: int = 0,
+    ) -> None:
+        """Initialize the sampler
+
+        readers: Images to sample from, with the same dtype and number of channels
+        patch_size: (height, width) of the patches
+        masks: None (default) samples every patch position uniformly. Otherwise one
+            2D array of non-negative weights per reader (None for uniform), which is
+            stretched over the image and used for every Z and T
+        shuffle_buffer_size: Read patches that batches are drawn from at random
+        prefetch: Patch reads kept in flight
+        cache_affinity: Probability of drawing a patch at a recently read chunk
+        seed: Random seed, 0 (default) picks a random seed
+        """
+        options = SamplerOptions()
+        options.patch_height, options.patch_width = patch_size
+        options.batch_size = batch_size
+        options.shuffle_buffer_size = shuffle_buffer_size
+        options.prefetch = prefetch
+        options.cache_affinity = cache_affinity
+        options.seed = seed
+
+        sampling_masks: List[SamplingMask] = []
+        for mask in masks or []:
+            sampling_mask = SamplingMask()
+            if mask is not None:
+                mask = np.asarray(mask, dtype=np.float64)
+                if mask.ndim != 2:
+                    raise ValueError("masks must be 2D arrays")
+                sampling_mask.height, sampling_mask.width = mask.shape
+                sampling_mask.weights = mask.ravel().tolist()
+            sampling_masks.append(sampling_mask)
+
+        self._sampler = PatchSamplerCPP(
+            [reader._image_reader for reader in readers], options, sampling_masks
+        )
+
+    def next_batch(self) -> Tuple[np.ndarray, np.ndarray]:
+        """Next batch of patches
+
+        Returns the (batch, C, height, width) patches and their (reader, T, Z, Y, X)
+        positions as a (batch, 5) array.
+        """
+        data, positions = self._sampler.next_batch()
+        return data, np.asarray(positions, dtype=np.int64).reshape(-1, 5)
+
+    def __iter__(self) -> Iterator[Tuple[np.ndarray, np.ndarray]]:
+        return self
+
+    def __next__(self) -> Tuple[np.ndarray, np.ndarray]:
+        return self.next_batch()
@@ -1,26 +1,473 @@
+import operator
 import numpy as np
-from typing import Tuple
-from .libbfiocpp import TsReaderCPP, Seq, FileType, get_ome_xml  # NOQA: F401
+from typing import Any, Callable, Dict, Iterator, List, Optional, Sequence, Tuple, Union
+from .libbfiocpp import (  # NOQA: F401
+    BatchOpen,
+    TsReaderCPP,
+    TsArrayView,
+    Seq,
+    FileType,
+    ImageInfo,
+    ReadConversion,
+    StatisticsOptions,
+    ImageStatistics,
+    MapTilesOptions,
+    ChannelReduction,
+    SlidingWindowOptions,
+    ThumbnailOptions,
+    get_ome_xml,
+    get_tile_kernel_names,
+    get_thumbnails as _get_thumbnails,
+    probe_image as _probe_image,
+    probe_images as _probe_images,
+)
+from .tswriter import TSWriter
+
+
+def _get_thumbnail_options(max_size: int, z: int, t: int) -> ThumbnailOptions:
+    options = ThumbnailOptions()
+    options.max_size = max_size
+    options.layer = z
+    options.tstep = t
+    return options
+
+
+def get_thumbnails(
+    files: Sequence[str],
+    file_type: FileType,
+    axes_list: str = "",
+    max_size: int = 1024,
+    z: int = 0,
+    t: int = 0,
+    num_threads: int = 0,
+) -> List[Tuple[Optional[np.ndarray], str]]:
+    """TSReader.thumbnail() of every file, num_threads files are read at a time
+
+    Returns a (thumbnail, error) pair per file. A file that fails has None and its
+    error message instead of raising, otherwise the error is "".
+
+    num_threads: Files opened and read concurrently, 0 (default) for one per core
+    """
+    return _get_thumbnails(
+        list(files),
+        file_type,
+        axes_list,
+        _get_thumbnail_options(max_size, z, t),
+        num_threads,
+    )
+
+
+def probe_image(path: str, file_type: FileType, axes_list: str = "") -> ImageInfo:
+    """Shape, dtype, tile size and level count of an image from its metadata only
+
+    Reads the TIFF tags and OME-XML Pixels, or the zarr array metadata, without
+    opening a reader. axes_list is used like TSReader for zarr arrays that are not
+    TCZYX. Raises RuntimeError if the metadata can not be read.
+    """
+    return _probe_image(path, file_type, axes_list)
+
+
+def probe_images(
+    paths: Sequence[str], file_type: FileType, axes_list: str = "", num_threads: int = 0
+) -> List[ImageInfo]:
+    """probe_image() of every path on num_threads threads (0 for one per core)
+
+    A file that fails has its error message in ImageInfo.error instead of raising.
+    """
+    return _probe_images(list(paths), file_type, axes_list, num_threads)
+
+
+def open_readers(
+    files: Sequence[str],
+    file_type: FileType,
+    axes_list: str = "",
+    max_in_flight: int = 0,
+    num_threads: int = 0,
+) -> Iterator[Tuple[int, Optional["TSReader"], str]]:
+    """Open many files concurrently, yielding readers as their opens complete
+
+    All opens share one tensorstore context and are issued without waiting for each
+    other. Yields (index in files, reader, "") for every file, or (index, None, error)
+    for a file that could not be opened.
+
+    max_in_flight: Opens pending at a time, 0 (default) for 256
+    num_threads: Threads reading the pyramid metadata of the files and issuing the
+        opens, 0 (default) for one per core
+    """
+    batch = BatchOpen(list(files), file_type, axes_list, max_in_flight, num_threads)
+    while True:
+        result = batch.next()
+        if result is None:
+            return
+        index, image_reader, error = result
+        if image_reader is None:
+            yield index, None, error
+        else:
+            yield index, TSReader._from_image_reader(image_reader, file_type), error
+
+
+class TSArray:
+    """Lazy array over an image
+
+    Indexing with integers, slices (with steps) and Ellipsis returns another TSArray
+    without reading anything. Data is read once, when the array is materialized with
+    read() or np.asarray().
+    """
+
+    def __init__(self, view: TsArrayView) -> None:
+        self._view = view
+
+    @property
+    def shape(self) -> Tuple[int, ...]:
+        return tuple(self._view.shape)
+
+    @property
+    def ndim(self) -> int:
+        return self._view.ndim
+
+    @property
+    def dtype(self) -> np.dtype:
+        return np.dtype(self._view.get_datatype())
+
+    @property
+    def chunks(self) -> Tuple[int, ...]:
+        """Read chunk shape, 0 where slicing made the chunks irregular"""
+        return tuple(self._view.chunks)
+
+    def __len__(self) -> int:
+        return self.shape[0]
+
+    def __getitem__(self, key: Any) -> "TSArray":
+        if not isinstance(key, tuple):
+            key = (key,)
+        if sum(k is Ellipsis for k in key) > 1:
+            raise IndexError("an index can only have a single ellipsis ('...')")
+        num_explicit = sum(k is not Ellipsis for k in key)
+        if num_explicit > self.ndim:
+            raise IndexError(
+                f"too many indices: array is {self.ndim}-dimensional, "
+                f"but {num_explicit} were indexed"
+            )
+        if Ellipsis in key:
+            position = key.index(Ellipsis)
+            fill = (slice(None),) * (self.ndim - num_explicit)
+            key = key[:position] + fill + key[position + 1 :]
+        key = key + (slice(None),) * (self.ndim - len(key))
+
+        # last dimension first, so integer indices do not shift the others
+        view = self._view
+        shape = self.shape
+        for dim in reversed(range(self.ndim)):
+            item = key[dim]
+            if isinstance(item, slice):
+                start, stop, step = item.indices(shape[dim])
+                if len(range(start, stop, step)) == 0:
+                    start, stop, step = 0, 0, 1
+                if (start, stop, step) != (0, shape[dim], 1):
+                    view = view.slice(dim, start, stop, step)
+            else:
+                index = operator.index(item)
+                if not -shape[dim] <= index < shape[dim]:
+                    raise IndexError(
+                        f"index {index} is out of bounds for axis {dim} "
+                        f"with size {shape[dim]}"
+                    )
+                view = view.index(dim, index % shape[dim])
+        return TSArray(view)
+
+    def read(self) -> np.ndarray:
+        """Read the data of the array"""
+        return self._view.read()
+
+    def __array__(self, dtype=None, copy=None) -> np.ndarray:
+        data = self.read()
+        return data if dtype is None else data.astype(dtype, copy=False)
+
+    def __repr__(self) -> str:
+        return f"TSArray(shape={self.shape}, dtype={self.dtype}, chunks={self.chunks})"
 
 
 class TSReader:
 
     READ_ONLY_MESSAGE: str = "{} is read-only."
 
-    def __init__(self, file_name: str, file_type: FileType, axes_list: str) -> None:
-        self._image_reader: TsReaderCPP = TsReaderCPP(file_name, file_type, axes_list)
+    def __init__(
+        self,
+        file_name: str,
+        file_type: FileType,
+        axes_list: str,
+        tiles_per_chunk: Optional[Tuple[int, int]] = None,
+    ) -> None:
+        """Initialize tensorstore reader
+
+        tiles_per_chunk: OME-TIFF only. Number of native tiles (Y, X) read as one
+            chunk, which amortizes the per-tile overhead of files with small
+            tiles. None (default) reads one tile per chunk
+        """
+        self._image_reader: TsReaderCPP = TsReaderCPP(
+            file_name, file_type, axes_list, list(tiles_per_chunk or [])
+        )
+        self._update_shape()
+        self._datatype: int = self._image_reader.get_datatype()
+        self._filetype = file_type
+
+    @classmethod
+    def _from_image_reader(
+        cls, image_reader: TsReaderCPP, file_type: FileType
+    ) -> "TSReader":
+        reader = cls.__new__(cls)
+        reader._image_reader = image_reader
+        reader._update_shape()
+        reader._datatype = image_reader.get_datatype()
+        reader._filetype = file_type
+        return reader
+
+    def _update_shape(self) -> None:
         self._Y: int = self._image_reader.get_image_height()
         self._X: int = self._image_reader.get_image_width()
         self._Z: int = self._image_reader.get_image_depth()
         self._C: int = self._image_reader.get_channel_count()
         self._T: int = self._image_reader.get_tstep_count()
-        self._datatype: int = self._image_reader.get_datatype()
-        self._filetype = file_type
+
+    @property
+    def level_count(self) -> int:
+        """Number of levels of an OME-Zarr multiscales group, 1 otherwise"""
+        return self._image_reader.get_level_count()
+
+    @property
+    def level(self) -> int:
+        """Level that is currently read"""
+        return self._image_reader.get_level()
+
+    def level_scales(self) -> List[List[float]]:
+        """Scale factors of every level relative to level 0, in array dimension order"""
+        return [
+            self._image_reader.get_level_scale(level)
+            for level in range(self.level_count)
+        ]
+
+    def set_level(self, level: int) -> None:
+        """Read from another level, the image dimensions are updated"""
+        self._image_reader.set_level(level)
+        self._update_shape()
+
+    def select_level(self, height: int, width: int) -> int:
+        """Read from the coarsest level that is at least height x width
+
+        Returns the selected level, level 0 if no level is large enough.
+        """
+        self.set_level(self._image_reader.get_level_for_size(height, width))
+        return self.level
 
     def data(
-        self, rows: Seq, cols: Seq, layers: Seq, channels: Seq, tsteps: Seq
+        self,
+        rows: Seq,
+        cols: Seq,
+        layers: Seq,
+        channels: Seq,
+        tsteps: Seq,
+        dtype: Optional[Union[str, np.dtype]] = None,
+        scale: Optional[Union[float, Sequence[float]]] = None,
+        offset: Optional[Union[float, Sequence[float]]] = None,
+        clip: Optional[Tuple[Optional[float], Optional[float]]] = None,
+        rescale: Optional[Tuple[Any, Any]] = None,
+        axes: Optional[str] = None,
     ) -> np.ndarray:
-        return self._image_reader.get_image_data(rows, cols, layers, channels, tsteps)
+        """Read a region, optionally converted while it is read
+
+        dtype: Output data type, None (default) keeps the image data type
+        scale, offset: Affine applied as data * scale + offset, a single value or
+            one value per channel read
+        clip: (min, max) applied after the affine, either may be None
+        rescale: (low, high) mapped to [0, 1] and clipped, a single value or one
+            value per channel read for each bound, e.g. per-channel percentiles.
+            Replaces scale, offset and clip. Raises ValueError if low equals high
+        axes: Axis order of the returned array, e.g. "YXC" or "ZYX". Axes left out
+            must have length 1 and are squeezed. None (default) returns TCZYX
+        """
+        conversion = ReadConversion()
+        if dtype is not None:
+            conversion.dtype = str(np.dtype(dtype))
+        if rescale is not None:
+            low = np.atleast_1d(np.asarray(rescale[0], dtype=np.float64))
+            high = np.atleast_1d(np.asarray(rescale[1], dtype=np.float64))
+            if np.any(high == low):
+                raise ValueError("rescale low and high must differ for every channel")
+            scale = 1.0 / (high - low)
+            offset = -low * scale
+            clip = (0.0, 1.0)
+        if scale is not None:
+            conversion.scale = np.atleast_1d(scale).astype(np.float64).tolist()
+        if offset is not None:
+            conversion.offset = np.atleast_1d(offset).astype(np.float64).tolist()
+        if clip is not None:
+            conversion.clip_min, conversion.clip_max = clip
+
+        return self._image_reader.get_image_data(
+            rows, cols, layers, channels, tsteps, conversion, axes or ""
+        )
+
+    @property
+    def array(self) -> TSArray:
+        """Lazy TCZYX array of the current level, e.g. reader.array[0, :, 5, ::2]"""
+        return TSArray(self._image_reader.get_array_view())
+
+    def projection(
+        self,
+        rows: Seq,
+        cols: Seq,
+        layers: Seq,
+        channels: Seq,
+        tsteps: Seq,
+        method: str = "max",
+        axis: str = "Z",
+    ) -> np.ndarray:
+        """Project a region along Z or T without reading it into memory
+
+        method: "max" (default), "min", "sum" or "mean". max and min keep the image
+            data type, sum and mean are float64
+        axis: "Z" (default) or "T", which has length 1 in the returned TCZYX array
+        """
+        return self._image_reader.get_projection(
+            rows, cols, layers, channels, tsteps, method, axis
+        )
+
+    def thumbnail(self, max_size: int = 1024, z: int = 0, t: int = 0) -> np.ndarray:
+        """(C, Y, X) thumbnail of a plane with its longest side max_size
+
+        The coarsest pyramid level that is large enough is sampled with one pixel per
+        block, so only the tiles or strips holding a sampled pixel are read. Without
+        a pyramid level close to max_size, tiles larger than a block each hold a
+        sampled pixel, so every tile of the plane is still decoded. Images smaller
+        than max_size are returned at full size. The current level is kept.
+        """
+        return self._image_reader.get_thumbnail(_get_thumbnail_options(max_size, z, t))
+
+    def statistics(
+        self,
+        per_layer: bool = False,
+        per_tstep: bool = False,
+        num_bins: int = 0,
+        histogram_range: Optional[Tuple[float, float]] = None,
+    ) -> List[ImageStatistics]:
+        """Per-channel min, max, mean, std and histogram of the current level
+
+        The image is reduced chunk by chunk in parallel, so only a few chunks are in
+        memory at a time.
+
+        per_layer, per_tstep: Separate statistics for every Z and/or T, otherwise
+            they are aggregated (layer and tstep are -1)
+        num_bins: Histogram bins, 0 (default) uses one bin per value for 8 and 16
+            bit integers and 1024 bins otherwise
+        histogram_range: (min, max) covered by the bins, values outside are counted
+            in the edge bins. None (default) uses the dtype range for 8 and 16 bit
+            integers and the data range otherwise, which reads the image twice
+        """
+        options = StatisticsOptions()
+        options.per_layer = per_layer
+        options.per_tstep = per_tstep
+        options.num_bins = num_bins
+        if histogram_range is not None:
+            options.histogram_min, options.histogram_max = histogram_range
+        return self._image_reader.compute_statistics(options)
+
+    def set_shading_correction(
+        self, flat: Optional["TSReader"] = None, dark: Optional["TSReader"] = None
+    ) -> None:
+        """Correct data() to (raw - dark) / flat while it is copied out
+
+        The correction is fused into the conversion of data(), so dtype, scale,
+        offset and clip apply to the corrected values. Without dtype the result keeps
+        the image dtype and is saturated, e.g. at 0 for uint16.
+
+        flat: Flat-field reference with the Y/X size of the current level and 1 channel
+            or one per channel
+        dark: Dark-frame reference, like flat
+        Without flat and dark the correction is removed.
+
+        Only data() applies the correction. While it is set, the reads that would
+        return raw values (array, projection(), statistics(), iter_tile_batches(),
+        map_tiles(), sliding_window(), thumbnail() and PatchSampler) raise
+        RuntimeError.
+        """
+        self._image_reader.set_shading_correction(
+            flat._image_reader if flat is not None else None,
+            dark._image_reader if dark is not None else None,
+        )
+
+    def map_tiles(
+        self,
+        kernel: Union[str, Callable[[np.ndarray], Optional[np.ndarray]]],
+        params: Optional[Dict[str, float]] = None,
+        tile_size: Tuple[int, int] = (1024, 1024),
+        output: Optional[TSWriter] = None,
+        num_threads: int = 0,
+    ) -> List[ChannelReduction]:
+        """Apply a kernel to every Y/X tile of every plane of the current level
+
+        Tiles are read, processed and written by a pool of threads, each taking the
+        next tile when it is done with one. Returns the count, nonzero count, sum, min
+        and max of the kernel output per channel.
+
+        kernel: Name of a C++ kernel, see get_tile_kernel_names(). The built-in
+            ones are "threshold" (params value), "subtract" (params value) and
+            "scale" (params factor and offset). Or a callable that gets a float64
+            (Y, X) copy of a tile and modifies it in place or returns the result.
+            Callables hold the GIL, so only the reads and writes around them run in
+            parallel.
+        params: Parameters of a built-in kernel
+        tile_size: (Y, X) size of the tiles
+        output: Writer with the shape of the image, the kernel output is converted to
+            its dtype with saturation. It is flushed before returning.
+        num_threads: Worker threads, 0 (default) uses one per core
+        """
+        options = MapTilesOptions()
+        options.tile_height, options.tile_width = tile_size
+        options.num_threads = num_threads
+        return self._image_reader.map_tiles(
+            kernel,
+            params or {},
+            options,
+            output._image_writer if output is not None else None,
+        )
+
+    def sliding_window(
+        self,
+        callback: Callable[[np.ndarray], np.ndarray],
+        output: TSWriter,
+        window_size: Tuple[int, int] = (512, 512),
+        overlap: Tuple[int, int] = (64, 64),
+        blend: str = "gaussian",
+        output_channels: int = 0,
+        prefetch: int = 8,
+    ) -> None:
+        """Run callback over overlapping windows and write the blended result
+
+        Windows of every Z/T plane of the current level are read ahead while the
+        callback runs. Results are accumulated in buffers aligned to the output chunks
+        and a chunk is written as soon as all windows overlapping it are done, so only
+        a band of the output is in memory. output is flushed before returning.
+
+        callback: Gets a float32 (C, Y, X) window of all channels and returns a
+            (output_channels, Y, X) result
+        output: Writer with the Y, X, Z and T size of the image and output_channels
+            channels
+        window_size: (Y, X) size of the windows
+        overlap: (Y, X) overlap of neighboring windows
+        blend: "gaussian" (default) weights results by a gaussian centered on each
+            window, "constant" averages them and "crop" keeps the center of every
+            window, dropping half of the overlap at each inner edge
+        output_channels: Channels returned by callback, 0 (default) for the input
+            channel count
+        prefetch: Windows read ahead of the callback
+        """
+        options = SlidingWindowOptions()
+        options.window_height, options.window_width = window_size
+        options.overlap_height, options.overlap_width = overlap
+        options.blend = blend
+        options.output_channels = output_channels
+        options.prefetch = prefetch
+        self._image_reader.run_sliding_window(output._image_writer, callback, options)
 
     def send_iter_read_request(
         self, tile_size: Tuple[int, int], tile_stride: Tuple[int, int]
@@ -29,6 +476,22 @@ class TSReader:
             tile_size[0], tile_size[1], tile_stride[0], tile_stride[1]
         )
 
+    def iter_tile_batches(
+        self, tile_size: Tuple[int, int], tile_stride: Tuple[int, int], batch_size: int
+    ) -> Iterator[Tuple[np.ndarray, np.ndarray]]:
+        """Iterate over the tiles of every plane, batch_size tiles at a time
+
+        The tiles of a batch are read concurrently into one array. Yields the
+        (N, stride Y, stride X) tiles, zero padded at the image edge, and their
+        (T, C, Z, Y_min, Y_max, X_min, X_max) coordinates as an (N, 7) array.
+        """
+        if batch_size < 1:
+            raise ValueError("batch_size must be positive")
+        self.send_iter_read_request(tile_size, tile_stride)
+        num_tiles = self._image_reader.get_iterator_request_count()
+        for first in range(0, num_tiles, batch_size):
+            yield self._image_reader.get_iterator_tile_batch(first, batch_size)
+
     def close(self):
         pass
 
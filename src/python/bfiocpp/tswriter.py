@@ -1,6 +1,14 @@
 import numpy as np
 from typing import Optional
-from .libbfiocpp import TsWriterCPP, Seq, FileType
+from .libbfiocpp import (
+    TsWriterCPP,
+    Seq,
+    FileType,
+    WriteFuture,
+    CompressionOptions,
+    ShardingOptions,
+    PyramidOptions,
+)
 
 
 class TSWriter:
@@ -13,6 +21,17 @@ class TSWriter:
         dtype: np.dtype,
         dimension_order: str,
         file_type: FileType = FileType.OmeZarrV2,
+        max_pending_writes: int = 16,
+        staging_bytes: int = 0,
+        compression: Optional[str] = None,
+        compression_level: int = -1,
+        blosc_cname: str = "lz4",
+        shuffle: str = "shuffle",
+        compression_threads: int = 0,
+        shard_shape: Optional[list] = None,
+        shard_index_location: str = "end",
+        pyramid_levels: int = 1,
+        downsample_method: str = "mean",
     ):
         """Initialize tensorstore Zarr writer
 
@@ -21,11 +40,68 @@ class TSWriter:
         chunk_shape: Shape of chunks [T, C, Z, Y, X]
         dtype: Data type of the image
         dimension_order: Order of dimensions (e.g., "TCZYX")
-        file_type: FileType.OmeZarrV2 (default) or FileType.OmeZarrV3
+        file_type: FileType.OmeZarrV2 (default), FileType.OmeZarrV3 or
+            FileType.OmeTiff. OME-TIFF is written as a tiled BigTIFF with the Y
+            and X sizes of chunk_shape as tile size (multiples of 16). Every
+            write is staged (without a memory cap if staging_bytes is 0) and
+            each tile is compressed once, so a tile must not be written again
+            after it is complete or evicted from staging
+        max_pending_writes: Maximum number of commits kept in flight by
+            write_image_data_async before it blocks
+        staging_bytes: Memory cap for assembling unaligned writes into whole
+            chunks before they are committed. 0 (default) disables staging.
+            With staging enabled, data is only guaranteed to be stored after
+            flush() or close()
+        compression: Chunk codec, one of "none", "blosc", "zstd" or "gzip".
+            None (default) keeps the tensorstore default, which is blosc for
+            zarr v2 and uncompressed for zarr v3. OME-TIFF supports "none",
+            "lzw", "deflate" (default) and "zstd"
+        compression_level: Codec level, 0 to 9 (0 to 22 for zstd). -1 (default)
+            uses the codec default
+        blosc_cname: Compressor used inside blosc ("lz4", "lz4hc", "blosclz",
+            "zstd" or "zlib")
+        shuffle: Blosc shuffle mode ("noshuffle", "shuffle" or "bitshuffle")
+        compression_threads: Number of threads encoding chunks or tiles, 0
+            (default) uses all cores
+        shard_shape: Zarr v3 only. Shape of the shards [T, C, Z, Y, X], each
+            stored as one file holding chunk_shape inner chunks. Must be a
+            multiple of chunk_shape. None (default) disables sharding
+        shard_index_location: Position of the shard index, "start" or "end"
+        pyramid_levels: Number of multiscale levels, each halving Y and X. With
+            more than 1 level, file_name is written as an OME-Zarr multiscale
+            group with the levels in file_name/0, file_name/1, ... The levels
+            are built from the written chunks, so writes go through the staging
+            buffer (256 MiB per level if staging_bytes is 0)
+        downsample_method: "mean" (default), "mode" for label images or "nearest"
         """
 
+        compression_options = CompressionOptions()
+        compression_options.codec = compression or ""
+        compression_options.level = compression_level
+        compression_options.blosc_cname = blosc_cname
+        compression_options.shuffle = shuffle
+        compression_options.num_threads = compression_threads
+
+        sharding_options = ShardingOptions()
+        sharding_options.shard_shape = list(shard_shape) if shard_shape else []
+        sharding_options.index_location = shard_index_location
+
+        pyramid_options = PyramidOptions()
+        pyramid_options.num_levels = pyramid_levels
+        pyramid_options.method = downsample_method
+
         self._image_writer: TsWriterCPP = TsWriterCPP(
-            file_name, image_shape, chunk_shape, str(dtype), dimension_order, file_type
+            file_name,
+            image_shape,
+            chunk_shape,
+            str(dtype),
+            dimension_order,
+            file_type,
+            max_pending_writes,
+            staging_bytes,
+            compression_options,
+            sharding_options,
+            pyramid_options,
         )
 
     def write_image_data(
@@ -51,11 +127,43 @@ class TSWriter:
             )
 
         except Exception as e:
-            raise RuntimeError(f"Error writing image data: {e.what}")
+            raise RuntimeError(f"Error writing image data: {e}")
+
+    def write_image_data_async(
+        self,
+        image_data: np.ndarray,
+        rows: Seq,
+        cols: Seq,
+        layers: Optional[Seq] = None,
+        channels: Optional[Seq] = None,
+        tsteps: Optional[Seq] = None,
+    ) -> WriteFuture:
+        """Write image data to file without waiting for the commit
+
+        image_data: 5d numpy array containing image data
+
+        Returns a WriteFuture once image_data has been copied. Errors are
+        raised by WriteFuture.result(), and by flush() or close(). With
+        staging enabled, a write that is staged returns a future that is
+        already done, and its errors are only raised by flush() or close().
+        """
+
+        if not isinstance(image_data, np.ndarray):
+            raise ValueError("Image data must be a 5d numpy array")
+
+        return self._image_writer.write_image_data_async(
+            image_data.flatten(), rows, cols, layers, channels, tsteps
+        )
+
+    def flush(self):
+        """Wait for all pending writes and raise any accumulated errors"""
+
+        self._image_writer.flush()
 
     def close(self):
 
-        pass
+        if hasattr(self, "_image_writer"):
+            self._image_writer.close()
 
     def __enter__(self) -> "TSWriter":
         """Handle entrance to a context manager.
@@ -1,4 +1,4 @@
-from bfiocpp import TSReader, Seq, FileType
+from bfiocpp import TSReader, TSWriter, Seq, FileType, PatchSampler, get_thumbnails, get_tile_kernel_names, open_readers, probe_images
 import unittest
 import requests, pathlib, shutil, logging, sys
 # SEE : Initialization of bio-formats java backend https://bio-formats.readthedocs.io/en/stable/developers/java-library.html
@@ -7,6 +7,12 @@ from ome_zarr.utils import download as zarr_download
 import bfio
 import numpy as np
 import random
+import tempfile, os
+
+try:
+    import tifffile
+except ImportError:
+    tifffile = None
 
 TEST_IMAGES = {
     "5025551.zarr": "https://uk1s3.embassy.ebi.ac.uk/idr/zarr/v0.4/idr0054A/5025551.zarr",
@@ -68,6 +74,14 @@ def tearDownModule():
     shutil.rmtree(TEST_DIR)
 
 
+def _write_image(file_path, data, chunk_shape, file_type=FileType.OmeZarrV2, **kwargs):
+    """Write all of a TCZYX array to file_path in its dtype"""
+    T, C, Z, Y, X = data.shape
+    bw = TSWriter(file_path, list(data.shape), chunk_shape, str(data.dtype), "TCZYX", file_type, **kwargs)
+    bw.write_image_data(data, Seq(0, Y - 1, 1), Seq(0, X - 1, 1), Seq(0, Z - 1, 1), Seq(0, C - 1, 1), Seq(0, T - 1, 1))
+    bw.close()
+
+
 class TestOmeTiffRead(unittest.TestCase):
 
     def test_read_ome_tif_full(self):
@@ -249,3 +263,549 @@ class TestOmeZarrRead(unittest.TestCase):
         assert tmp.dtype == np.uint8
         assert tmp.sum() == 81778531
         assert tmp.shape == (1, 4, 1, 1024, 1024)
+
+
+class TestOmeZarrMultiscaleRead(unittest.TestCase):
+
+    def test_read_zarr_multiscale_group(self):
+        """test_read_zarr_multiscale_group - Open the group instead of level 0"""
+        br = TSReader(str(TEST_DIR.joinpath("5025551.zarr")), FileType.OmeZarrV2, "")
+        assert br.level_count > 1
+        assert br.level == 0
+        assert br._X == 2702
+        assert br._Y == 2700
+
+        br.set_level(1)
+        assert br._X < 2702
+        assert br._Y < 2700
+        assert br.level_scales()[1][-1] > 1
+
+    def test_select_level(self):
+        """test_select_level - Pick the coarsest level for a requested size"""
+        shape = [1, 1, 1, 256, 256]
+        test_data = np.arange(256 * 256, dtype=np.uint16).reshape(shape)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "pyramid.zarr")
+            bw = TSWriter(file_path, shape, [1, 1, 1, 64, 64], "uint16", "TCZYX", pyramid_levels=4)
+            bw.write_image_data(test_data, Seq(0, 255, 1), Seq(0, 255, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            bw.close()
+
+            br = TSReader(file_path, FileType.OmeZarrV2, "TCZYX")
+            assert br.level_count == 4
+            assert br.level_scales()[3] == [1, 1, 1, 8, 8]
+
+            assert br.select_level(100, 60) == 1
+            assert (br._Y, br._X) == (128, 128)
+            assert br.select_level(32, 32) == 3
+            assert (br._Y, br._X) == (32, 32)
+            assert br.select_level(1000, 1000) == 0
+
+            br.set_level(2)
+            tmp = br.data(Seq(0, 63, 1), Seq(0, 63, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            assert tmp.shape == (1, 1, 1, 64, 64)
+
+
+@unittest.skipIf(tifffile is None, "tifffile is not installed")
+class TestOmeTiffPyramidRead(unittest.TestCase):
+
+    def test_read_ome_tif_subifd_levels(self):
+        """test_read_ome_tif_subifd_levels - Read reduced resolutions stored in SubIFDs"""
+        data = np.arange(256 * 320, dtype=np.uint16).reshape(256, 320)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "pyramid.ome.tif")
+            with tifffile.TiffWriter(file_path, bigtiff=True, ome=True) as tif:
+                tif.write(data, subifds=2, tile=(64, 64), metadata={"axes": "YX"})
+                tif.write(data[::2, ::2], subfiletype=1, tile=(64, 64))
+                tif.write(data[::4, ::4], subfiletype=1, tile=(64, 64))
+
+            br = TSReader(file_path, FileType.OmeTiff, "")
+            assert br.level_count == 3
+            assert (br._Y, br._X) == (256, 320)
+            assert br.level_scales()[2] == [1, 1, 1, 4, 4]
+
+            for level in range(3):
+                br.set_level(level)
+                expected = data[:: 2**level, :: 2**level]
+                assert (br._Y, br._X) == expected.shape
+                tmp = br.data(Seq(0, br._Y - 1, 1), Seq(0, br._X - 1, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+                assert np.array_equal(tmp[0, 0, 0], expected)
+
+            assert br.select_level(100, 100) == 1
+
+
+@unittest.skipIf(tifffile is None, "tifffile is not installed")
+class TestOmeTiffTilesPerChunkRead(unittest.TestCase):
+
+    def test_read_ome_tif_tiles_per_chunk(self):
+        """test_read_ome_tif_tiles_per_chunk - Read blocks of small native tiles as one chunk"""
+        data = np.arange(2 * 200 * 300, dtype=np.uint16).reshape(2, 200, 300)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "small_tiles.ome.tif")
+            tifffile.imwrite(file_path, data, tile=(32, 48), ome=True, metadata={"axes": "ZYX"})
+
+            br = TSReader(file_path, FileType.OmeTiff, "", tiles_per_chunk=(2, 3))
+            assert (br._Z, br._Y, br._X) == (2, 200, 300)
+            assert (br._image_reader.get_tile_height(), br._image_reader.get_tile_width()) == (64, 144)
+
+            # the region straddles chunks and the partial chunks on the image edge
+            tmp = br.data(Seq(50, 199, 1), Seq(100, 299, 1), Seq(0, 1, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            assert np.array_equal(tmp[0, 0], data[:, 50:200, 100:300])
+
+
+class TestConvertedRead(unittest.TestCase):
+
+    def test_read_converted(self):
+        """test_read_converted - Convert dtype and rescale per channel while reading"""
+        shape = [1, 2, 1, 300, 200]
+        data = np.random.default_rng(0).integers(0, 4000, size=shape, dtype=np.uint16)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "convert.zarr")
+            _write_image(file_path, data, [1, 1, 1, 64, 64])
+
+            br = TSReader(file_path, FileType.OmeZarrV2, "TCZYX")
+            region = (Seq(10, 289, 1), Seq(5, 199, 1), Seq(0, 0, 1), Seq(0, 1, 1), Seq(0, 0, 1))
+            native = data[..., 10:290, 5:200].astype(np.float64)
+
+            low, high = [100.0, 500.0], [3000.0, 3500.0]
+            tmp = br.data(*region, dtype=np.float32, rescale=(low, high))
+            assert tmp.dtype == np.float32
+            expected = np.stack([(native[:, c] - low[c]) / (high[c] - low[c]) for c in range(2)], axis=1)
+            assert np.allclose(tmp, np.clip(expected, 0, 1), atol=1e-6)
+
+            # integer outputs are rounded and saturated
+            tmp = br.data(*region, dtype="uint8", scale=0.1)
+            assert tmp.dtype == np.uint8
+            assert np.array_equal(tmp, np.clip(np.floor(native * 0.1 + 0.5), 0, 255).astype(np.uint8))
+
+            # an empty range, e.g. equal percentiles of a constant channel, cannot be rescaled
+            with self.assertRaises(ValueError):
+                br.data(*region, dtype=np.float32, rescale=([100.0, 200.0], [3000.0, 200.0]))
+
+
+class TestShadingCorrectedRead(unittest.TestCase):
+
+    def test_read_shading_corrected(self):
+        """test_read_shading_corrected - (raw - dark) / flat is applied while reading"""
+        shape = [1, 2, 1, 120, 100]
+        rng = np.random.default_rng(11)
+        data = rng.integers(500, 4000, size=shape, dtype=np.uint16)
+        flat = rng.uniform(0.5, 1.5, size=[1, 1, 1, 120, 100]).astype(np.float32)
+        dark = rng.integers(0, 200, size=shape, dtype=np.uint16)
+
+        with tempfile.TemporaryDirectory() as dir:
+            paths = {}
+            for name, image in [("data", data), ("flat", flat), ("dark", dark)]:
+                paths[name] = os.path.join(dir, f"{name}.zarr")
+                _write_image(paths[name], image, [1, 1, 1, 64, 64])
+
+            br = TSReader(paths["data"], FileType.OmeZarrV2, "TCZYX")
+            br.set_shading_correction(
+                flat=TSReader(paths["flat"], FileType.OmeZarrV2, "TCZYX"),
+                dark=TSReader(paths["dark"], FileType.OmeZarrV2, "TCZYX"),
+            )
+            region = (Seq(10, 109, 1), Seq(5, 99, 1), Seq(0, 0, 1), Seq(0, 1, 1), Seq(0, 0, 1))
+            expected = (data.astype(np.float64) - dark) / flat.astype(np.float64)
+            tmp = br.data(*region, dtype=np.float32)
+            assert np.allclose(tmp, expected[..., 10:110, 5:100], rtol=1e-5)
+
+            # reads that would skip the correction raise instead of returning raw data
+            with self.assertRaises(RuntimeError):
+                br.statistics()
+            with self.assertRaises(RuntimeError):
+                br.projection(*region)
+            with self.assertRaises(RuntimeError):
+                br.thumbnail(max_size=32)
+            with self.assertRaises(RuntimeError):
+                br.map_tiles("scale", {"factor": 1})
+
+            br.set_shading_correction()
+            assert np.array_equal(br.data(*region), data[..., 10:110, 5:100])
+
+
+class TestStatisticsRead(unittest.TestCase):
+
+    def test_statistics(self):
+        """test_statistics - Per-channel statistics and histograms match numpy"""
+        shape = [1, 2, 3, 130, 100]
+        data = np.random.default_rng(1).integers(0, 4000, size=shape, dtype=np.uint16)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "stats.zarr")
+            _write_image(file_path, data, [1, 1, 2, 64, 64])
+
+            br = TSReader(file_path, FileType.OmeZarrV2, "TCZYX")
+            stats = br.statistics()
+            assert len(stats) == 2
+            for s in stats:
+                channel = data[:, s.channel].astype(np.float64)
+                assert s.layer == -1 and s.tstep == -1
+                assert s.count == channel.size
+                assert s.min == channel.min() and s.max == channel.max()
+                assert np.isclose(s.mean, channel.mean()) and np.isclose(s.std, channel.std())
+                # one bin per value for uint16
+                assert np.array_equal(s.histogram, np.bincount(data[:, s.channel].ravel(), minlength=65536))
+
+            stats = br.statistics(per_layer=True, num_bins=16)
+            assert len(stats) == 6
+            for s in stats:
+                plane = data[0, s.channel, s.layer]
+                assert s.max == plane.max()
+                assert np.array_equal(s.histogram, np.histogram(plane, bins=16, range=(0, 65536))[0])
+
+    def test_statistics_large_offset(self):
+        """test_statistics_large_offset - The std of values far from zero keeps its precision"""
+        shape = [1, 1, 2, 100, 100]
+        data = 1e9 + np.random.default_rng(12).normal(0, 0.5, size=shape)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "offset.zarr")
+            _write_image(file_path, data, [1, 1, 1, 32, 32])
+
+            s = TSReader(file_path, FileType.OmeZarrV2, "TCZYX").statistics(num_bins=16)[0]
+            assert np.isclose(s.mean, data.mean(), rtol=0, atol=1e-6)
+            assert np.isclose(s.std, data.std(), rtol=1e-6)
+
+
+class TestProjectionRead(unittest.TestCase):
+
+    def test_projection(self):
+        """test_projection - Z and T projections match numpy"""
+        shape = [2, 2, 5, 150, 90]
+        data = np.random.default_rng(2).integers(0, 4000, size=shape, dtype=np.uint16)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "projection.zarr")
+            _write_image(file_path, data, [1, 1, 2, 64, 64])
+
+            br = TSReader(file_path, FileType.OmeZarrV2, "TCZYX")
+            region = (Seq(10, 139, 1), Seq(3, 89, 1), Seq(1, 4, 1), Seq(0, 1, 1), Seq(0, 1, 1))
+            native = data[:, :, 1:5, 10:140, 3:90]
+
+            tmp = br.projection(*region)
+            assert tmp.dtype == np.uint16 and tmp.shape == (2, 2, 1, 130, 87)
+            assert np.array_equal(tmp, native.max(axis=2, keepdims=True))
+
+            tmp = br.projection(*region, method="mean", axis="T")
+            assert tmp.dtype == np.float64 and tmp.shape == (1, 2, 4, 130, 87)
+            assert np.allclose(tmp, native.mean(axis=0, keepdims=True))
+
+
+class TestAxisOrderRead(unittest.TestCase):
+
+    def test_read_axis_order(self):
+        """test_read_axis_order - Reorder and squeeze axes while reading"""
+        shape = [1, 3, 2, 70, 50]
+        data = np.random.default_rng(3).integers(0, 4000, size=shape, dtype=np.uint16)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "axes.zarr")
+            _write_image(file_path, data, [1, 1, 1, 32, 32])
+
+            br = TSReader(file_path, FileType.OmeZarrV2, "TCZYX")
+            region = (Seq(5, 64, 1), Seq(0, 49, 1), Seq(1, 1, 1), Seq(0, 2, 1), Seq(0, 0, 1))
+            expected = np.transpose(data[0, :, 1, 5:65], (1, 2, 0))
+
+            tmp = br.data(*region, axes="YXC")
+            assert tmp.shape == (60, 50, 3)
+            assert np.array_equal(tmp, expected)
+
+            tmp = br.data(*region, dtype=np.float32, scale=0.5, axes="YXC")
+            assert tmp.shape == (60, 50, 3) and tmp.dtype == np.float32
+            assert np.allclose(tmp, expected * 0.5)
+
+            # only axes of length 1 can be squeezed
+            with self.assertRaises(ValueError):
+                br.data(*region, axes="ZYX")
+
+
+class TestArrayViewRead(unittest.TestCase):
+
+    def test_array_view(self):
+        """test_array_view - Lazy numpy style slicing reads the same data as numpy"""
+        shape = [2, 3, 4, 60, 45]
+        data = np.random.default_rng(4).integers(0, 4000, size=shape, dtype=np.uint16)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "view.zarr")
+            _write_image(file_path, data, [1, 1, 1, 32, 32])
+
+            br = TSReader(file_path, FileType.OmeZarrV2, "TCZYX")
+            array = br.array
+            assert array.shape == tuple(shape) and array.dtype == np.uint16
+            assert array.chunks == (1, 1, 1, 32, 32)
+
+            for key in [
+                (1, slice(None), 2),
+                (Ellipsis, slice(5, 50, 3), slice(None, None, -2)),
+                (0, -1, slice(1, 3), 10),
+            ]:
+                view = array[key]
+                assert view.shape == data[key].shape
+                assert np.array_equal(np.asarray(view), data[key])
+
+            # slicing a slice composes without reading
+            view = array[1][:, 1:3][..., 10:40, ::4]
+            assert np.array_equal(view.read(), data[1][:, 1:3][..., 10:40, ::4])
+
+            with self.assertRaises(IndexError):
+                array[2]
+
+
+class TestChunkViewRead(unittest.TestCase):
+
+    def test_read_aligned_chunk(self):
+        """test_read_aligned_chunk - Chunk aligned reads return writeable arrays of the chunk"""
+        shape = [1, 1, 2, 100, 80]
+        data = np.random.default_rng(5).integers(0, 4000, size=shape, dtype=np.uint16)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "chunks.zarr")
+            _write_image(file_path, data, [1, 1, 1, 64, 64])
+
+            br = TSReader(file_path, FileType.OmeZarrV2, "TCZYX")
+            # interior and edge chunks
+            for rows, cols in [((0, 63), (0, 63)), ((64, 99), (64, 79))]:
+                tmp = br.data(Seq(*rows, 1), Seq(*cols, 1), Seq(1, 1, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+                assert tmp.flags.writeable
+                assert np.array_equal(tmp, data[:, :, 1:2, rows[0] : rows[1] + 1, cols[0] : cols[1] + 1])
+                # the array is a copy, writing to it leaves the next read unchanged
+                tmp[:] = 0
+                tmp = br.data(Seq(*rows, 1), Seq(*cols, 1), Seq(1, 1, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+                assert np.array_equal(tmp, data[:, :, 1:2, rows[0] : rows[1] + 1, cols[0] : cols[1] + 1])
+
+            tmp = br.data(Seq(1, 63, 1), Seq(0, 63, 1), Seq(1, 1, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            assert tmp.flags.writeable
+            assert np.array_equal(tmp, data[:, :, 1:2, 1:64, 0:64])
+
+
+class TestPatchSampler(unittest.TestCase):
+
+    def test_patch_sampler(self):
+        """test_patch_sampler - Sampled patches match the images at their positions"""
+        shapes = [[1, 2, 3, 200, 150], [2, 2, 1, 120, 180]]
+        images = [np.random.default_rng(6 + i).integers(0, 4000, size=shape, dtype=np.uint16) for i, shape in enumerate(shapes)]
+
+        with tempfile.TemporaryDirectory() as dir:
+            readers = []
+            for i, (shape, data) in enumerate(zip(shapes, images)):
+                file_path = os.path.join(dir, f"sample{i}.zarr")
+                _write_image(file_path, data, [1, 1, 1, 64, 64])
+                readers.append(TSReader(file_path, FileType.OmeZarrV2, "TCZYX"))
+
+            sampler = PatchSampler(readers, patch_size=(32, 48), batch_size=8, shuffle_buffer_size=16, prefetch=8, seed=1)
+            for _ in range(5):
+                batch, positions = sampler.next_batch()
+                assert batch.shape == (8, 2, 32, 48) and batch.dtype == np.uint16
+                for patch, (image, t, z, y, x) in zip(batch, positions):
+                    assert np.array_equal(patch, images[image][t, :, z, y : y + 32, x : x + 48])
+
+            # only the lower right quarter of the first image has weight
+            masks = [np.array([[0.0, 0.0], [0.0, 1.0]]), np.zeros((1, 1))]
+            sampler = PatchSampler(readers, patch_size=(32, 32), batch_size=16, masks=masks, seed=2)
+            _, positions = sampler.next_batch()
+            assert np.all(positions[:, 0] == 0)
+            assert np.all(positions[:, 3] + 16 >= 100) and np.all(positions[:, 4] + 16 >= 75)
+
+
+class TestTileBatchRead(unittest.TestCase):
+
+    def test_tile_batches(self):
+        """test_tile_batches - Batched tile iteration matches the image"""
+        shape = [1, 2, 2, 100, 70]
+        data = np.random.default_rng(8).integers(0, 4000, size=shape, dtype=np.uint16)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "batches.zarr")
+            _write_image(file_path, data, [1, 1, 1, 64, 64])
+
+            br = TSReader(file_path, FileType.OmeZarrV2, "TCZYX")
+            num_tiles = 0
+            for tiles, coordinates in br.iter_tile_batches((32, 32), (32, 32), 5):
+                assert tiles.shape[1:] == (32, 32) and len(tiles) == len(coordinates) <= 5
+                for tile, (t, c, z, y_min, y_max, x_min, x_max) in zip(tiles, coordinates):
+                    expected = data[t, c, z, y_min : y_max + 1, x_min : x_max + 1]
+                    assert np.array_equal(tile[: expected.shape[0], : expected.shape[1]], expected)
+                    assert not tile[expected.shape[0] :].any() and not tile[:, expected.shape[1] :].any()
+                num_tiles += len(tiles)
+            assert num_tiles == 2 * 2 * 4 * 3
+
+
+class TestMapTiles(unittest.TestCase):
+
+    def test_map_tiles(self):
+        """test_map_tiles - Kernels are applied to every tile, written and reduced"""
+        shape = [1, 2, 1, 90, 70]
+        data = np.random.default_rng(9).integers(0, 1000, size=shape, dtype=np.uint16)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "input.zarr")
+            _write_image(file_path, data, [1, 1, 1, 32, 32])
+
+            br = TSReader(file_path, FileType.OmeZarrV2, "TCZYX")
+            assert {"threshold", "subtract", "scale"} <= set(get_tile_kernel_names())
+            output_path = os.path.join(dir, "mask.zarr")
+            mask_writer = TSWriter(output_path, shape, [1, 1, 1, 32, 32], "uint8", "TCZYX")
+            reductions = br.map_tiles("threshold", {"value": 500}, tile_size=(40, 30), output=mask_writer, num_threads=3)
+            mask_writer.close()
+
+            expected = data > 500
+            for reduction in reductions:
+                channel = expected[:, reduction.channel]
+                assert reduction.count == channel.size and reduction.nonzero == channel.sum()
+            mask = TSReader(output_path, FileType.OmeZarrV2, "TCZYX")
+            assert np.array_equal(mask.data(Seq(0, 89, 1), Seq(0, 69, 1), Seq(0, 0, 1), Seq(0, 1, 1), Seq(0, 0, 1)), expected)
+
+            reductions = br.map_tiles(lambda tile: tile * 2, tile_size=(64, 64))
+            for reduction in reductions:
+                assert reduction.sum == 2 * data[:, reduction.channel].sum()
+
+            # in place changes are kept, the tile is a copy that outlives the call
+            tiles = []
+
+            def double_in_place(tile):
+                tile *= 2
+                tiles.append(tile)
+
+            reductions = br.map_tiles(double_in_place, tile_size=(64, 64))
+            for reduction in reductions:
+                assert reduction.sum == 2 * data[:, reduction.channel].sum()
+            assert sum(tile.sum() for tile in tiles) == 2 * data.sum()
+
+
+class TestSlidingWindow(unittest.TestCase):
+
+    def test_sliding_window(self):
+        """test_sliding_window - Blended windows reproduce a pointwise callback"""
+        shape = [1, 2, 2, 100, 90]
+        data = np.random.default_rng(10).integers(0, 1000, size=shape, dtype=np.uint16)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "input.zarr")
+            _write_image(file_path, data, [1, 1, 1, 32, 32])
+
+            br = TSReader(file_path, FileType.OmeZarrV2, "TCZYX")
+            for blend in ["gaussian", "constant", "crop"]:
+                output_path = os.path.join(dir, f"{blend}.zarr")
+                output_shape = [1, 1, 2, 100, 90]
+                output = TSWriter(output_path, output_shape, [1, 1, 1, 32, 32], "float32", "TCZYX")
+                br.sliding_window(
+                    lambda window: window.sum(axis=0, keepdims=True),
+                    output,
+                    window_size=(48, 40),
+                    overlap=(12, 10),
+                    blend=blend,
+                    output_channels=1,
+                    prefetch=3,
+                )
+                output.close()
+
+                result = TSReader(output_path, FileType.OmeZarrV2, "TCZYX")
+                result_data = result.data(Seq(0, 99, 1), Seq(0, 89, 1), Seq(0, 1, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+                expected = data.sum(axis=1, keepdims=True, dtype=np.float32)
+                assert np.allclose(result_data, expected, rtol=1e-4)
+
+
+class TestThumbnail(unittest.TestCase):
+
+    def test_thumbnail_from_pyramid_level(self):
+        """test_thumbnail_from_pyramid_level - Use the level of the thumbnail size"""
+        shape = [1, 2, 1, 256, 256]
+        test_data = np.random.default_rng(11).integers(0, 4000, size=shape, dtype=np.uint16)
+
+        with tempfile.TemporaryDirectory() as dir:
+            file_path = os.path.join(dir, "pyramid.zarr")
+            _write_image(file_path, test_data, [1, 1, 1, 64, 64], pyramid_levels=4)
+
+            br = TSReader(file_path, FileType.OmeZarrV2, "TCZYX")
+            thumbnail = br.thumbnail(max_size=64)
+            assert br.level == 0
+            br.set_level(2)
+            level_data = br.data(Seq(0, 63, 1), Seq(0, 63, 1), Seq(0, 0, 1), Seq(0, 1, 1), Seq(0, 0, 1))
+            assert np.array_equal(thumbnail, level_data[0, :, 0])
+
+    def test_thumbnails_sampled(self):
+        """test_thumbnails_sampled - Sample the block centers of images without levels"""
+        shape = [1, 1, 1, 150, 130]
+        with tempfile.TemporaryDirectory() as dir:
+            files, images = [], []
+            for i in range(3):
+                file_path = os.path.join(dir, f"image_{i}.ome.tif")
+                data = np.random.default_rng(i).integers(0, 4000, size=shape, dtype=np.uint16)
+                _write_image(file_path, data, [1, 1, 1, 64, 64], FileType.OmeTiff)
+                files.append(file_path)
+                images.append(data)
+
+            # 150 x 130 to 50 x 43, one pixel of every 3 x ~3 block
+            rows = ((np.arange(50) + 0.5) * 150 / 50).astype(int)
+            cols = ((np.arange(43) + 0.5) * 130 / 43).astype(int)
+            files.insert(1, os.path.join(dir, "missing.ome.tif"))
+            thumbnails = get_thumbnails(files, FileType.OmeTiff, max_size=50, num_threads=2)
+            assert len(thumbnails) == 4
+            thumbnail, error = thumbnails.pop(1)
+            assert thumbnail is None and "missing.ome.tif" in error
+            for (thumbnail, error), data in zip(thumbnails, images):
+                assert error == ""
+                assert thumbnail.shape == (1, 50, 43)
+                assert np.array_equal(thumbnail[0], data[0, 0, 0][np.ix_(rows, cols)])
+
+
+class TestBatchOpen(unittest.TestCase):
+
+    def test_open_readers(self):
+        """test_open_readers - Open files concurrently with per-file errors"""
+        shape = [1, 1, 1, 40, 30]
+        with tempfile.TemporaryDirectory() as dir:
+            files, images = [], []
+            for i in range(6):
+                file_path = os.path.join(dir, f"field_{i}.zarr")
+                data = np.full(shape, i, dtype=np.uint8)
+                _write_image(file_path, data, [1, 1, 1, 16, 16])
+                files.append(file_path)
+                images.append(data)
+            files.insert(3, os.path.join(dir, "missing.zarr"))
+
+            with self.assertRaises(RuntimeError):
+                TSReader(files[3], FileType.OmeZarrV2, "TCZYX")
+
+            results = {}
+            for index, reader, error in open_readers(files, FileType.OmeZarrV2, "TCZYX", max_in_flight=2):
+                results[index] = (reader, error)
+            assert sorted(results) == list(range(7))
+
+            reader, error = results[3]
+            assert reader is None and "missing.zarr" in error
+            for index, data in zip([0, 1, 2, 4, 5, 6], images):
+                reader, error = results[index]
+                assert error == ""
+                tmp = reader.data(Seq(0, 39, 1), Seq(0, 29, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+                assert np.array_equal(tmp, data)
+
+
+class TestProbeImage(unittest.TestCase):
+
+    def test_probe_matches_reader(self):
+        """test_probe_matches_reader - Metadata only probe reports what a reader opens"""
+        shape = [1, 3, 2, 100, 70]
+        data = np.zeros(shape, dtype=np.int16)
+        with tempfile.TemporaryDirectory() as dir:
+            files = {}
+            for file_type, name in [(FileType.OmeTiff, "image.ome.tif"), (FileType.OmeZarrV2, "image.zarr"),
+                                    (FileType.OmeZarrV3, "image_v3.zarr")]:
+                file_path = os.path.join(dir, name)
+                _write_image(file_path, data, [1, 1, 1, 64, 32], file_type)
+                files[file_type] = file_path
+
+            for file_type, file_path in files.items():
+                info, missing = probe_images([file_path, os.path.join(dir, "missing")], file_type, "TCZYX")
+                assert info.error == ""
+                assert missing.error != ""
+
+                br = TSReader(file_path, file_type, "TCZYX")
+                assert (info.num_tsteps, info.num_channels, info.depth, info.height, info.width) == (br._T, br._C, br._Z, br._Y, br._X)
+                assert info.data_type == br._datatype == "int16"
+                assert (info.tile_height, info.tile_width) == (64, 32)
+                assert info.num_levels == br.level_count
@@ -1,4 +1,4 @@
-from bfiocpp import TSReader, TSWriter, Seq, FileType
+from bfiocpp import TSReader, TSWriter, Seq, FileType, convert, rechunk
 import unittest
 import requests, pathlib, shutil, logging, sys
 # SEE : Initialization of bio-formats java backend https://bio-formats.readthedocs.io/en/stable/developers/java-library.html
@@ -6,7 +6,7 @@ import requests, pathlib, shutil, logging, sys
 from ome_zarr.utils import download as zarr_download
 import bfio
 import numpy as np
-import tempfile, os
+import tempfile, os, json
 
 TEST_IMAGES = {
     "5025551.zarr": "https://uk1s3.embassy.ebi.ac.uk/idr/zarr/v0.4/idr0054A/5025551.zarr",
@@ -556,4 +556,403 @@ class TestZarrV3Write(unittest.TestCase):
                            ".zarray should exist for default v2 format")
             # Verify zarr.json does NOT exist
             self.assertFalse(os.path.exists(os.path.join(test_file_path, 'zarr.json')),
-                            "zarr.json should not exist for v2 format")
\ No newline at end of file
+                            "zarr.json should not exist for v2 format")
+
+class TestZarrAsyncWrite(unittest.TestCase):
+    """Tests for the asynchronous write-behind queue"""
+
+    def test_write_zarr_async(self):
+        """Test async tile writes with a small in-flight limit"""
+        with tempfile.TemporaryDirectory() as dir:
+            test_file_path = os.path.join(dir, 'test_async.zarr')
+
+            shape = [1, 1, 1, 256, 256]
+            chunk_shape = [1, 1, 1, 64, 64]
+
+            bw = TSWriter(test_file_path, shape, chunk_shape, "uint16", "TCZYX",
+                          max_pending_writes=2)
+
+            futures = []
+            for y_start in range(0, 256, 64):
+                for x_start in range(0, 256, 64):
+                    tile = np.full([1, 1, 1, 64, 64], fill_value=y_start + x_start, dtype=np.uint16)
+                    rows = Seq(y_start, y_start + 63, 1)
+                    cols = Seq(x_start, x_start + 63, 1)
+                    layers = Seq(0, 0, 1)
+                    channels = Seq(0, 0, 1)
+                    tsteps = Seq(0, 0, 1)
+                    futures.append(bw.write_image_data_async(tile, rows, cols, layers, channels, tsteps))
+
+            bw.close()
+            self.assertTrue(all(f.done() for f in futures))
+
+            br = TSReader(test_file_path, FileType.OmeZarrV2, "TCZYX")
+            read_data = br.data(Seq(0, 255, 1), Seq(0, 255, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            self.assertTrue(np.all(read_data[0, 0, 0, :64, :64] == 0))
+            self.assertTrue(np.all(read_data[0, 0, 0, 192:, 192:] == 384))
+
+    def test_write_zarr_error_raised(self):
+        """Test that an out of bounds write raises instead of being logged"""
+        with tempfile.TemporaryDirectory() as dir:
+            test_file_path = os.path.join(dir, 'test_error.zarr')
+
+            shape = [1, 1, 1, 32, 32]
+            bw = TSWriter(test_file_path, shape, shape, "uint16", "TCZYX")
+            tile = np.ones([1, 1, 1, 32, 32], dtype=np.uint16)
+
+            with self.assertRaises(Exception):
+                bw.write_image_data(tile, Seq(16, 47, 1), Seq(0, 31, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            with self.assertRaises(Exception):
+                bw.write_image_data_async(tile, Seq(16, 47, 1), Seq(0, 31, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+
+    def test_write_zarr_async_commit_error(self):
+        """Test that a failed async commit is raised by flush() and close()"""
+        for finish in ["flush", "close"]:
+            with tempfile.TemporaryDirectory() as dir:
+                test_file_path = os.path.join(dir, 'test_commit_error.zarr')
+
+                shape = [1, 1, 1, 32, 32]
+                bw = TSWriter(test_file_path, shape, shape, "uint16", "TCZYX")
+
+                # a file in place of the array makes every chunk write fail
+                shutil.rmtree(test_file_path)
+                pathlib.Path(test_file_path).touch()
+
+                tile = np.ones([1, 1, 1, 32, 32], dtype=np.uint16)
+                bw.write_image_data_async(tile, Seq(0, 31, 1), Seq(0, 31, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+
+                with self.assertRaises(Exception):
+                    getattr(bw, finish)()
+
+
+class TestZarrStagedWrite(unittest.TestCase):
+    """Tests for the chunk-assembling write buffer"""
+
+    def test_write_zarr_staged_unaligned(self):
+        """Test unaligned tiles assembled into chunks, with and without eviction"""
+        shape = [1, 1, 1, 300, 300]
+        chunk_shape = [1, 1, 1, 128, 128]
+        source_data = np.random.randint(0, 65535, shape, dtype=np.uint16)
+
+        # the second limit only fits a single chunk, so partial chunks get evicted
+        for staging_bytes in [64 * 1024 * 1024, 128 * 128 * 2]:
+            with tempfile.TemporaryDirectory() as dir:
+                test_file_path = os.path.join(dir, 'test_staged.zarr')
+
+                with TSWriter(test_file_path, shape, chunk_shape, "uint16", "TCZYX",
+                              staging_bytes=staging_bytes) as bw:
+                    for y_start in range(0, 300, 100):
+                        for x_start in range(0, 300, 100):
+                            tile = source_data[:, :, :, y_start:y_start + 100, x_start:x_start + 100]
+                            rows = Seq(y_start, y_start + 99, 1)
+                            cols = Seq(x_start, x_start + 99, 1)
+                            bw.write_image_data(tile, rows, cols, Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+
+                br = TSReader(test_file_path, FileType.OmeZarrV2, "TCZYX")
+                read_data = br.data(Seq(0, 299, 1), Seq(0, 299, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+                self.assertTrue(np.array_equal(read_data, source_data))
+
+    def test_write_zarr_staged_mismatched_data(self):
+        """Test that a staged write of the wrong dtype or size raises"""
+        with tempfile.TemporaryDirectory() as dir:
+            test_file_path = os.path.join(dir, 'test_staged_mismatch.zarr')
+
+            shape = [1, 1, 1, 256, 256]
+            chunk_shape = [1, 1, 1, 128, 128]
+            bw = TSWriter(test_file_path, shape, chunk_shape, "uint16", "TCZYX",
+                          staging_bytes=1 << 20)
+            rows, cols = Seq(0, 99, 1), Seq(0, 99, 1)
+
+            wrong_dtype = np.ones([1, 1, 1, 100, 100], dtype=np.uint8)
+            too_short = np.ones([1, 1, 1, 50, 100], dtype=np.uint16)
+            for tile in [wrong_dtype, too_short]:
+                with self.assertRaises(Exception):
+                    bw.write_image_data(tile, rows, cols, Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+                with self.assertRaises(Exception):
+                    bw.write_image_data_async(tile, rows, cols, Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            bw.close()
+
+
+class TestZarrCompressedWrite(unittest.TestCase):
+    """Tests for configurable compression codecs"""
+
+    def test_write_zarr_codecs(self):
+        """Test v2 and v3 writes with each codec round trip"""
+        shape = [1, 1, 1, 100, 100]
+        chunk_shape = [1, 1, 1, 64, 64]
+        test_data = np.arange(100 * 100, dtype=np.uint16).reshape(shape)
+
+        cases = [
+            (FileType.OmeZarrV2, "gzip", "lz4", "shuffle"),
+            (FileType.OmeZarrV2, "blosc", "zstd", "bitshuffle"),
+            (FileType.OmeZarrV3, "zstd", "lz4", "shuffle"),
+            (FileType.OmeZarrV3, "blosc", "lz4", "bitshuffle"),
+            (FileType.OmeZarrV3, "none", "lz4", "shuffle"),
+        ]
+
+        with tempfile.TemporaryDirectory() as dir:
+            for file_type, codec, cname, shuffle in cases:
+                test_file_path = os.path.join(dir, f'test_{file_type}_{codec}.zarr')
+
+                bw = TSWriter(test_file_path, shape, chunk_shape, "uint16", "TCZYX", file_type,
+                              compression=codec, compression_level=3, blosc_cname=cname, shuffle=shuffle)
+                bw.write_image_data(test_data, Seq(0, 99, 1), Seq(0, 99, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+                bw.close()
+
+                if file_type == FileType.OmeZarrV2:
+                    with open(os.path.join(test_file_path, '.zarray')) as f:
+                        compressor = json.load(f)["compressor"]
+                    self.assertEqual(compressor["id"], codec)
+                else:
+                    with open(os.path.join(test_file_path, 'zarr.json')) as f:
+                        codec_names = [c["name"] for c in json.load(f)["codecs"]]
+                    expected = ["bytes"] if codec == "none" else ["bytes", codec]
+                    self.assertEqual(codec_names, expected)
+
+                br = TSReader(test_file_path, file_type, "TCZYX")
+                read_data = br.data(Seq(0, 99, 1), Seq(0, 99, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+                self.assertTrue(np.array_equal(read_data, test_data))
+
+    def test_write_zarr_invalid_codec(self):
+        """Test that an unknown codec is rejected"""
+        with tempfile.TemporaryDirectory() as dir:
+            with self.assertRaises(Exception):
+                TSWriter(os.path.join(dir, 'invalid.zarr'), [1, 1, 1, 10, 10], [1, 1, 1, 10, 10],
+                         "uint16", "TCZYX", compression="lzma")
+
+    def test_write_zarr_invalid_level(self):
+        """Test that a level out of the codec range is rejected"""
+        with tempfile.TemporaryDirectory() as dir:
+            for codec, level in [("gzip", 10), ("blosc", 10), ("zstd", 23)]:
+                with self.assertRaises(Exception):
+                    TSWriter(os.path.join(dir, f'invalid_{codec}.zarr'), [1, 1, 1, 10, 10], [1, 1, 1, 10, 10],
+                             "uint16", "TCZYX", compression=codec, compression_level=level)
+
+
+class TestZarrShardedWrite(unittest.TestCase):
+    """Tests for zarr v3 sharding"""
+
+    def test_write_zarr_sharded(self):
+        """Test that inner chunks are stored in shards and read back"""
+        shape = [1, 1, 1, 200, 200]
+        chunk_shape = [1, 1, 1, 32, 32]
+        shard_shape = [1, 1, 1, 128, 128]
+        test_data = np.arange(200 * 200, dtype=np.uint16).reshape(shape)
+
+        with tempfile.TemporaryDirectory() as dir:
+            test_file_path = os.path.join(dir, 'test_sharded.zarr')
+
+            bw = TSWriter(test_file_path, shape, chunk_shape, "uint16", "TCZYX", FileType.OmeZarrV3,
+                          compression="zstd", shard_shape=shard_shape, staging_bytes=1 << 20)
+            for y in range(0, 200, 50):
+                bw.write_image_data(test_data[..., y:y+50, :], Seq(y, y+49, 1), Seq(0, 199, 1),
+                                    Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            bw.close()
+
+            with open(os.path.join(test_file_path, 'zarr.json')) as f:
+                metadata = json.load(f)
+            self.assertEqual(metadata["chunk_grid"]["configuration"]["chunk_shape"], shard_shape)
+            self.assertEqual(metadata["codecs"][0]["name"], "sharding_indexed")
+            self.assertEqual(metadata["codecs"][0]["configuration"]["chunk_shape"], chunk_shape)
+
+            # 2 x 2 shards instead of 7 x 7 chunks
+            num_files = sum(len(files) for _, _, files in os.walk(os.path.join(test_file_path, 'c')))
+            self.assertEqual(num_files, 4)
+
+            br = TSReader(test_file_path, FileType.OmeZarrV3, "TCZYX")
+            read_data = br.data(Seq(0, 199, 1), Seq(0, 199, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            self.assertTrue(np.array_equal(read_data, test_data))
+
+    def test_write_zarr_invalid_shard_shape(self):
+        """Test that a shard shape that is not a multiple of the chunk shape is rejected"""
+        with tempfile.TemporaryDirectory() as dir:
+            with self.assertRaises(Exception):
+                TSWriter(os.path.join(dir, 'invalid.zarr'), [1, 1, 1, 100, 100], [1, 1, 1, 32, 32],
+                         "uint16", "TCZYX", FileType.OmeZarrV3, shard_shape=[1, 1, 1, 48, 48])
+
+
+class TestZarrPyramidWrite(unittest.TestCase):
+    """Tests for multiscale pyramid generation during write"""
+
+    @staticmethod
+    def downsample_mean(image):
+        """Reference 2x mean downsampling in Y and X with odd edges"""
+        rows, cols = image.shape[-2:]
+        padded = np.pad(image.astype(np.float64), [(0, 0)] * 3 + [(0, rows % 2), (0, cols % 2)], mode="edge")
+        blocks = padded.reshape(padded.shape[:3] + (padded.shape[3] // 2, 2, padded.shape[4] // 2, 2))
+        return blocks.mean(axis=(4, 6))
+
+    def test_write_zarr_pyramid(self):
+        """Test that every level matches the downsampled full resolution image"""
+        shape = [1, 1, 1, 150, 130]
+        chunk_shape = [1, 1, 1, 32, 32]
+        rng = np.random.default_rng(0)
+        test_data = rng.integers(0, 1000, size=shape, dtype=np.uint16)
+
+        for file_type, metadata_file in [(FileType.OmeZarrV2, '.zattrs'), (FileType.OmeZarrV3, 'zarr.json')]:
+            with tempfile.TemporaryDirectory() as dir:
+                test_file_path = os.path.join(dir, 'test_pyramid.zarr')
+
+                # unaligned tiles and a small staging budget so some chunks are evicted incomplete
+                bw = TSWriter(test_file_path, shape, chunk_shape, "uint16", "TCZYX", file_type,
+                              staging_bytes=4 * 32 * 32 * 2, pyramid_levels=3)
+                for y in range(0, 150, 45):
+                    for x in range(0, 130, 50):
+                        y_end, x_end = min(y + 45, 150), min(x + 50, 130)
+                        bw.write_image_data(test_data[..., y:y_end, x:x_end], Seq(y, y_end - 1, 1), Seq(x, x_end - 1, 1),
+                                            Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+                bw.close()
+
+                with open(os.path.join(test_file_path, metadata_file)) as f:
+                    metadata = json.load(f)
+                if file_type == FileType.OmeZarrV3:
+                    metadata = metadata["attributes"]["ome"]
+                datasets = metadata["multiscales"][0]["datasets"]
+                self.assertEqual([d["path"] for d in datasets], ["0", "1", "2"])
+                self.assertEqual(datasets[2]["coordinateTransformations"][0]["scale"], [1, 1, 1, 4, 4])
+
+                # levels are downsampled from the rounded previous level
+                expected = test_data
+                for level in range(3):
+                    br = TSReader(os.path.join(test_file_path, str(level)), file_type, "TCZYX")
+                    rows, cols = expected.shape[-2:]
+                    read_data = br.data(Seq(0, rows - 1, 1), Seq(0, cols - 1, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+                    self.assertTrue(np.array_equal(read_data, expected))
+                    expected = np.floor(self.downsample_mean(expected) + 0.5).astype(np.uint16)
+
+    def test_write_zarr_pyramid_mode(self):
+        """Test that mode downsampling keeps label values"""
+        shape = [1, 1, 1, 64, 64]
+        test_data = np.zeros(shape, dtype=np.uint32)
+        test_data[..., 0:3, 0:3] = 7
+
+        with tempfile.TemporaryDirectory() as dir:
+            test_file_path = os.path.join(dir, 'test_labels.zarr')
+            bw = TSWriter(test_file_path, shape, [1, 1, 1, 32, 32], "uint32", "TCZYX",
+                          pyramid_levels=2, downsample_method="mode")
+            bw.write_image_data(test_data, Seq(0, 63, 1), Seq(0, 63, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            bw.close()
+
+            br = TSReader(os.path.join(test_file_path, '1'), FileType.OmeZarrV2, "TCZYX")
+            read_data = br.data(Seq(0, 1, 1), Seq(0, 1, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            # the 2x2 block at (1, 1) has one label pixel and three background pixels
+            self.assertEqual(read_data[0, 0, 0].tolist(), [[7, 7], [7, 0]])
+
+    def test_write_zarr_pyramid_close_error(self):
+        """Test that a failed close keeps raising instead of returning silently"""
+        shape = [1, 1, 1, 64, 64]
+        with tempfile.TemporaryDirectory() as dir:
+            test_file_path = os.path.join(dir, 'test_close_error.zarr')
+            bw = TSWriter(test_file_path, shape, [1, 1, 1, 32, 32], "uint16", "TCZYX", pyramid_levels=2)
+            tile = np.ones([1, 1, 1, 16, 16], dtype=np.uint16)
+            bw.write_image_data(tile, Seq(0, 15, 1), Seq(0, 15, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+
+            # a file in place of the group makes the staged chunks fail on close
+            shutil.rmtree(test_file_path)
+            pathlib.Path(test_file_path).touch()
+
+            for _ in range(2):
+                with self.assertRaises(Exception):
+                    bw.close()
+
+
+class TestOmeTiffWrite(unittest.TestCase):
+    """Verify writing tiled OME-TIFF files"""
+
+    def test_write_ome_tiff_codecs(self):
+        """Test that each codec round trips through the OME-TIFF reader"""
+        shape = [1, 2, 3, 100, 90]
+        rng = np.random.default_rng(0)
+        test_data = rng.integers(0, 50, size=shape, dtype=np.uint16)
+
+        for codec in ["none", "lzw", "deflate", "zstd"]:
+            with tempfile.TemporaryDirectory() as dir:
+                test_file_path = os.path.join(dir, 'test.ome.tif')
+
+                # unaligned writes are assembled into 64x64 tiles, edge tiles are padded
+                bw = TSWriter(test_file_path, shape, [1, 1, 1, 64, 64], "uint16", "TCZYX", FileType.OmeTiff,
+                              compression=codec)
+                for y in range(0, 100, 50):
+                    bw.write_image_data(test_data[..., y:y + 50, :], Seq(y, y + 49, 1), Seq(0, 89, 1),
+                                        Seq(0, 2, 1), Seq(0, 1, 1), Seq(0, 0, 1))
+                bw.close()
+
+                br = TSReader(test_file_path, FileType.OmeTiff, "TCZYX")
+                self.assertEqual((br._T, br._C, br._Z, br._Y, br._X), tuple(shape))
+                read_data = br.data(Seq(0, 99, 1), Seq(0, 89, 1), Seq(0, 2, 1), Seq(0, 1, 1), Seq(0, 0, 1))
+                self.assertTrue(np.array_equal(read_data, test_data), codec)
+
+    def test_write_ome_tiff_tile_written_twice(self):
+        """Test that rewriting an already compressed tile raises an error"""
+        shape = [1, 1, 1, 64, 64]
+        test_data = np.ones(shape, dtype=np.uint8)
+
+        with tempfile.TemporaryDirectory() as dir:
+            test_file_path = os.path.join(dir, 'test.ome.tif')
+            bw = TSWriter(test_file_path, shape, [1, 1, 1, 32, 32], "uint8", "TCZYX", FileType.OmeTiff)
+            bw.write_image_data(test_data, Seq(0, 63, 1), Seq(0, 63, 1), Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            with self.assertRaises(RuntimeError):
+                bw.write_image_data(test_data[..., :32, :32], Seq(0, 31, 1), Seq(0, 31, 1),
+                                    Seq(0, 0, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            bw.close()
+
+
+class TestConvertImage(unittest.TestCase):
+    """Verify the OME-TIFF to OME-Zarr conversion engine"""
+
+    def test_convert_resume(self):
+        """Test that an interrupted conversion resumes and matches the source"""
+        shape = [1, 2, 2, 150, 130]
+        test_data = np.random.default_rng(3).integers(0, 4000, size=shape, dtype=np.uint16)
+
+        with tempfile.TemporaryDirectory() as dir:
+            input_path = os.path.join(dir, 'input.ome.tif')
+            bw = TSWriter(input_path, shape, [1, 1, 1, 64, 64], "uint16", "TCZYX", FileType.OmeTiff)
+            bw.write_image_data(test_data, Seq(0, 149, 1), Seq(0, 129, 1), Seq(0, 1, 1), Seq(0, 1, 1), Seq(0, 0, 1))
+            bw.close()
+
+            output_path = os.path.join(dir, 'output.zarr')
+            chunks = [1, 1, 1, 50, 50]
+
+            def interrupt(report):
+                if report.chunks_written == 5:
+                    raise KeyboardInterrupt
+
+            with self.assertRaises(RuntimeError):
+                convert(input_path, output_path, chunk_shape=chunks, read_threads=2, progress=interrupt)
+
+            report = convert(input_path, output_path, chunk_shape=chunks, resume=True, memory_limit=3 * 50 * 50 * 2)
+            self.assertEqual(report.num_chunks, 2 * 2 * 3 * 3)
+            self.assertGreaterEqual(report.chunks_skipped, 5)
+            self.assertEqual(report.chunks_written + report.chunks_skipped, report.num_chunks)
+            self.assertFalse(os.path.exists(os.path.join(output_path, '.bfiocpp_convert_journal')))
+
+            br = TSReader(output_path, FileType.OmeZarrV2, "TCZYX")
+            read_data = br.data(Seq(0, 149, 1), Seq(0, 129, 1), Seq(0, 1, 1), Seq(0, 1, 1), Seq(0, 0, 1))
+            self.assertTrue(np.array_equal(read_data, test_data))
+
+
+class TestRechunkImage(unittest.TestCase):
+    """Verify the zarr to zarr rechunking tool"""
+
+    def test_rechunk_planes_to_columns(self):
+        """Test rechunking YX plane chunks to Z columns with a new format and codec"""
+        shape = [1, 1, 12, 96, 80]
+        test_data = np.random.default_rng(4).integers(0, 4000, size=shape, dtype=np.uint16)
+
+        with tempfile.TemporaryDirectory() as dir:
+            input_path = os.path.join(dir, 'input.zarr')
+            bw = TSWriter(input_path, shape, [1, 1, 1, 96, 80], "uint16", "TCZYX", FileType.OmeZarrV2)
+            bw.write_image_data(test_data, Seq(0, 95, 1), Seq(0, 79, 1), Seq(0, 11, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            bw.close()
+
+            output_path = os.path.join(dir, 'output.zarr')
+            # a block aligned to both grids is the whole image, the limit only allows a quarter
+            report = rechunk(input_path, output_path, [1, 1, 12, 16, 16], axes_list="TCZYX", zarr_version=3,
+                             compression="zstd", memory_limit=96 * 80 * 12)
+            self.assertEqual(report.num_chunks, 6 * 5)
+            self.assertEqual(report.chunks_written, report.num_chunks)
+
+            br = TSReader(output_path, FileType.OmeZarrV3, "TCZYX")
+            read_data = br.data(Seq(0, 95, 1), Seq(0, 79, 1), Seq(0, 11, 1), Seq(0, 0, 1), Seq(0, 0, 1))
+            self.assertTrue(np.array_equal(read_data, test_data))